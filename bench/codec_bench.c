@@ -0,0 +1,368 @@
+/* ----------------------------------------------------------------------
+ *
+ * Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+ * for his excellent work in this area.
+ *
+ * @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+ *
+ * Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+ *
+ * Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+ *
+ * All rights reserved.
+ *
+ * XMediaLib is licensed by Xirsys, with permission, under the Apache
+ * License Version 2.0. (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See LICENSE for the full license text.
+ *
+ * ---------------------------------------------------------------------- */
+
+
+/*
+ * C level codec benchmark. Replays the test/samples corpora through every
+ * codec_ops table (and the resample.h converter resampler_nif.c and
+ * transcoder_nif.c share) with no VM in between, so the numbers are what
+ * the codecs themselves cost. Run it from the repository root: make bench
+ *
+ * Columns:
+ *   ns/frame      wall time per frame
+ *   frames/s      frames one core gets through per second
+ *   allocs/frame  malloc/calloc/realloc calls per frame (glibc only)
+ *   rtf           real-time factor, processing time / audio duration
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "codec.h"
+#include "resample.h"
+
+extern const codec_ops pcmu_codec_ops;
+extern const codec_ops pcma_codec_ops;
+extern const codec_ops g722_codec_ops;
+extern const codec_ops g726_codec_ops;
+extern const codec_ops g729_codec_ops;
+extern const codec_ops gsm_codec_ops;
+extern const codec_ops ilbc_codec_ops;
+extern const codec_ops lpc_codec_ops;
+extern const codec_ops dvi4_codec_ops;
+extern const codec_ops speex_codec_ops;
+extern const codec_ops opus_codec_ops;
+
+/* every case runs for at least this long */
+#define BENCH_MIN_NS 500000000ULL
+
+#ifdef __GLIBC__
+/* Count heap allocations made by the codecs and the libraries under them */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void __libc_free(void* ptr);
+
+static unsigned long long allocs = 0;
+
+void* malloc(size_t size) { allocs++; return __libc_malloc(size); }
+void* calloc(size_t n, size_t size) { allocs++; return __libc_calloc(n, size); }
+void* realloc(void* ptr, size_t size) { allocs++; return __libc_realloc(ptr, size); }
+void free(void* ptr) { __libc_free(ptr); }
+#define ALLOCS_AVAILABLE 1
+#else
+static unsigned long long allocs = 0;
+#define ALLOCS_AVAILABLE 0
+#endif
+
+typedef struct {
+	const char* name;
+	const codec_ops* ops;
+	int sample_rate;
+	int channels;
+	/* int16 samples (all channels) per frame to encode */
+	size_t frame_samples;
+	/* encoder input, 16-bit PCM */
+	const char* pcm;
+	int pcm_big_endian;
+	/* decoder input, fixed size frames or (payload_size 0) Opus test vectors */
+	const char* payload;
+	size_t payload_size;
+} bench_case;
+
+static const bench_case cases[] = {
+	{"PCMU", &pcmu_codec_ops, 8000, 1, 160, "test/samples/pcmu/raw-pcm16.raw", 1, "test/samples/pcmu/raw-ulaw.raw", 160},
+	{"PCMA", &pcma_codec_ops, 8000, 1, 160, "test/samples/pcma/raw-pcm16.raw", 1, "test/samples/pcma/raw-alaw.raw", 160},
+	{"G722", &g722_codec_ops, 8000, 1, 160, "test/samples/g722/sample-pcm-16-mono-8khz.raw", 1, "test/samples/g722/conf-adminmenu-162.g722", 160},
+	{"G726", &g726_codec_ops, 8000, 1, 160, "test/samples/pcmu/raw-pcm16.raw", 1, NULL, 0},
+	{"G729", &g729_codec_ops, 8000, 1, 160, "test/samples/g729/default_en.16-mono-8khz.raw", 1, "test/samples/g729/default_en.g729", 20},
+	{"GSM", &gsm_codec_ops, 8000, 1, 160, "test/samples/gsm/sample-pcm-16-mono-8khz.raw", 1, "test/samples/gsm/sample-gsm-16-mono-8khz.raw", 33},
+	{"iLBC(20)", &ilbc_codec_ops, 8000, 1, 160, "test/samples/ilbc/F00.INP", 1, "test/samples/ilbc/F00.BIT20", 38},
+	{"iLBC(30)", &ilbc_codec_ops, 8000, 1, 240, "test/samples/ilbc/F01.INP", 1, "test/samples/ilbc/F01.BIT30", 50},
+	{"LPC", &lpc_codec_ops, 8000, 1, 180, "test/samples/pcmu/raw-pcm16.raw", 1, NULL, 0},
+	{"DVI4", &dvi4_codec_ops, 8000, 1, 160, "test/samples/pcmu/raw-pcm16.raw", 1, NULL, 0},
+	{"SPEEX", &speex_codec_ops, 8000, 1, 160, "test/samples/speex/sample-pcm-16-mono-8khz.raw", 1, NULL, 0},
+	{"OPUS", &opus_codec_ops, 48000, 2, 1920, "test/samples/opus/testvector03.dec", 0, "test/samples/opus/testvector01.bit", 0},
+	{"OPUS", &opus_codec_ops, 48000, 2, 1920, NULL, 0, "test/samples/opus/testvector02.bit", 0},
+	{"OPUS", &opus_codec_ops, 48000, 2, 1920, NULL, 0, "test/samples/opus/testvector07.bit", 0},
+	{"OPUS", &opus_codec_ops, 48000, 2, 1920, NULL, 0, "test/samples/opus/testvector11.bit", 0},
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint8_t* read_file(const char* path, size_t* len)
+{
+	FILE* f = fopen(path, "rb");
+	uint8_t* buf;
+	long size;
+
+	if (!f)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	buf = (uint8_t*)malloc(size ? size : 1);
+	if (fread(buf, 1, size, f) != (size_t)size) {
+		free(buf);
+		buf = NULL;
+	}
+	fclose(f);
+	*len = size;
+	return buf;
+}
+
+static void to_host16(uint8_t* buf, size_t len, int big_endian)
+{
+	int16_t* pcm = (int16_t*)buf;
+	size_t i;
+
+	for (i = 0; i < len / 2; i++)
+		pcm[i] = big_endian ? (int16_t)((buf[2 * i] << 8) | buf[2 * i + 1])
+			: (int16_t)(buf[2 * i] | (buf[2 * i + 1] << 8));
+}
+
+static void report(const char* name, const char* op, uint64_t ns, uint64_t frames,
+		unsigned long long n_allocs, double frame_ns)
+{
+	double per_frame = (double)ns / frames;
+
+	printf("%-10s %-8s %10.0f %12.0f ", name, op, per_frame, 1e9 / per_frame);
+	if (ALLOCS_AVAILABLE)
+		printf("%12.2f ", (double)n_allocs / frames);
+	else
+		printf("%12s ", "n/a");
+	printf("%8.4f\n", per_frame / frame_ns);
+}
+
+/* Splits a payload file into frames, returns the number of frames */
+static size_t split_payload(const bench_case* c, uint8_t* buf, size_t len,
+		const uint8_t*** frames, size_t** sizes)
+{
+	size_t n = 0, cap = 64, pos = 0, size;
+
+	*frames = (const uint8_t**)malloc(cap * sizeof(uint8_t*));
+	*sizes = (size_t*)malloc(cap * sizeof(size_t));
+
+	while (pos < len) {
+		if (c->payload_size) {
+			size = c->payload_size;
+		} else {
+			/* Opus test vector: <<Len:32, FinalRange:32, Packet:Len/binary>> */
+			if (pos + 8 > len)
+				break;
+			size = ((size_t)buf[pos] << 24) | (buf[pos + 1] << 16) | (buf[pos + 2] << 8) | buf[pos + 3];
+			pos += 8;
+		}
+		if (pos + size > len)
+			break;
+		if (n == cap) {
+			cap *= 2;
+			*frames = (const uint8_t**)realloc(*frames, cap * sizeof(uint8_t*));
+			*sizes = (size_t*)realloc(*sizes, cap * sizeof(size_t));
+		}
+		(*frames)[n] = buf + pos;
+		(*sizes)[n] = size;
+		n++;
+		pos += size;
+	}
+	return n;
+}
+
+static void bench_encode(const bench_case* c, double frame_ns)
+{
+	size_t len, n, i;
+	uint8_t* pcm = read_file(c->pcm, &len);
+	uint8_t* out;
+	void* state;
+	uint64_t start, ns = 0, frames = 0;
+	unsigned long long a;
+
+	if (!pcm) {
+		fprintf(stderr, "%s: can't read %s\n", c->name, c->pcm);
+		return;
+	}
+	to_host16(pcm, len, c->pcm_big_endian);
+	n = len / 2 / c->frame_samples;
+
+	state = c->ops->init ? c->ops->init(c->sample_rate, c->channels) : NULL;
+	out = (uint8_t*)malloc(c->ops->max_encoded(state, c->frame_samples));
+
+	a = allocs;
+	while (ns < BENCH_MIN_NS && n) {
+		start = now_ns();
+		for (i = 0; i < n; i++)
+			c->ops->encode(state, (int16_t*)pcm + i * c->frame_samples, c->frame_samples,
+					out, c->ops->max_encoded(state, c->frame_samples));
+		ns += now_ns() - start;
+		frames += n;
+	}
+	a = allocs - a;
+
+	if (frames)
+		report(c->name, "encode", ns, frames, a, frame_ns);
+
+	if (c->ops->destroy)
+		c->ops->destroy(state);
+	free(out);
+	free(pcm);
+}
+
+static void bench_decode(const bench_case* c)
+{
+	size_t len, n, i, max, samples = 0;
+	double frame_ns;
+	uint8_t* buf = read_file(c->payload, &len);
+	const uint8_t** frames_in;
+	size_t* sizes;
+	int16_t* pcm;
+	void* state;
+	uint64_t start, ns = 0, frames = 0;
+	unsigned long long a;
+	int ret;
+	char name[32];
+
+	if (!buf) {
+		fprintf(stderr, "%s: can't read %s\n", c->name, c->payload);
+		return;
+	}
+	n = split_payload(c, buf, len, &frames_in, &sizes);
+
+	state = c->ops->init ? c->ops->init(c->sample_rate, c->channels) : NULL;
+	max = c->ops->max_decoded(state, c->payload_size ? c->payload_size : 1500);
+	pcm = (int16_t*)malloc(max * sizeof(int16_t));
+
+	a = allocs;
+	while (ns < BENCH_MIN_NS && n) {
+		samples = 0;
+		start = now_ns();
+		for (i = 0; i < n; i++) {
+			ret = c->ops->decode(state, frames_in[i], sizes[i], pcm, max);
+			if (ret < 0) {
+				fprintf(stderr, "%s: decode failed at frame %zu\n", c->name, i);
+				goto out;
+			}
+			samples += ret;
+		}
+		ns += now_ns() - start;
+		frames += n;
+	}
+	a = allocs - a;
+
+	/* frame sizes vary within the Opus vectors, so go by what came out */
+	frame_ns = n ? 1e9 * samples / c->channels / c->sample_rate / n : 0;
+
+	/* tell the Opus vectors apart */
+	if (c->payload_size)
+		snprintf(name, sizeof(name), "%s", c->name);
+	else
+		snprintf(name, sizeof(name), "%s/%.2s", c->name, strstr(c->payload, ".bit") - 2);
+
+	if (frames)
+		report(name, "decode", ns, frames, a, frame_ns);
+
+out:
+	if (c->ops->destroy)
+		c->ops->destroy(state);
+	free(pcm);
+	free(frames_in);
+	free(sizes);
+	free(buf);
+}
+
+/* 20 msec frames of 8 kHz mono up to 48 kHz, as Codec.encode does for Opus */
+static void bench_resampler(void)
+{
+	size_t len, n, i;
+	uint8_t* pcm = read_file("test/samples/pcmu/raw-pcm16.raw", &len);
+	int16_t out[960];
+	resample_state rs;
+	uint64_t start, ns = 0, frames = 0;
+	unsigned long long a;
+	long done;
+
+	if (!pcm)
+		return;
+	to_host16(pcm, len, 1);
+	n = len / 2 / 160;
+	resample_init(&rs, 48000, 1);
+
+	a = allocs;
+	while (ns < BENCH_MIN_NS && n) {
+		start = now_ns();
+		for (i = 0; i < n; i++) {
+			done = resample_run(&rs, (int16_t*)pcm + i * 160, 160, 8000, 1);
+			if (done < 0 || done > 960) {
+				fprintf(stderr, "resampler: failed at frame %zu\n", i);
+				goto out;
+			}
+			resample_output(&rs, done, out);
+		}
+		ns += now_ns() - start;
+		frames += n;
+	}
+	a = allocs - a;
+
+	report("resampler", "8k->48k", ns, frames, a, 20e6);
+
+out:
+	resample_free(&rs);
+	free(pcm);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t i;
+
+	printf("%-10s %-8s %10s %12s %12s %8s\n", "codec", "op", "ns/frame", "frames/s", "allocs/frame", "rtf");
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		const bench_case* c = &cases[i];
+		double frame_ns = 1e9 * (c->frame_samples / c->channels) / c->sample_rate;
+
+		if (argc > 1 && strcmp(argv[1], c->name))
+			continue;
+		if (c->pcm)
+			bench_encode(c, frame_ns);
+		if (c->payload)
+			bench_decode(c);
+	}
+
+	if (argc == 1 || !strcmp(argv[1], "resampler"))
+		bench_resampler();
+
+	return 0;
+}
@@ -0,0 +1,178 @@
+### ----------------------------------------------------------------------
+###
+### Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+### for his excellent work in this area.
+###
+### @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+###
+### Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+###
+### Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+###
+### All rights reserved.
+###
+### XMediaLib is licensed by Xirsys, with permission, under the Apache
+### License Version 2.0. (the "License");
+### you may not use this file except in compliance with the License.
+### You may obtain a copy of the License at
+###
+###      http://www.apache.org/licenses/LICENSE-2.0
+###
+### Unless required by applicable law or agreed to in writing, software
+### distributed under the License is distributed on an "AS IS" BASIS,
+### WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+### See the License for the specific language governing permissions and
+### limitations under the License.
+###
+### See LICENSE for the full license text.
+###
+### ----------------------------------------------------------------------
+
+
+# Elixir level codec benchmark, the counterpart of bench/codec_bench.c going
+# through XMediaLib.Codec (NIF call, binary allocation, resampling) instead
+# of calling the codecs from C. Run from the repository root:
+#
+#   mix run bench/codec_bench.exs [CODEC]
+#
+# words/frame is heap garbage produced per frame by the benchmarking process,
+# rtf the real-time factor (processing time / audio duration).
+
+defmodule XMediaLib.CodecBench do
+  alias XMediaLib.Codec
+  alias XMediaLib.Resampler
+
+  @min_ns 500_000_000
+
+  # {name, desc, int16 samples per frame, pcm file, big endian?, payload file, payload size}
+  # payload size 0 means Opus test vector framing
+  @cases [
+    {"PCMU", {'PCMU', 8000, 1}, 160, "test/samples/pcmu/raw-pcm16.raw", true,
+     "test/samples/pcmu/raw-ulaw.raw", 160},
+    {"PCMA", {'PCMA', 8000, 1}, 160, "test/samples/pcma/raw-pcm16.raw", true,
+     "test/samples/pcma/raw-alaw.raw", 160},
+    {"G722", {'G722', 8000, 1}, 160, "test/samples/g722/sample-pcm-16-mono-8khz.raw", true,
+     "test/samples/g722/conf-adminmenu-162.g722", 160},
+    {"G726", {'G726', 8000, 1}, 160, "test/samples/pcmu/raw-pcm16.raw", true, nil, nil},
+    {"G729", {'G729', 8000, 1}, 160, "test/samples/g729/default_en.16-mono-8khz.raw", true,
+     "test/samples/g729/default_en.g729", 20},
+    {"GSM", {'GSM', 8000, 1}, 160, "test/samples/gsm/sample-pcm-16-mono-8khz.raw", true,
+     "test/samples/gsm/sample-gsm-16-mono-8khz.raw", 33},
+    {"iLBC(20)", {'ILBC', 8000, 1}, 160, "test/samples/ilbc/F00.INP", true,
+     "test/samples/ilbc/F00.BIT20", 38},
+    {"iLBC(30)", {'ILBC', 8000, 1}, 240, "test/samples/ilbc/F01.INP", true,
+     "test/samples/ilbc/F01.BIT30", 50},
+    {"LPC", {'LPC', 8000, 1}, 180, "test/samples/pcmu/raw-pcm16.raw", true, nil, nil},
+    {"DVI4", {'DVI4', 8000, 1}, 160, "test/samples/pcmu/raw-pcm16.raw", true, nil, nil},
+    {"SPEEX", {'SPEEX', 8000, 1}, 160, "test/samples/speex/sample-pcm-16-mono-8khz.raw", true,
+     nil, nil},
+    {"OPUS", {'OPUS', 48000, 2}, 1920, "test/samples/opus/testvector03.dec", false,
+     "test/samples/opus/testvector01.bit", 0},
+    {"OPUS", {'OPUS', 48000, 2}, 1920, nil, nil, "test/samples/opus/testvector02.bit", 0},
+    {"OPUS", {'OPUS', 48000, 2}, 1920, nil, nil, "test/samples/opus/testvector07.bit", 0},
+    {"OPUS", {'OPUS', 48000, 2}, 1920, nil, nil, "test/samples/opus/testvector11.bit", 0}
+  ]
+
+  def run(args) do
+    IO.puts(
+      :io_lib.format("~-10s ~-8s ~10s ~12s ~12s ~8s", [
+        "codec",
+        "op",
+        "ns/frame",
+        "frames/s",
+        "words/frame",
+        "rtf"
+      ])
+    )
+
+    for {name, _, _, _, _, _, _} = c <- @cases, args == [] or args == [name] do
+      encode(c)
+      decode(c)
+    end
+
+    args in [[], ["resampler"]] && resampler()
+    :ok
+  end
+
+  defp encode({_, _, _, nil, _, _, _}), do: :ok
+
+  defp encode({name, {_, rate, channels} = desc, frame_samples, file, big_endian, _, _}) do
+    pcm = File.read!(file)
+    frames = for <<frame::binary-size(frame_samples * 2) <- to_host(pcm, big_endian)>>, do: frame
+    {:ok, codec} = Codec.open(desc)
+
+    {ns, n, words} = measure(frames, &Codec.encode(codec, {&1, rate, channels, 16}))
+    report(name, "encode", ns, n, words, 1.0e9 * frame_samples / channels / rate)
+  end
+
+  defp decode({_, _, _, _, _, nil, _}), do: :ok
+
+  defp decode({name, {_, rate, channels} = desc, _, _, _, file, size}) do
+    frames = split(File.read!(file), size)
+    {:ok, codec} = Codec.open(desc)
+
+    # frame sizes vary within the Opus vectors, so go by what came out
+    samples =
+      Enum.reduce(frames, 0, fn frame, acc ->
+        {:ok, {pcm, _, _, _}} = Codec.decode(codec, frame)
+        acc + div(byte_size(pcm), 2)
+      end)
+
+    label = if size == 0, do: name <> "/" <> String.slice(file, -6, 2), else: name
+    {ns, n, words} = measure(frames, &Codec.decode(codec, &1))
+    report(label, "decode", ns, n, words, 1.0e9 * samples / channels / rate / length(frames))
+  end
+
+  # 20 msec frames of 8 kHz mono up to 48 kHz, as Codec.encode does for Opus
+  defp resampler() do
+    pcm = to_host(File.read!("test/samples/pcmu/raw-pcm16.raw"), true)
+    frames = for <<frame::binary-size(320) <- pcm>>, do: frame
+    {:ok, resampler} = Resampler.new(48000, 1)
+
+    {ns, n, words} = measure(frames, &Resampler.process(resampler, &1, 8000, 1))
+    report("resampler", "8k->48k", ns, n, words, 20.0e6)
+  end
+
+  defp measure(frames, fun), do: measure(frames, fun, 0, 0, gc_words())
+
+  defp measure(frames, fun, ns, n, words) when ns < @min_ns do
+    start = :erlang.monotonic_time(:nanosecond)
+    Enum.each(frames, fun)
+    stop = :erlang.monotonic_time(:nanosecond)
+    measure(frames, fun, ns + stop - start, n + length(frames), words)
+  end
+
+  defp measure(_frames, _fun, ns, n, words), do: {ns, n, gc_words() - words}
+
+  defp gc_words() do
+    :erlang.garbage_collect()
+    {_, words, _} = :erlang.statistics(:garbage_collection)
+    words
+  end
+
+  defp split(bin, 0) do
+    for <<len::32, _range::32, frame::binary-size(len) <- bin>>, do: frame
+  end
+
+  defp split(bin, size), do: for(<<frame::binary-size(size) <- bin>>, do: frame)
+
+  defp to_host(pcm, false), do: pcm
+  defp to_host(pcm, true), do: for(<<s::big-16 <- pcm>>, into: <<>>, do: <<s::native-16>>)
+
+  defp report(name, op, ns, n, words, frame_ns) do
+    per_frame = ns / n
+
+    IO.puts(
+      :io_lib.format("~-10s ~-8s ~10b ~12b ~12.2f ~8.4f", [
+        name,
+        op,
+        round(per_frame),
+        round(1.0e9 / per_frame),
+        words / n,
+        per_frame / frame_ns
+      ])
+    )
+  end
+end
+
+XMediaLib.CodecBench.run(System.argv())
@@ -0,0 +1,70 @@
+/* ----------------------------------------------------------------------
+ *
+ * Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+ * for his excellent work in this area.
+ *
+ * @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+ *
+ * Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+ *
+ * Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+ *
+ * All rights reserved.
+ *
+ * XMediaLib is licensed by Xirsys, with permission, under the Apache
+ * License Version 2.0. (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See LICENSE for the full license text.
+ *
+ * ---------------------------------------------------------------------- */
+
+#ifndef __CODEC_H__
+#define __CODEC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* longest stretch of audio handled in one call where a bound is needed, in ms */
+#define CODEC_MAX_PTIME 120
+
+/*
+ * Every codec in c_src exposes one of these. The functions know nothing
+ * about the Erlang VM, so the same table is used by the NIF wrapper
+ * (codec_nif.h) and by anything else linking the codecs directly.
+ *
+ * encode() returns the number of bytes written to out, decode() returns the
+ * number of int16 samples (all channels) written to pcm. Both return -1 if
+ * the input is not something the codec can handle.
+ */
+typedef struct {
+	const char* name;
+	void* (*init)(int sample_rate, int channels);
+	void (*destroy)(void* state);
+	int (*encode)(void* state, const int16_t* pcm, size_t samples, uint8_t* out, size_t out_len);
+	int (*decode)(void* state, const uint8_t* in, size_t len, int16_t* pcm, size_t max_samples);
+	/* upper bounds used to size the output buffers */
+	size_t (*max_encoded)(void* state, size_t samples);
+	size_t (*max_decoded)(void* state, size_t len);
+	/* optional, returns the state to what init() produced, keeping the
+	 * allocations, so a codec can be handed on to another stream */
+	void (*reset)(void* state);
+	/* optional, changes an encoder setting at any point of the stream.
+	 * Returns -1 for an option or value the codec doesn't know */
+	int (*ctl)(void* state, const char* option, int value);
+	/* optional, conceals `samples` lost samples (whole codec frames) from
+	 * the decoder history. next is the packet after the loss, or NULL, for
+	 * codecs which carry FEC. Returns samples written or -1 like decode() */
+	int (*plc)(void* state, const uint8_t* next, size_t next_len, int16_t* pcm, size_t samples);
+} codec_ops;
+
+#endif /* __CODEC_H__ */
@@ -0,0 +1,476 @@
+/* ----------------------------------------------------------------------
+ *
+ * Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+ * for his excellent work in this area.
+ *
+ * @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+ *
+ * Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+ *
+ * Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+ *
+ * All rights reserved.
+ *
+ * XMediaLib is licensed by Xirsys, with permission, under the Apache
+ * License Version 2.0. (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See LICENSE for the full license text.
+ *
+ * ---------------------------------------------------------------------- */
+
+/*
+ * Generic NIF wrapper around a codec_ops table. Include it once, at the end
+ * of a codec source file, after defining CODEC_OPS:
+ *
+ *   #define CODEC_OPS pcmu_codec_ops
+ *   #include "codec_nif.h"
+ *   CODEC_NIF_INIT(Elixir.XMediaLib.Codec.PCMU)
+ *
+ * With CODEC_NO_NIF defined the wrapper compiles to nothing, leaving the
+ * bare codec_ops table for linking into plain C programs.
+ *
+ * Define CODEC_NIF_FLAGS as ERL_NIF_DIRTY_JOB_CPU_BOUND beforehand for codecs
+ * which are too expensive to run on a normal scheduler. CODEC_NIF_LOAD names
+ * a void function run once when the library is loaded, and
+ * CODEC_NIF_EXTRA_FUNCS appends codec specific entries to the function table.
+ *
+ * The codec state lives in a resource owned by the caller, so encode/decode
+ * are plain function calls - no process hop and no port in between.
+ * encode_frames/decode_frames take a list of frames and return a list, for
+ * long ptimes and offline transcoding. set_option/3 forwards an atom and an
+ * integer to the codec's ctl, for codecs which have one. reset/1 clears the
+ * codec history so the resource can be reused for another stream.
+ *
+ * set_option(vad, 1) puts voice activity detection (vad.h) in front of the
+ * encoder: silent frames aren't encoded at all, encode returns
+ * {ok, {cn, Payload}} when an RFC 3389 comfort noise packet is due and
+ * {ok, silence} otherwise. comfort_noise/3 is the receiving side, it plays
+ * out noise at the level of the last CN payload.
+ *
+ * decode_lost/3 stands in for decode/2 when a packet never arrived: the
+ * codec's plc conceals the given number of samples from its history, or
+ * recovers them from the FEC in the next payload where the codec has it.
+ * {error, unsupported} for codecs without plc.
+ */
+
+#ifndef __CODEC_NIF_H__
+#define __CODEC_NIF_H__
+
+#include "codec.h"
+
+#ifndef CODEC_OPS
+#error "CODEC_OPS must be defined before including codec_nif.h"
+#endif
+
+#ifdef CODEC_NO_NIF
+
+/*
+ * Linked into something else (transcoder_nif.c, bench/codec_bench.c), only
+ * the codec_ops table is wanted. CODEC_NIF_LOAD still has to run, so it runs at program startup.
+ */
+#ifdef CODEC_NIF_LOAD
+static void __attribute__((constructor)) codec_standalone_load(void)
+{
+	CODEC_NIF_LOAD();
+}
+#endif
+
+#define CODEC_NIF_INIT(MODULE)
+
+#else
+
+#include "erl_nif.h"
+#include "vad.h"
+
+#ifndef CODEC_NIF_FLAGS
+#define CODEC_NIF_FLAGS 0
+#endif
+
+typedef struct {
+	/* codecs keep history, so one call at a time per resource */
+	ErlNifMutex* lock;
+	void* state;
+	int sample_rate;
+	int channels;
+	int vad_on;
+	vad_state vad;
+	cn_state cn;
+} codec_resource;
+
+static ErlNifResourceType* codec_resource_type = NULL;
+
+static ERL_NIF_TERM atom_ok;
+static ERL_NIF_TERM atom_error;
+static ERL_NIF_TERM atom_codec_error;
+static ERL_NIF_TERM atom_unsupported;
+static ERL_NIF_TERM atom_cn;
+static ERL_NIF_TERM atom_silence;
+
+static void codec_resource_dtor(ErlNifEnv* env, void* obj)
+{
+	codec_resource* r = (codec_resource*)obj;
+	if (r->state && CODEC_OPS.destroy)
+		CODEC_OPS.destroy(r->state);
+	if (r->lock)
+		enif_mutex_destroy(r->lock);
+}
+
+static ERL_NIF_TERM codec_error(ErlNifEnv* env, ERL_NIF_TERM reason)
+{
+	return enif_make_tuple2(env, atom_error, reason);
+}
+
+static ERL_NIF_TERM codec_new(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	int sample_rate, channels;
+	codec_resource* r;
+	ERL_NIF_TERM term;
+
+	if (!enif_get_int(env, argv[0], &sample_rate) || !enif_get_int(env, argv[1], &channels))
+		return enif_make_badarg(env);
+
+	r = (codec_resource*)enif_alloc_resource(codec_resource_type, sizeof(codec_resource));
+	memset(r, 0, sizeof(codec_resource));
+	r->sample_rate = sample_rate;
+	r->channels = channels;
+	cn_init(&r->cn);
+
+	/* stateless codecs have no init */
+	if (CODEC_OPS.init) {
+		r->state = CODEC_OPS.init(sample_rate, channels);
+		if (!r->state) {
+			enif_release_resource(r);
+			return codec_error(env, atom_unsupported);
+		}
+	}
+	/* even without codec state there's the VAD and CN state to protect */
+	if (!(r->lock = enif_mutex_create((char*)"codec_resource"))) {
+		enif_release_resource(r);
+		return codec_error(env, atom_codec_error);
+	}
+
+	term = enif_make_resource(env, r);
+	enif_release_resource(r);
+
+	return enif_make_tuple2(env, atom_ok, term);
+}
+
+/* Caller holds the lock. Returns 0 if the codec rejected the frame */
+static int encode_frame(ErlNifEnv* env, codec_resource* r, ErlNifBinary* in, ERL_NIF_TERM* term)
+{
+	ErlNifBinary out;
+	size_t samples;
+	int ret;
+
+	if (in->size % 2 != 0)
+		return 0;
+
+	samples = in->size >> 1;
+
+	if (r->vad_on) {
+		int level;
+		switch (vad_process(&r->vad, (const int16_t*)in->data, samples, &level)) {
+		case VAD_SEND_CN:
+			enif_make_new_binary(env, 1, term)[0] = (unsigned char)level;
+			*term = enif_make_tuple2(env, atom_cn, *term);
+			return 1;
+		case VAD_SILENT:
+			*term = atom_silence;
+			return 1;
+		}
+	}
+
+	if (!enif_alloc_binary(CODEC_OPS.max_encoded(r->state, samples), &out))
+		return 0;
+
+	ret = CODEC_OPS.encode(r->state, (const int16_t*)in->data, samples, out.data, out.size);
+	if (ret < 0) {
+		enif_release_binary(&out);
+		return 0;
+	}
+	if ((size_t)ret != out.size)
+		enif_realloc_binary(&out, ret);
+
+	*term = enif_make_binary(env, &out);
+	return 1;
+}
+
+static int decode_frame(ErlNifEnv* env, codec_resource* r, ErlNifBinary* in, ERL_NIF_TERM* term)
+{
+	ErlNifBinary out;
+	size_t max_samples;
+	int ret;
+
+	max_samples = CODEC_OPS.max_decoded(r->state, in->size);
+	if (!enif_alloc_binary(max_samples * 2, &out))
+		return 0;
+
+	ret = CODEC_OPS.decode(r->state, in->data, in->size, (int16_t*)out.data, max_samples);
+	if (ret < 0) {
+		enif_release_binary(&out);
+		return 0;
+	}
+	if ((size_t)ret * 2 != out.size)
+		enif_realloc_binary(&out, ret * 2);
+
+	*term = enif_make_binary(env, &out);
+	return 1;
+}
+
+typedef int (*frame_fun)(ErlNifEnv*, codec_resource*, ErlNifBinary*, ERL_NIF_TERM*);
+
+static ERL_NIF_TERM codec_run(ErlNifEnv* env, const ERL_NIF_TERM argv[], frame_fun fun)
+{
+	codec_resource* r;
+	ErlNifBinary in;
+	ERL_NIF_TERM term;
+	int ok;
+
+	if (!enif_get_resource(env, argv[0], codec_resource_type, (void**)&r) ||
+			!enif_inspect_binary(env, argv[1], &in))
+		return enif_make_badarg(env);
+
+	if (r->lock)
+		enif_mutex_lock(r->lock);
+	ok = fun(env, r, &in, &term);
+	if (r->lock)
+		enif_mutex_unlock(r->lock);
+
+	return ok ? enif_make_tuple2(env, atom_ok, term) : codec_error(env, atom_codec_error);
+}
+
+/*
+ * Batch variant: a list of frames in, a list of frames out, with the lock
+ * taken and the NIF entered only once for the whole batch.
+ */
+static ERL_NIF_TERM codec_run_list(ErlNifEnv* env, const ERL_NIF_TERM argv[], frame_fun fun)
+{
+	codec_resource* r;
+	ErlNifBinary in;
+	ERL_NIF_TERM list, head, term, acc;
+	unsigned len;
+	int ok = 1;
+
+	if (!enif_get_resource(env, argv[0], codec_resource_type, (void**)&r) ||
+			!enif_get_list_length(env, argv[1], &len))
+		return enif_make_badarg(env);
+
+	/* check the input before any frame goes through the (stateful) codec */
+	for (list = argv[1]; enif_get_list_cell(env, list, &head, &list); )
+		if (!enif_inspect_binary(env, head, &in))
+			return enif_make_badarg(env);
+
+	acc = enif_make_list(env, 0);
+
+	if (r->lock)
+		enif_mutex_lock(r->lock);
+	for (list = argv[1]; ok && enif_get_list_cell(env, list, &head, &list); ) {
+		enif_inspect_binary(env, head, &in);
+		if ((ok = fun(env, r, &in, &term)))
+			acc = enif_make_list_cell(env, term, acc);
+	}
+	if (r->lock)
+		enif_mutex_unlock(r->lock);
+
+	if (!ok)
+		return codec_error(env, atom_codec_error);
+
+	enif_make_reverse_list(env, acc, &list);
+	return enif_make_tuple2(env, atom_ok, list);
+}
+
+static ERL_NIF_TERM codec_encode(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	return codec_run(env, argv, encode_frame);
+}
+
+static ERL_NIF_TERM codec_decode(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	return codec_run(env, argv, decode_frame);
+}
+
+static ERL_NIF_TERM codec_encode_frames(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	return codec_run_list(env, argv, encode_frame);
+}
+
+static ERL_NIF_TERM codec_decode_frames(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	return codec_run_list(env, argv, decode_frame);
+}
+
+static ERL_NIF_TERM codec_reset(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	codec_resource* r;
+
+	if (!enif_get_resource(env, argv[0], codec_resource_type, (void**)&r))
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(r->lock);
+	if (r->state && CODEC_OPS.reset)
+		CODEC_OPS.reset(r->state);
+	vad_init(&r->vad, r->sample_rate, r->channels);
+	cn_init(&r->cn);
+	enif_mutex_unlock(r->lock);
+
+	return atom_ok;
+}
+
+static ERL_NIF_TERM codec_set_option(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	codec_resource* r;
+	char option[32];
+	int value, ret;
+
+	if (!enif_get_resource(env, argv[0], codec_resource_type, (void**)&r) ||
+			!enif_get_atom(env, argv[1], option, sizeof(option), ERL_NIF_LATIN1) ||
+			!enif_get_int(env, argv[2], &value))
+		return enif_make_badarg(env);
+
+	/* not the codec's business, handled here for all of them */
+	if (!strcmp(option, "vad")) {
+		enif_mutex_lock(r->lock);
+		if (value && !r->vad_on)
+			vad_init(&r->vad, r->sample_rate, r->channels);
+		r->vad_on = value != 0;
+		enif_mutex_unlock(r->lock);
+		return atom_ok;
+	}
+
+	if (!CODEC_OPS.ctl)
+		return codec_error(env, atom_unsupported);
+
+	if (r->lock)
+		enif_mutex_lock(r->lock);
+	ret = CODEC_OPS.ctl(r->state, option, value);
+	if (r->lock)
+		enif_mutex_unlock(r->lock);
+
+	return ret < 0 ? codec_error(env, atom_unsupported) : atom_ok;
+}
+
+/* longest stretch comfort_noise/decode_lost make up in one call */
+static unsigned int codec_max_samples(const codec_resource* r)
+{
+	return (unsigned int)r->sample_rate * r->channels * CODEC_MAX_PTIME / 1000;
+}
+
+/* comfort_noise(State, CnPayload, Samples), an empty payload keeps the level */
+static ERL_NIF_TERM codec_comfort_noise(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	codec_resource* r;
+	ErlNifBinary cn;
+	ERL_NIF_TERM term;
+	unsigned int samples;
+	int16_t* pcm;
+
+	if (!enif_get_resource(env, argv[0], codec_resource_type, (void**)&r) ||
+			!enif_inspect_binary(env, argv[1], &cn) ||
+			!enif_get_uint(env, argv[2], &samples) ||
+			samples > codec_max_samples(r))
+		return enif_make_badarg(env);
+
+	if (!(pcm = (int16_t*)enif_make_new_binary(env, samples * sizeof(int16_t), &term)))
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(r->lock);
+	cn_update(&r->cn, cn.data, cn.size);
+	cn_generate(&r->cn, pcm, samples);
+	enif_mutex_unlock(r->lock);
+
+	return enif_make_tuple2(env, atom_ok, term);
+}
+
+/* decode_lost(State, Samples, NextPayload), NextPayload is <<>> when unknown */
+static ERL_NIF_TERM codec_decode_lost(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	codec_resource* r;
+	ErlNifBinary next, out;
+	unsigned int samples;
+	int ret;
+
+	if (!enif_get_resource(env, argv[0], codec_resource_type, (void**)&r) ||
+			!enif_get_uint(env, argv[1], &samples) ||
+			!enif_inspect_binary(env, argv[2], &next) ||
+			samples > codec_max_samples(r))
+		return enif_make_badarg(env);
+
+	if (!CODEC_OPS.plc)
+		return codec_error(env, atom_unsupported);
+
+	if (!enif_alloc_binary(samples * sizeof(int16_t), &out))
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(r->lock);
+	ret = CODEC_OPS.plc(r->state, next.size ? next.data : NULL, next.size,
+			(int16_t*)out.data, samples);
+	enif_mutex_unlock(r->lock);
+
+	if (ret < 0) {
+		enif_release_binary(&out);
+		return codec_error(env, atom_codec_error);
+	}
+
+	enif_realloc_binary(&out, ret * sizeof(int16_t));
+	return enif_make_tuple2(env, atom_ok, enif_make_binary(env, &out));
+}
+
+static int codec_load(ErlNifEnv* env, void** priv_data, ERL_NIF_TERM load_info)
+{
+	codec_resource_type = enif_open_resource_type(env, NULL, "codec_resource",
+			codec_resource_dtor, ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, NULL);
+	if (!codec_resource_type)
+		return -1;
+
+	atom_ok = enif_make_atom(env, "ok");
+	atom_error = enif_make_atom(env, "error");
+	atom_codec_error = enif_make_atom(env, "codec_error");
+	atom_unsupported = enif_make_atom(env, "unsupported");
+	atom_cn = enif_make_atom(env, "cn");
+	atom_silence = enif_make_atom(env, "silence");
+
+#ifdef CODEC_NIF_LOAD
+	CODEC_NIF_LOAD();
+#endif
+
+	return 0;
+}
+
+static int codec_upgrade(ErlNifEnv* env, void** priv_data, void** old_priv_data, ERL_NIF_TERM load_info)
+{
+	return codec_load(env, priv_data, load_info);
+}
+
+static ErlNifFunc codec_nif_funcs[] =
+{
+	{"new", 2, codec_new, 0},
+	{"encode", 2, codec_encode, CODEC_NIF_FLAGS},
+	{"decode", 2, codec_decode, CODEC_NIF_FLAGS},
+	{"set_option", 3, codec_set_option, 0},
+	{"reset", 1, codec_reset, 0},
+	{"comfort_noise", 3, codec_comfort_noise, 0},
+	{"decode_lost", 3, codec_decode_lost, CODEC_NIF_FLAGS},
+	/* a batch can be arbitrarily long, keep it off the normal schedulers */
+	{"encode_frames", 2, codec_encode_frames, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+	{"decode_frames", 2, codec_decode_frames, ERL_NIF_DIRTY_JOB_CPU_BOUND}
+#ifdef CODEC_NIF_EXTRA_FUNCS
+	, CODEC_NIF_EXTRA_FUNCS
+#endif
+};
+
+#define CODEC_NIF_INIT(MODULE) \
+	ERL_NIF_INIT(MODULE,codec_nif_funcs,codec_load,NULL,codec_upgrade,NULL)
+
+#endif /* CODEC_NO_NIF */
+
+#endif /* __CODEC_NIF_H__ */
@@ -32,6 +32,22 @@
 #include <string.h>
 #include "erl_nif.h"
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CRC32C_SSE42 1
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__linux__) && (defined(__GNUC__) || defined(__clang__))
+#define CRC32C_ARMV8 1
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+#if defined(__BIG_ENDIAN__) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define CRC32C_BIG_ENDIAN 1
+#endif
+
 /* http://tools.ietf.org/html/draft-ietf-tsvwg-sctpcsum-01 */
 /* http://tools.ietf.org/html/draft-ietf-tsvwg-sctpcsum-03 */
 
@@ -123,50 +139,258 @@ static const uint32_t crc_c[256] = {
     0xBE2DA0A5, 0x4C4623A6, 0x5F16D052, 0xAD7D5351,
 };
 
-static ERL_NIF_TERM crc32c(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+/*
+ * Slicing-by-8 tables, derived from crc_c when the library is loaded. Only
+ * used when the CPU has no CRC32C instruction.
+ */
+static uint32_t crc_s8[8][256];
+
+/* iolists nested deeper than this are flattened by the VM instead */
+#define MAX_IOLIST_DEPTH 64
+
+typedef struct {
+	ErlNifMutex* lock;
+	uint32_t crc;
+} crc32c_ctx;
+
+static ErlNifResourceType* crc32c_ctx_type = NULL;
+
+static uint32_t (*crc32c_update)(uint32_t crc, const uint8_t* p, size_t len) = NULL;
+
+static void crc32c_init_tables(void)
 {
-//		char **rbuf, int rlen
-//
-	ErlNifBinary bin;
-	ErlNifBinary out;
+	uint32_t c;
+	int i, k;
+
+	for (i = 0; i < 256; i++) {
+		c = crc_c[i];
+		crc_s8[0][i] = c;
+		for (k = 1; k < 8; k++) {
+			c = (c >> 8) ^ crc_c[c & 0xFF];
+			crc_s8[k][i] = c;
+		}
+	}
+}
+
+static uint32_t crc32c_slice8(uint32_t crc, const uint8_t* p, size_t len)
+{
+#ifndef CRC32C_BIG_ENDIAN
+	uint32_t lo, hi;
+
+	for (; len && ((uintptr_t)p & 7); len--)
+		CRC32C(crc, *p++);
+
+	for (; len >= 8; len -= 8, p += 8) {
+		memcpy(&lo, p, 4);
+		memcpy(&hi, p + 4, 4);
+		lo ^= crc;
+		crc = crc_s8[7][lo & 0xFF] ^ crc_s8[6][(lo >> 8) & 0xFF] ^
+			crc_s8[5][(lo >> 16) & 0xFF] ^ crc_s8[4][lo >> 24] ^
+			crc_s8[3][hi & 0xFF] ^ crc_s8[2][(hi >> 8) & 0xFF] ^
+			crc_s8[1][(hi >> 16) & 0xFF] ^ crc_s8[0][hi >> 24];
+	}
+#endif
+	for (; len; len--)
+		CRC32C(crc, *p++);
+
+	return crc;
+}
+
+#ifdef CRC32C_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t* p, size_t len)
+{
+	uint64_t c = crc;
+	uint64_t v;
 
-	enif_inspect_binary(env, argv[0], &bin);
-	enif_alloc_binary(4, &out);
+	for (; len && ((uintptr_t)p & 7); len--)
+		c = _mm_crc32_u8((uint32_t)c, *p++);
+	for (; len >= 8; len -= 8, p += 8) {
+		memcpy(&v, p, 8);
+		c = _mm_crc32_u64(c, v);
+	}
+	for (; len; len--)
+		c = _mm_crc32_u8((uint32_t)c, *p++);
 
-	uint32_t crc32c = ~(uint32_t) 0;
-	uint32_t result;
-	uint32_t i;
-#ifdef __BIG_ENDIAN__
-	uint8_t byte0, byte1, byte2, byte3;
+	return (uint32_t)c;
+}
 #endif
-	for (i = 0; i < bin.size ; i++)
-		CRC32C(crc32c, ((uint8_t*)(bin.data))[i]);
-
-	result = ~crc32c;
-
-#ifdef __BIG_ENDIAN__
-	// FIXME this is BigEndian stuff and needs to be fixed and tested
-	byte0 = result & 0xff;
-	byte1 = (result>>8) & 0xff;
-	byte2 = (result>>16) & 0xff;
-	byte3 = (result>>24) & 0xff;
-	crc32c = ((byte0 << 24) | (byte1 << 16) | (byte2 << 8) | byte3);
-#else
-	crc32c = result;
+
+#ifdef CRC32C_ARMV8
+__attribute__((target("+crc")))
+static uint32_t crc32c_armv8(uint32_t crc, const uint8_t* p, size_t len)
+{
+	uint64_t v;
+
+	for (; len && ((uintptr_t)p & 7); len--)
+		crc = __crc32cb(crc, *p++);
+	for (; len >= 8; len -= 8, p += 8) {
+		memcpy(&v, p, 8);
+		crc = __crc32cd(crc, v);
+	}
+	for (; len; len--)
+		crc = __crc32cb(crc, *p++);
+
+	return crc;
+}
 #endif
-	memcpy(out.data, &crc32c, 4);
 
-	return enif_make_binary(env, &out);
+static void crc32c_select(void)
+{
+	crc32c_init_tables();
+	crc32c_update = crc32c_slice8;
+
+#if defined(CRC32C_SSE42)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2"))
+		crc32c_update = crc32c_sse42;
+#elif defined(CRC32C_ARMV8)
+	if (getauxval(AT_HWCAP) & HWCAP_CRC32)
+		crc32c_update = crc32c_armv8;
+#endif
 }
 
-static int upgrade(ErlNifEnv* env, void** priv_data, void** old_priv_data, ERL_NIF_TERM load_info)
+/* Walks iodata in place, so fragmented packets are never concatenated */
+static int crc32c_iodata(ErlNifEnv* env, ERL_NIF_TERM term, uint32_t* crc, int depth)
 {
+	ErlNifBinary bin;
+	ERL_NIF_TERM head;
+	int byte;
+
+	if (enif_inspect_binary(env, term, &bin)) {
+		*crc = crc32c_update(*crc, bin.data, bin.size);
+		return 1;
+	}
+
+	if (depth > MAX_IOLIST_DEPTH) {
+		if (!enif_inspect_iolist_as_binary(env, term, &bin))
+			return 0;
+		*crc = crc32c_update(*crc, bin.data, bin.size);
+		return 1;
+	}
+
+	while (enif_get_list_cell(env, term, &head, &term)) {
+		if (enif_get_int(env, head, &byte)) {
+			if (byte < 0 || byte > 255)
+				return 0;
+			CRC32C(*crc, (uint8_t)byte);
+		}
+		else if (!crc32c_iodata(env, head, crc, depth + 1))
+			return 0;
+	}
+
+	/* either a proper list or a binary in the tail */
+	if (enif_is_empty_list(env, term))
+		return 1;
+	return enif_is_binary(env, term) && crc32c_iodata(env, term, crc, depth + 1);
+}
+
+static ERL_NIF_TERM make_crc(ErlNifEnv* env, uint32_t crc)
+{
+	ERL_NIF_TERM term;
+	unsigned char* out = enif_make_new_binary(env, 4, &term);
+
+	/* least significant byte first, whatever the host byte order */
+	crc = ~crc;
+	out[0] = crc & 0xFF;
+	out[1] = (crc >> 8) & 0xFF;
+	out[2] = (crc >> 16) & 0xFF;
+	out[3] = (crc >> 24) & 0xFF;
+
+	return term;
+}
+
+static ERL_NIF_TERM crc32c(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	uint32_t crc = ~(uint32_t) 0;
+
+	if (!crc32c_iodata(env, argv[0], &crc, 0))
+		return enif_make_badarg(env);
+
+	return make_crc(env, crc);
+}
+
+static void crc32c_ctx_dtor(ErlNifEnv* env, void* obj)
+{
+	crc32c_ctx* ctx = (crc32c_ctx*)obj;
+
+	if (ctx->lock)
+		enif_mutex_destroy(ctx->lock);
+}
+
+static ERL_NIF_TERM crc32c_new(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	ERL_NIF_TERM term;
+	crc32c_ctx* ctx = (crc32c_ctx*)enif_alloc_resource(crc32c_ctx_type, sizeof(crc32c_ctx));
+
+	if (!(ctx->lock = enif_mutex_create((char*)"crc32c_ctx"))) {
+		enif_release_resource(ctx);
+		return enif_make_badarg(env);
+	}
+	ctx->crc = ~(uint32_t) 0;
+
+	term = enif_make_resource(env, ctx);
+	enif_release_resource(ctx);
+
+	return term;
+}
+
+static ERL_NIF_TERM crc32c_update_nif(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	crc32c_ctx* ctx;
+	uint32_t crc;
+	int ok;
+
+	if (!enif_get_resource(env, argv[0], crc32c_ctx_type, (void**)&ctx))
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(ctx->lock);
+	crc = ctx->crc;
+	ok = crc32c_iodata(env, argv[1], &crc, 0);
+	if (ok)
+		ctx->crc = crc;
+	enif_mutex_unlock(ctx->lock);
+
+	return ok ? argv[0] : enif_make_badarg(env);
+}
+
+static ERL_NIF_TERM crc32c_final(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	crc32c_ctx* ctx;
+	uint32_t crc;
+
+	if (!enif_get_resource(env, argv[0], crc32c_ctx_type, (void**)&ctx))
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(ctx->lock);
+	crc = ctx->crc;
+	enif_mutex_unlock(ctx->lock);
+
+	return make_crc(env, crc);
+}
+
+static int load(ErlNifEnv* env, void** priv_data, ERL_NIF_TERM load_info)
+{
+	crc32c_ctx_type = enif_open_resource_type(env, NULL, "crc32c_ctx",
+			crc32c_ctx_dtor, ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, NULL);
+	if (!crc32c_ctx_type)
+		return -1;
+
+	crc32c_select();
 	return 0;
 }
 
+static int upgrade(ErlNifEnv* env, void** priv_data, void** old_priv_data, ERL_NIF_TERM load_info)
+{
+	return load(env, priv_data, load_info);
+}
+
 static ErlNifFunc nif_funcs[] =
 {
-	    {"crc32c", 1, crc32c}
+	    {"crc32c", 1, crc32c},
+	    {"new", 0, crc32c_new},
+	    {"update", 2, crc32c_update_nif},
+	    {"final", 1, crc32c_final}
 };
 
-ERL_NIF_INIT(Elixir.XMediaLib.CRC32C,nif_funcs,NULL,NULL,upgrade,NULL)
+ERL_NIF_INIT(Elixir.XMediaLib.CRC32C,nif_funcs,load,NULL,upgrade,NULL)
@@ -28,100 +28,97 @@
  *
  * ---------------------------------------------------------------------- */
 
+
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
-#include "erl_driver.h"
+#include <stdlib.h>
 #include <spandsp/telephony.h>
 #include <spandsp/ima_adpcm.h>
+#include <spandsp/plc.h>
+#include "codec.h"
+
+/* DVI4 (RFC 3551 4.5.1) prepends a 4 byte state header to every block */
+#define DVI4_HEADER_SIZE 4
 
 typedef struct {
-	ErlDrvPort port;
-	ima_adpcm_state_t* state;
+	ima_adpcm_state_t* adpcm;
+	/* loss concealment history, fed with everything decoded */
+	plc_state_t* plc;
 } codec_data;
 
-enum {
-	CMD_ENCODE = 1,
-	CMD_DECODE = 2
-};
+static void* dvi4_init(int sample_rate, int channels)
+{
+	codec_data* d = (codec_data*)malloc(sizeof(codec_data));
+	if (!d)
+		return NULL;
+	d->adpcm = ima_adpcm_init(NULL, IMA_ADPCM_DVI4, 0);
+	d->plc = plc_init(NULL);
+	return d;
+}
 
-static ErlDrvData codec_drv_start(ErlDrvPort port, char *buff)
+static void dvi4_destroy(void* state)
 {
-	codec_data* d = (codec_data*)driver_alloc(sizeof(codec_data));
-	d->port = port;
-	d->state = ima_adpcm_init(NULL, IMA_ADPCM_DVI4, 0);
-	set_port_control_flags(port, PORT_CONTROL_FLAG_BINARY);
-	return (ErlDrvData)d;
+	codec_data* d = (codec_data*)state;
+	ima_adpcm_free(d->adpcm);
+	plc_free(d->plc);
+	free(d);
 }
 
-static void codec_drv_stop(ErlDrvData handle)
+static void dvi4_reset(void* state)
 {
-	codec_data *d = (codec_data *) handle;
-	ima_adpcm_free(d->state);
-	driver_free((char*)handle);
+	codec_data* d = (codec_data*)state;
+	ima_adpcm_init(d->adpcm, IMA_ADPCM_DVI4, 0);
+	plc_init(d->plc);
 }
 
-static ErlDrvSSizeT codec_drv_control(
-		ErlDrvData handle,
-		unsigned int command,
-		char *buf, ErlDrvSizeT len,
-		char **rbuf, ErlDrvSizeT rlen)
+static int dvi4_encode(void* state, const int16_t* pcm, size_t samples, uint8_t* out, size_t out_len)
 {
-	codec_data* d = (codec_data*)handle;
-
-	int ret = 0;
-	ErlDrvBinary *out;
-	*rbuf = NULL;
-	uint8_t* tmp = NULL;
-
-	switch(command) {
-		case CMD_ENCODE:
-			tmp = (uint8_t*)calloc(len, sizeof(uint8_t));
-			ret = ima_adpcm_encode(d->state, tmp, (const int16_t *)buf, len >> 1);
-			out = driver_alloc_binary(ret);
-			memcpy(out->orig_bytes, tmp, ret);
-			free(tmp);
-			*rbuf = (char *) out;
-			break;
-		 case CMD_DECODE:
-			/* FIXME */
-			out = driver_alloc_binary(len / 2);
-			ret = ima_adpcm_decode(d->state, (int16_t *)out->orig_bytes, (const uint8_t *)buf, len);
-			*rbuf = (char *) out;
-			break;
-		 default:
-			break;
-	}
+	codec_data* d = (codec_data*)state;
+	return ima_adpcm_encode(d->adpcm, out, pcm, samples);
+}
+
+static int dvi4_decode(void* state, const uint8_t* in, size_t len, int16_t* pcm, size_t max_samples)
+{
+	codec_data* d = (codec_data*)state;
+	int ret = ima_adpcm_decode(d->adpcm, pcm, in, len);
+
+	if (ret > 0)
+		plc_rx(d->plc, pcm, ret);
 	return ret;
 }
 
-ErlDrvEntry codec_driver_entry = {
-	NULL,			/* F_PTR init, N/A */
-	codec_drv_start,	/* L_PTR start, called when port is opened */
-	codec_drv_stop,		/* F_PTR stop, called when port is closed */
-	NULL,			/* F_PTR output, called when erlang has sent */
-	NULL,			/* F_PTR ready_input, called when input descriptor ready */
-	NULL,			/* F_PTR ready_output, called when output descriptor ready */
-	"dvi4_codec_drv",		/* char *driver_name, the argument to open_port */
-	NULL,			/* F_PTR finish, called when unloaded */
-	NULL,			/* handle */
-	codec_drv_control,	/* F_PTR control, port_command callback */
-	NULL,			/* F_PTR timeout, reserved */
-	NULL,			/* F_PTR outputv, reserved */
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	ERL_DRV_EXTENDED_MARKER,
-	ERL_DRV_EXTENDED_MAJOR_VERSION,
-	ERL_DRV_EXTENDED_MINOR_VERSION,
-	0,
-	NULL,
-	NULL,
-	NULL
-};
+static size_t dvi4_max_encoded(void* state, size_t samples)
+{
+	return DVI4_HEADER_SIZE + (samples + 1) / 2;
+}
+
+static size_t dvi4_max_decoded(void* state, size_t len)
+{
+	return len << 1;
+}
 
-DRIVER_INIT(codec_drv) /* must match name in driver_entry */
+/* no concealment in the codec, spandsp's PLC repeats the last pitch period */
+static int dvi4_plc(void* state, const uint8_t* next, size_t next_len, int16_t* pcm, size_t samples)
 {
-	return &codec_driver_entry;
+	codec_data* d = (codec_data*)state;
+	return plc_fillin(d->plc, pcm, samples);
 }
+
+const codec_ops dvi4_codec_ops = {
+	"dvi4",
+	dvi4_init,
+	dvi4_destroy,
+	dvi4_encode,
+	dvi4_decode,
+	dvi4_max_encoded,
+	dvi4_max_decoded,
+	dvi4_reset,
+	NULL,			/* ctl */
+	dvi4_plc
+};
+
+#define CODEC_OPS dvi4_codec_ops
+#include "codec_nif.h"
+
+CODEC_NIF_INIT(Elixir.XMediaLib.Codec.DVI4)
@@ -0,0 +1,96 @@
+/* ----------------------------------------------------------------------
+ *
+ * Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+ * for his excellent work in this area.
+ *
+ * @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+ *
+ * Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+ *
+ * Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+ *
+ * All rights reserved.
+ *
+ * XMediaLib is licensed by Xirsys, with permission, under the Apache
+ * License Version 2.0. (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See LICENSE for the full license text.
+ *
+ * ---------------------------------------------------------------------- */
+
+
+#ifndef __G711_LUT_H__
+#define __G711_LUT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <spandsp/telephony.h>
+#include <spandsp/bit_operations.h>
+#include <spandsp/g711.h>
+
+/*
+ * Table driven G.711. The tables are filled from spandsp once, when the
+ * library is loaded, so the output stays bit exact with the scalar
+ * functions while every sample costs a single load. The encoder tables are
+ * indexed by the full 16-bit sample - the rounding of negative samples
+ * differs between spandsp releases, so dropping low bits is not safe.
+ */
+
+static uint8_t g711_ulaw_enc[65536];
+static uint8_t g711_alaw_enc[65536];
+static int16_t g711_ulaw_dec[256];
+static int16_t g711_alaw_dec[256];
+static uint8_t g711_alaw_to_ulaw[256];
+static uint8_t g711_ulaw_to_alaw[256];
+
+static void g711_lut_init(void)
+{
+	size_t i;
+
+	for (i = 0; i < 65536; i++) {
+		g711_ulaw_enc[i] = linear_to_ulaw((int16_t)i);
+		g711_alaw_enc[i] = linear_to_alaw((int16_t)i);
+	}
+	for (i = 0; i < 256; i++) {
+		g711_ulaw_dec[i] = ulaw_to_linear(i);
+		g711_alaw_dec[i] = alaw_to_linear(i);
+		g711_alaw_to_ulaw[i] = alaw_to_ulaw(i);
+		g711_ulaw_to_alaw[i] = ulaw_to_alaw(i);
+	}
+}
+
+static inline void g711_encode(const uint8_t* table, const int16_t* pcm, uint8_t* out, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i < samples; i++)
+		out[i] = table[(uint16_t)pcm[i]];
+}
+
+static inline void g711_decode(const int16_t* table, const uint8_t* in, int16_t* pcm, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		pcm[i] = table[in[i]];
+}
+
+static inline void g711_transcode(const uint8_t* table, const uint8_t* in, uint8_t* out, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		out[i] = table[in[i]];
+}
+
+#endif /* __G711_LUT_H__ */
@@ -28,106 +28,98 @@
  *
  * ---------------------------------------------------------------------- */
 
+
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
-#include "erl_driver.h"
+#include <stdlib.h>
 #include <spandsp/telephony.h>
 #include <spandsp/g722.h>
+#include <spandsp/plc.h>
+#include "codec.h"
 
 typedef struct {
-	ErlDrvPort port;
 	g722_encode_state_t* estate;
 	g722_decode_state_t* dstate;
+	/* loss concealment history, fed with everything decoded */
+	plc_state_t* plc;
 } codec_data;
 
-enum {
-	CMD_ENCODE = 1,
-	CMD_DECODE = 2
-};
-
-enum {
-	FRAME_SIZE_1 = 80,
-	FRAME_SIZE_2 = 160,
-	FRAME_SIZE_3 = 240
-};
-
-static ErlDrvData codec_drv_start(ErlDrvPort port, char *buff)
+static void* g722_init(int sample_rate, int channels)
 {
-	codec_data* d = (codec_data*)driver_alloc(sizeof(codec_data));
-	d->port = port;
+	codec_data* d = (codec_data*)malloc(sizeof(codec_data));
+	if (!d)
+		return NULL;
 	d->estate = g722_encode_init(NULL, 64000, G722_SAMPLE_RATE_8000);
 	d->dstate = g722_decode_init(NULL, 64000, G722_SAMPLE_RATE_8000);
-	set_port_control_flags(port, PORT_CONTROL_FLAG_BINARY);
-	return (ErlDrvData)d;
+	d->plc = plc_init(NULL);
+	return d;
 }
 
-static void codec_drv_stop(ErlDrvData handle)
+static void g722_destroy(void* state)
 {
-	codec_data *d = (codec_data *) handle;
+	codec_data* d = (codec_data*)state;
 	g722_encode_free(d->estate);
 	g722_decode_free(d->dstate);
-	driver_free((char*)handle);
+	plc_free(d->plc);
+	free(d);
 }
 
-static ErlDrvSSizeT codec_drv_control(
-		ErlDrvData handle,
-		unsigned int command,
-		char *buf, ErlDrvSizeT len,
-		char **rbuf, ErlDrvSizeT rlen)
+static void g722_reset(void* state)
 {
-	codec_data* d = (codec_data*)handle;
-
-	int ret = 0;
-	ErlDrvBinary *out;
-	*rbuf = NULL;
+	codec_data* d = (codec_data*)state;
+	g722_encode_init(d->estate, 64000, G722_SAMPLE_RATE_8000);
+	g722_decode_init(d->dstate, 64000, G722_SAMPLE_RATE_8000);
+	plc_init(d->plc);
+}
 
-	switch(command) {
-		case CMD_ENCODE:
-			out = driver_alloc_binary(len >> 1);
+static int g722_codec_encode(void* state, const int16_t* pcm, size_t samples, uint8_t* out, size_t out_len)
+{
+	codec_data* d = (codec_data*)state;
+	return g722_encode(d->estate, out, pcm, samples);
+}
 
-			ret = g722_encode(d->estate, (uint8_t *)out->orig_bytes, (const int16_t *)buf, len >> 1);
-			*rbuf = (char *) out;
-			break;
-		 case CMD_DECODE:
-			out = driver_alloc_binary(len << 1);
-			ret = g722_decode(d->dstate, (int16_t *)out->orig_bytes, (const uint8_t *)buf, len) << 1;
+static int g722_codec_decode(void* state, const uint8_t* in, size_t len, int16_t* pcm, size_t max_samples)
+{
+	codec_data* d = (codec_data*)state;
+	int ret = g722_decode(d->dstate, pcm, in, len);
 
-			*rbuf = (char *) out;
-			break;
-		 default:
-			break;
-	}
+	if (ret > 0)
+		plc_rx(d->plc, pcm, ret);
 	return ret;
 }
 
-ErlDrvEntry codec_driver_entry = {
-	NULL,			/* F_PTR init, N/A */
-	codec_drv_start,	/* L_PTR start, called when port is opened */
-	codec_drv_stop,		/* F_PTR stop, called when port is closed */
-	NULL,			/* F_PTR output, called when erlang has sent */
-	NULL,			/* F_PTR ready_input, called when input descriptor ready */
-	NULL,			/* F_PTR ready_output, called when output descriptor ready */
-	(char*) "g722_codec_drv",	/* char *driver_name, the argument to open_port */
-	NULL,			/* F_PTR finish, called when unloaded */
-	NULL,			/* handle */
-	codec_drv_control,	/* F_PTR control, port_command callback */
-	NULL,			/* F_PTR timeout, reserved */
-	NULL,			/* F_PTR outputv, reserved */
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	(int) ERL_DRV_EXTENDED_MARKER,
-	(int) ERL_DRV_EXTENDED_MAJOR_VERSION,
-	(int) ERL_DRV_EXTENDED_MINOR_VERSION,
-	0,
-	NULL,
-	NULL,
-	NULL
-};
+static size_t g722_max_encoded(void* state, size_t samples)
+{
+	return samples;
+}
+
+static size_t g722_max_decoded(void* state, size_t len)
+{
+	return len << 1;
+}
 
-DRIVER_INIT(codec_drv) /* must match name in driver_entry */
+/* no concealment in the codec, spandsp's PLC repeats the last pitch period */
+static int g722_plc(void* state, const uint8_t* next, size_t next_len, int16_t* pcm, size_t samples)
 {
-	return &codec_driver_entry;
+	codec_data* d = (codec_data*)state;
+	return plc_fillin(d->plc, pcm, samples);
 }
+
+const codec_ops g722_codec_ops = {
+	"g722",
+	g722_init,
+	g722_destroy,
+	g722_codec_encode,
+	g722_codec_decode,
+	g722_max_encoded,
+	g722_max_decoded,
+	g722_reset,
+	NULL,			/* ctl */
+	g722_plc
+};
+
+#define CODEC_OPS g722_codec_ops
+#include "codec_nif.h"
+
+CODEC_NIF_INIT(Elixir.XMediaLib.Codec.G722)
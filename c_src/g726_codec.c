@@ -28,111 +28,115 @@
  *
  * ---------------------------------------------------------------------- */
 
+
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
-#include "erl_driver.h"
+#include <stdlib.h>
 #include <spandsp/telephony.h>
 #include <spandsp/g726.h>
+#include <spandsp/plc.h>
+#include "codec.h"
 
 typedef struct {
-	ErlDrvPort port;
 	g726_state_t* estate;
 	g726_state_t* dstate;
 	int bitrate;
+	/* loss concealment history, fed with everything decoded */
+	plc_state_t* plc;
 } codec_data;
 
-enum {
-	CMD_SETUP = 0,
-	CMD_ENCODE = 1,
-	CMD_DECODE = 2
-};
+/* RFC 3551 static payload type 'G726' is G726-32 */
+#define DEFAULT_BITRATE 32000
 
-static ErlDrvData codec_drv_start(ErlDrvPort port, char *buff)
+static void* g726_codec_init(int sample_rate, int channels)
 {
-	codec_data* d = (codec_data*)driver_alloc(sizeof(codec_data));
-	d->port = port;
-	d->estate = NULL;
-	d->dstate = NULL;
-	d->bitrate = 0;
-	set_port_control_flags(port, PORT_CONTROL_FLAG_BINARY);
-	return (ErlDrvData)d;
+	codec_data* d = (codec_data*)malloc(sizeof(codec_data));
+	if (!d)
+		return NULL;
+	d->bitrate = DEFAULT_BITRATE;
+	d->dstate = g726_init(NULL, d->bitrate, G726_ENCODING_LINEAR, G726_PACKING_NONE);
+	d->estate = g726_init(NULL, d->bitrate, G726_ENCODING_LINEAR, G726_PACKING_NONE);
+	d->plc = plc_init(NULL);
+	if (!d->dstate || !d->estate || !d->plc) {
+		if (d->dstate)
+			g726_free(d->dstate);
+		if (d->estate)
+			g726_free(d->estate);
+		if (d->plc)
+			plc_free(d->plc);
+		free(d);
+		return NULL;
+	}
+	return d;
 }
 
-static void codec_drv_stop(ErlDrvData handle)
+static void g726_codec_destroy(void* state)
 {
-	codec_data *d = (codec_data *) handle;
-	if(d->dstate)
-		g726_free(d->dstate);
-	if(d->estate)
-		g726_free(d->estate);
-	driver_free((char*)handle);
+	codec_data* d = (codec_data*)state;
+	g726_free(d->dstate);
+	g726_free(d->estate);
+	plc_free(d->plc);
+	free(d);
 }
 
-static ErlDrvSSizeT codec_drv_control(
-		ErlDrvData handle,
-		unsigned int command,
-		char *buf, ErlDrvSizeT len,
-		char **rbuf, ErlDrvSizeT rlen)
+static void g726_codec_reset(void* state)
 {
-	codec_data* d = (codec_data*)handle;
-
-	int ret = 0;
-	ErlDrvBinary *out;
-	int16_t amp[240]; // for 30 msec sample
-	uint8_t g726_data[480]; // no idea how big it could be - FIXME
-	*rbuf = NULL;
-
-	switch(command) {
-		case CMD_ENCODE:
-			ret = g726_encode(d->estate, g726_data, (const int16_t *)buf, len >> 1);
-			out = driver_alloc_binary(ret);
-			memcpy(out->orig_bytes, g726_data, ret);
-			*rbuf = (char *) out;
-			break;
-		 case CMD_DECODE:
-			ret = g726_decode(d->dstate, amp, (const uint8_t*)buf, len) >> 1;
-			out = driver_alloc_binary(ret);
-			memcpy(out->orig_bytes, amp, ret);
-			*rbuf = (char *) out;
-			break;
-		case CMD_SETUP:
-			d->bitrate = buf[0] * 1000;
-			d->dstate = g726_init(NULL, d->bitrate, G726_ENCODING_LINEAR, G726_PACKING_NONE);
-			d->estate = g726_init(NULL, d->bitrate, G726_ENCODING_LINEAR, G726_PACKING_NONE);
-		 default:
-			break;
-	}
+	codec_data* d = (codec_data*)state;
+	g726_init(d->dstate, d->bitrate, G726_ENCODING_LINEAR, G726_PACKING_NONE);
+	g726_init(d->estate, d->bitrate, G726_ENCODING_LINEAR, G726_PACKING_NONE);
+	plc_init(d->plc);
+}
+
+static int g726_codec_encode(void* state, const int16_t* pcm, size_t samples, uint8_t* out, size_t out_len)
+{
+	codec_data* d = (codec_data*)state;
+	return g726_encode(d->estate, out, pcm, samples);
+}
+
+static int g726_codec_decode(void* state, const uint8_t* in, size_t len, int16_t* pcm, size_t max_samples)
+{
+	codec_data* d = (codec_data*)state;
+	int ret = g726_decode(d->dstate, pcm, in, len);
+
+	if (ret > 0)
+		plc_rx(d->plc, pcm, ret);
 	return ret;
 }
 
-ErlDrvEntry codec_driver_entry = {
-	NULL,			/* F_PTR init, N/A */
-	codec_drv_start,	/* L_PTR start, called when port is opened */
-	codec_drv_stop,		/* F_PTR stop, called when port is closed */
-	NULL,			/* F_PTR output, called when erlang has sent */
-	NULL,			/* F_PTR ready_input, called when input descriptor ready */
-	NULL,			/* F_PTR ready_output, called when output descriptor ready */
-	(char*) "g726_codec_drv",		/* char *driver_name, the argument to open_port */
-	NULL,			/* F_PTR finish, called when unloaded */
-	NULL,			/* handle */
-	codec_drv_control,	/* F_PTR control, port_command callback */
-	NULL,			/* F_PTR timeout, reserved */
-	NULL,			/* F_PTR outputv, reserved */
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	(int) ERL_DRV_EXTENDED_MARKER,
-	(int) ERL_DRV_EXTENDED_MAJOR_VERSION,
-	(int) ERL_DRV_EXTENDED_MINOR_VERSION,
-	0,
-	NULL,
-	NULL,
-	NULL
-};
+/* with G726_PACKING_NONE every code word takes a whole byte */
+static size_t g726_max_encoded(void* state, size_t samples)
+{
+	return samples;
+}
+
+/* ...but leave room for the tightest packing (2 bits per sample) */
+static size_t g726_max_decoded(void* state, size_t len)
+{
+	return len << 2;
+}
 
-DRIVER_INIT(codec_drv) /* must match name in driver_entry */
+/* no concealment in the codec, spandsp's PLC repeats the last pitch period */
+static int g726_plc(void* state, const uint8_t* next, size_t next_len, int16_t* pcm, size_t samples)
 {
-	return &codec_driver_entry;
+	codec_data* d = (codec_data*)state;
+	return plc_fillin(d->plc, pcm, samples);
 }
+
+const codec_ops g726_codec_ops = {
+	"g726",
+	g726_codec_init,
+	g726_codec_destroy,
+	g726_codec_encode,
+	g726_codec_decode,
+	g726_max_encoded,
+	g726_max_decoded,
+	g726_codec_reset,
+	NULL,			/* ctl */
+	g726_plc
+};
+
+#define CODEC_OPS g726_codec_ops
+#include "codec_nif.h"
+
+CODEC_NIF_INIT(Elixir.XMediaLib.Codec.G726)
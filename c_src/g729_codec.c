@@ -28,119 +28,188 @@
  *
  * ---------------------------------------------------------------------- */
 
+
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
-#include "erl_driver.h"
+#include <stdlib.h>
 #include <bcg729/decoder.h>
 #include <bcg729/encoder.h>
+#include "codec.h"
+
+/*
+ * G.729 with Annex B. Decoding always understands SID frames: a 2-byte SID
+ * may end a payload (RFC 3551) or make up all of it, and an empty payload
+ * stands for 20 ms of untransmitted frames, filled with comfort noise from
+ * the last SID. The encoder runs VAD/DTX only with annexb set, then a
+ * payload is speech frames, optionally followed by one SID, or empty when
+ * there's nothing to send.
+ */
 
 typedef struct {
-	ErlDrvPort port;
 	bcg729EncoderChannelContextStruct* estate;
 	bcg729DecoderChannelContextStruct* dstate;
+	uint8_t annexb;
 } codec_data;
 
-enum {
-	CMD_ENCODE = 1,
-	CMD_DECODE = 2
-};
+/* 10 msec of 8 kHz audio per 80-bit frame */
+#define FRAME_SIZE 80
+#define G729_SIZE 10
+#define SID_SIZE 2
+/* untransmitted frames played out for an empty payload */
+#define DTX_FRAMES 2
 
-static ErlDrvData codec_drv_start(ErlDrvPort port, char *buff)
+static void* g729_init(int sample_rate, int channels)
 {
-	codec_data* d = (codec_data*)driver_alloc(sizeof(codec_data));
-	d->port = port;
-	d->estate = initBcg729EncoderChannel(0);
+	codec_data* d = (codec_data*)malloc(sizeof(codec_data));
+	if (!d)
+		return NULL;
+	d->annexb = 0;
+	d->estate = initBcg729EncoderChannel(d->annexb);
 	d->dstate = initBcg729DecoderChannel();
-	set_port_control_flags(port, PORT_CONTROL_FLAG_BINARY);
-	return (ErlDrvData)d;
+	if (!d->estate || !d->dstate) {
+		if (d->estate)
+			closeBcg729EncoderChannel(d->estate);
+		if (d->dstate)
+			closeBcg729DecoderChannel(d->dstate);
+		free(d);
+		return NULL;
+	}
+	return d;
 }
 
-static void codec_drv_stop(ErlDrvData handle)
+static void g729_destroy(void* state)
 {
-	codec_data *d = (codec_data *) handle;
+	codec_data* d = (codec_data*)state;
 	closeBcg729EncoderChannel(d->estate);
 	closeBcg729DecoderChannel(d->dstate);
-	driver_free((char*)handle);
+	free(d);
 }
 
-static ErlDrvSSizeT codec_drv_control(
-		ErlDrvData handle,
-		unsigned int command,
-		char *buf, ErlDrvSizeT len,
-		char **rbuf, ErlDrvSizeT rlen)
+/*
+ * bcg729 has no way to reinitialise a channel in place, and setting one up
+ * again is the cost a reset is meant to save. So the channels are kept: a
+ * reused G.729 codec starts the next stream with the filter memory of the
+ * last one, which dies away within a few frames.
+ */
+static void g729_reset(void* state)
 {
-	codec_data* d = (codec_data*)handle;
+}
 
-	int ret = 0;
-	ErlDrvBinary *out;
-	*rbuf = NULL;
+static int g729_encode(void* state, const int16_t* pcm, size_t samples, uint8_t* out, size_t out_len)
+{
+	codec_data* d = (codec_data*)state;
+	size_t n = samples / FRAME_SIZE; // Number of frames
+	size_t i, pos = 0;
+	int sid = 0;
+	uint8_t frame[G729_SIZE];
+	uint8_t len;
+
+	if (samples % FRAME_SIZE != 0)
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		bcg729Encoder(d->estate, pcm + FRAME_SIZE * i, frame, &len);
+		/* untransmitted, a pending SID stays the last frame of the payload */
+		if (!len)
+			continue;
+		/* a SID can only be the last frame, speech (or a newer SID) after it wins */
+		if (sid) {
+			pos -= SID_SIZE;
+			sid = 0;
+		}
+		memcpy(out + pos, frame, len);
+		pos += len;
+		sid = len == SID_SIZE;
+	}
 
-	int n = 0; // Number of frames
-	int i = 0; // Temporary counter
+	return pos;
+}
+
+static int g729_decode(void* state, const uint8_t* in, size_t len, int16_t* pcm, size_t max_samples)
+{
+	codec_data* d = (codec_data*)state;
+	size_t n = len / G729_SIZE; // Number of speech frames
+	size_t i;
+
+	if (!len) {
+		for (i = 0; i < DTX_FRAMES; i++)
+			bcg729Decoder(d->dstate, NULL, 0, 0, 1, 0, pcm + FRAME_SIZE * i);
+		return DTX_FRAMES * FRAME_SIZE;
+	}
 
-	switch(command) {
-		case CMD_ENCODE:
-			if (len % 160 != 0)
-				break;
+	for (i = 0; i < n; i++)
+		bcg729Decoder(d->dstate, in + G729_SIZE * i, G729_SIZE, 0, 0, 0, pcm + FRAME_SIZE * i);
 
-			n = len / 160; // Calculate a number of frames
+	if (len % G729_SIZE == SID_SIZE) {
+		bcg729Decoder(d->dstate, in + G729_SIZE * n, SID_SIZE, 0, 1, 0, pcm + FRAME_SIZE * n);
+		n++;
+	}
 
-			out = driver_alloc_binary(n*10); // n*80 bits
-			ret = n*10;
+	return n * FRAME_SIZE;
+}
 
-			uint8_t buf_len;
+static size_t g729_max_encoded(void* state, size_t samples)
+{
+	return samples / FRAME_SIZE * G729_SIZE;
+}
 
-			for(i = 0; i<n; i++)
-				bcg729Encoder(d->estate, (int16_t*)buf+80*i, (uint8_t*)out->orig_bytes+10*i, &buf_len);
+static size_t g729_max_decoded(void* state, size_t len)
+{
+	if (!len)
+		return DTX_FRAMES * FRAME_SIZE;
+	return (len / G729_SIZE + (len % G729_SIZE == SID_SIZE)) * FRAME_SIZE;
+}
 
-			*rbuf = (char *) out;
-			break;
-		case CMD_DECODE:
-			n = len / 10; // Calculate a number of frames
+/* bcg729 frame erasure, or comfort noise if the stream was in DTX */
+static int g729_plc(void* state, const uint8_t* next, size_t next_len, int16_t* pcm, size_t samples)
+{
+	codec_data* d = (codec_data*)state;
+	size_t i;
+
+	if (samples == 0 || samples % FRAME_SIZE != 0)
+		return -1;
+	for (i = 0; i < samples / FRAME_SIZE; i++)
+		bcg729Decoder(d->dstate, NULL, 0, 1, 0, 0, pcm + FRAME_SIZE * i);
+	return samples;
+}
 
-			out = driver_alloc_binary(n*160); // n*160 bytes
-			ret = n*160;
+/*
+ * annexb turns VAD/DTX on the encoder on or off. bcg729 only takes it at
+ * init time, so the encoder is restarted - set it before the stream starts.
+ */
+static int g729_ctl(void* state, const char* option, int value)
+{
+	codec_data* d = (codec_data*)state;
+	bcg729EncoderChannelContextStruct* estate;
 
-			for(i = 0; i<n; i++)
-				// bcg729Decoder(d->dstate, ((uint8_t*)buf)+10*i, 0, (int16_t*)out->orig_bytes+80*i);
-				bcg729Decoder(d->dstate, ((uint8_t*)buf)+10*i, len, 0, 0, 0, (int16_t*)out->orig_bytes+80*i);
+	if (strcmp(option, "annexb"))
+		return -1;
 
-			*rbuf = (char *) out;
-			break;
-		default:
-			break;
-	}
-	return ret;
+	estate = initBcg729EncoderChannel(value != 0);
+	if (!estate)
+		return -1;
+	closeBcg729EncoderChannel(d->estate);
+	d->estate = estate;
+	d->annexb = value != 0;
+	return 0;
 }
 
-ErlDrvEntry codec_driver_entry = {
-	NULL,			/* F_PTR init, N/A */
-	codec_drv_start,	/* L_PTR start, called when port is opened */
-	codec_drv_stop,		/* F_PTR stop, called when port is closed */
-	NULL,			/* F_PTR output, called when erlang has sent */
-	NULL,			/* F_PTR ready_input, called when input descriptor ready */
-	NULL,			/* F_PTR ready_output, called when output descriptor ready */
-	(char*) "g729_codec_drv",		/* char *driver_name, the argument to open_port */
-	NULL,			/* F_PTR finish, called when unloaded */
-	NULL,			/* handle */
-	codec_drv_control,	/* F_PTR control, port_command callback */
-	NULL,			/* F_PTR timeout, reserved */
-	NULL,			/* F_PTR outputv, reserved */
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	(int) ERL_DRV_EXTENDED_MARKER,
-	(int) ERL_DRV_EXTENDED_MAJOR_VERSION,
-	(int) ERL_DRV_EXTENDED_MINOR_VERSION,
-	0,
-	NULL,
-	NULL,
-	NULL
+const codec_ops g729_codec_ops = {
+	"g729",
+	g729_init,
+	g729_destroy,
+	g729_encode,
+	g729_decode,
+	g729_max_encoded,
+	g729_max_decoded,
+	g729_reset,
+	g729_ctl,
+	g729_plc
 };
 
-DRIVER_INIT(codec_drv) /* must match name in driver_entry */
-{
-	return &codec_driver_entry;
-}
+#define CODEC_OPS g729_codec_ops
+#define CODEC_NIF_FLAGS ERL_NIF_DIRTY_JOB_CPU_BOUND
+#include "codec_nif.h"
+
+CODEC_NIF_INIT(Elixir.XMediaLib.Codec.G729)
@@ -28,110 +28,110 @@
  *
  * ---------------------------------------------------------------------- */
 
-/* Loosely based on Evgeniy Khramtsov's original approach - erlrtp */
 
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
-#include "erl_driver.h"
+#include <stdlib.h>
 #include <spandsp/telephony.h>
 #include <spandsp/bit_operations.h>
 #include <spandsp/gsm0610.h>
+#include <spandsp/plc.h>
+#include "codec.h"
 
 typedef struct {
-	ErlDrvPort port;
 	gsm0610_state_t* dstate;
 	gsm0610_state_t* estate;
+	/* loss concealment history, fed with everything decoded */
+	plc_state_t* plc;
 } codec_data;
 
-enum {
-	CMD_ENCODE = 1,
-	CMD_DECODE = 2
-};
-
 #define FRAME_SIZE 160
 #define GSM_SIZE 33
 
-static ErlDrvData codec_drv_start(ErlDrvPort port, char *buff)
+static void* gsm_init(int sample_rate, int channels)
 {
-	codec_data* d = (codec_data*)driver_alloc(sizeof(codec_data));
-	d->port = port;
+	codec_data* d = (codec_data*)malloc(sizeof(codec_data));
+	if (!d)
+		return NULL;
 	d->dstate = gsm0610_init(NULL, GSM0610_PACKING_VOIP);
 	d->estate = gsm0610_init(NULL, GSM0610_PACKING_VOIP);
-	set_port_control_flags(port, PORT_CONTROL_FLAG_BINARY);
-	return (ErlDrvData)d;
+	d->plc = plc_init(NULL);
+	return d;
 }
 
-static void codec_drv_stop(ErlDrvData handle)
+static void gsm_destroy(void* state)
 {
-	codec_data *d = (codec_data *) handle;
+	codec_data* d = (codec_data*)state;
 	gsm0610_free(d->dstate);
 	gsm0610_free(d->estate);
-	driver_free((char*)handle);
+	plc_free(d->plc);
+	free(d);
+}
+
+static void gsm_reset(void* state)
+{
+	codec_data* d = (codec_data*)state;
+	gsm0610_init(d->dstate, GSM0610_PACKING_VOIP);
+	gsm0610_init(d->estate, GSM0610_PACKING_VOIP);
+	plc_init(d->plc);
 }
 
-static ErlDrvSSizeT codec_drv_control(
-		ErlDrvData handle,
-		unsigned int command,
-		char *buf, ErlDrvSizeT len,
-		char **rbuf, ErlDrvSizeT rlen)
+static int gsm_encode(void* state, const int16_t* pcm, size_t samples, uint8_t* out, size_t out_len)
 {
-	codec_data* d = (codec_data*)handle;
-
-	int ret = 0;
-	ErlDrvBinary *out;
-	*rbuf = NULL;
-
-	switch(command) {
-		case CMD_ENCODE:
-			if (len != FRAME_SIZE * 2)
-				break;
-			out = driver_alloc_binary(GSM_SIZE);
-
-			ret = gsm0610_encode(d->estate, (uint8_t*)out->orig_bytes, (const int16_t*)buf, len >> 1);
-			*rbuf = (char *)out;
-			break;
-		 case CMD_DECODE:
-			if (len != GSM_SIZE)
-				break;
-			out = driver_alloc_binary(FRAME_SIZE * 2);
-			ret = gsm0610_decode(d->dstate, (int16_t*)out->orig_bytes, (const uint8_t*)buf, len) >> 1;
-
-			*rbuf = (char *)out;
-			break;
-		 default:
-			break;
-	}
+	codec_data* d = (codec_data*)state;
+
+	/* any number of whole frames, gsm0610 walks them itself */
+	if (samples == 0 || samples % FRAME_SIZE != 0)
+		return -1;
+	return gsm0610_encode(d->estate, out, pcm, samples);
+}
+
+static int gsm_decode(void* state, const uint8_t* in, size_t len, int16_t* pcm, size_t max_samples)
+{
+	codec_data* d = (codec_data*)state;
+	int ret;
+
+	if (len == 0 || len % GSM_SIZE != 0)
+		return -1;
+	ret = gsm0610_decode(d->dstate, pcm, in, len);
+
+	if (ret > 0)
+		plc_rx(d->plc, pcm, ret);
 	return ret;
 }
 
-ErlDrvEntry codec_driver_entry = {
-	NULL,			/* F_PTR init, N/A */
-	codec_drv_start,	/* L_PTR start, called when port is opened */
-	codec_drv_stop,		/* F_PTR stop, called when port is closed */
-	NULL,			/* F_PTR output, called when erlang has sent */
-	NULL,			/* F_PTR ready_input, called when input descriptor ready */
-	NULL,			/* F_PTR ready_output, called when output descriptor ready */
-	(char*) "gsm_codec_drv",	/* char *driver_name, the argument to open_port */
-	NULL,			/* F_PTR finish, called when unloaded */
-	NULL,			/* handle */
-	codec_drv_control,	/* F_PTR control, port_command callback */
-	NULL,			/* F_PTR timeout, reserved */
-	NULL,			/* F_PTR outputv, reserved */
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	(int) ERL_DRV_EXTENDED_MARKER,
-	(int) ERL_DRV_EXTENDED_MAJOR_VERSION,
-	(int) ERL_DRV_EXTENDED_MINOR_VERSION,
-	0,
-	NULL,
-	NULL,
-	NULL
-};
+static size_t gsm_max_encoded(void* state, size_t samples)
+{
+	return samples / FRAME_SIZE * GSM_SIZE;
+}
+
+static size_t gsm_max_decoded(void* state, size_t len)
+{
+	return len / GSM_SIZE * FRAME_SIZE;
+}
 
-DRIVER_INIT(codec_drv) /* must match name in driver_entry */
+/* no concealment in the codec, spandsp's PLC repeats the last pitch period */
+static int gsm_plc(void* state, const uint8_t* next, size_t next_len, int16_t* pcm, size_t samples)
 {
-	return &codec_driver_entry;
+	codec_data* d = (codec_data*)state;
+	return plc_fillin(d->plc, pcm, samples);
 }
+
+const codec_ops gsm_codec_ops = {
+	"gsm",
+	gsm_init,
+	gsm_destroy,
+	gsm_encode,
+	gsm_decode,
+	gsm_max_encoded,
+	gsm_max_decoded,
+	gsm_reset,
+	NULL,			/* ctl */
+	gsm_plc
+};
+
+#define CODEC_OPS gsm_codec_ops
+#include "codec_nif.h"
+
+CODEC_NIF_INIT(Elixir.XMediaLib.Codec.GSM)
@@ -0,0 +1,145 @@
+/* ----------------------------------------------------------------------
+ *
+ * Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+ * for his excellent work in this area.
+ *
+ * @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+ *
+ * Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+ *
+ * Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+ *
+ * All rights reserved.
+ *
+ * XMediaLib is licensed by Xirsys, with permission, under the Apache
+ * License Version 2.0. (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See LICENSE for the full license text.
+ *
+ * ---------------------------------------------------------------------- */
+
+
+#ifndef __HMAC_SHA1_H__
+#define __HMAC_SHA1_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <openssl/evp.h>
+
+/*
+ * HMAC-SHA1 with the key schedule done once. The SHA-1 states after
+ * absorbing (key ^ ipad) and (key ^ opad) are kept, so every message only
+ * costs copying them and hashing the message itself.
+ */
+
+#define HMAC_SHA1_BLOCK 64
+#define HMAC_SHA1_SIZE 20
+
+typedef struct {
+	EVP_MD_CTX* inner;
+	EVP_MD_CTX* outer;
+	EVP_MD_CTX* work;
+} hmac_sha1;
+
+static void hmac_sha1_free(hmac_sha1* h)
+{
+	if (h->inner)
+		EVP_MD_CTX_free(h->inner);
+	if (h->outer)
+		EVP_MD_CTX_free(h->outer);
+	if (h->work)
+		EVP_MD_CTX_free(h->work);
+	h->inner = h->outer = h->work = NULL;
+}
+
+static int hmac_sha1_init(hmac_sha1* h, const uint8_t* key, size_t len)
+{
+	uint8_t k[HMAC_SHA1_BLOCK];
+	uint8_t pad[HMAC_SHA1_BLOCK];
+	unsigned int dlen;
+	int i;
+
+	h->inner = EVP_MD_CTX_new();
+	h->outer = EVP_MD_CTX_new();
+	h->work = EVP_MD_CTX_new();
+	if (!h->inner || !h->outer || !h->work)
+		goto fail;
+
+	memset(k, 0, sizeof(k));
+	if (len > HMAC_SHA1_BLOCK) {
+		if (!EVP_Digest(key, len, k, &dlen, EVP_sha1(), NULL))
+			goto fail;
+	}
+	else if (len)
+		memcpy(k, key, len);
+
+	for (i = 0; i < HMAC_SHA1_BLOCK; i++)
+		pad[i] = k[i] ^ 0x36;
+	if (!EVP_DigestInit_ex(h->inner, EVP_sha1(), NULL) || !EVP_DigestUpdate(h->inner, pad, sizeof(pad)))
+		goto fail;
+
+	for (i = 0; i < HMAC_SHA1_BLOCK; i++)
+		pad[i] = k[i] ^ 0x5c;
+	if (!EVP_DigestInit_ex(h->outer, EVP_sha1(), NULL) || !EVP_DigestUpdate(h->outer, pad, sizeof(pad)))
+		goto fail;
+
+	return 1;
+
+fail:
+	hmac_sha1_free(h);
+	return 0;
+}
+
+/*
+ * The _ctx variants hash into a working context the caller owns, so any
+ * number of threads can use one key schedule at the same time: inner and
+ * outer are only ever read once hmac_sha1_init has returned.
+ */
+static inline int hmac_sha1_start_ctx(const hmac_sha1* h, EVP_MD_CTX* work)
+{
+	return EVP_MD_CTX_copy_ex(work, h->inner);
+}
+
+static inline int hmac_sha1_update_ctx(EVP_MD_CTX* work, const void* data, size_t len)
+{
+	return EVP_DigestUpdate(work, data, len);
+}
+
+static inline int hmac_sha1_final_ctx(const hmac_sha1* h, EVP_MD_CTX* work, uint8_t out[HMAC_SHA1_SIZE])
+{
+	uint8_t digest[HMAC_SHA1_SIZE];
+	unsigned int len;
+
+	return EVP_DigestFinal_ex(work, digest, &len) &&
+		EVP_MD_CTX_copy_ex(work, h->outer) &&
+		EVP_DigestUpdate(work, digest, sizeof(digest)) &&
+		EVP_DigestFinal_ex(work, out, &len);
+}
+
+static inline int hmac_sha1_start(hmac_sha1* h)
+{
+	return hmac_sha1_start_ctx(h, h->work);
+}
+
+static inline int hmac_sha1_update(hmac_sha1* h, const void* data, size_t len)
+{
+	return hmac_sha1_update_ctx(h->work, data, len);
+}
+
+static inline int hmac_sha1_final(hmac_sha1* h, uint8_t out[HMAC_SHA1_SIZE])
+{
+	return hmac_sha1_final_ctx(h, h->work, out);
+}
+
+#endif /* __HMAC_SHA1_H__ */
@@ -28,32 +28,36 @@
  *
  * ---------------------------------------------------------------------- */
 
+
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
-#include "erl_driver.h"
+#include <stdlib.h>
 #include <ilbc.h>
-//#include <syslog.h>
+#include "codec.h"
 
 typedef struct {
-	ErlDrvPort port;
 	// 20 msec codec
 	iLBC_encinst_t* estate20;
 	iLBC_decinst_t* dstate20;
 	// 30 msec codec
 	iLBC_encinst_t* estate30;
 	iLBC_decinst_t* dstate30;
+	/* mode of the last payload decoded, lost frames are concealed in it */
+	iLBC_decinst_t* last;
+	size_t last_frame;
 } codec_data;
 
-enum {
-	CMD_ENCODE = 1,
-	CMD_DECODE = 2
-};
+#define FRAME_SIZE_20 160
+#define FRAME_SIZE_30 240
+#define ILBC_SIZE_20 38
+#define ILBC_SIZE_30 50
 
-static ErlDrvData codec_drv_start(ErlDrvPort port, char *buff)
+static void* ilbc_init(int sample_rate, int channels)
 {
-	codec_data* d = (codec_data*)driver_alloc(sizeof(codec_data));
-	d->port = port;
+	codec_data* d = (codec_data*)malloc(sizeof(codec_data));
+	if (!d)
+		return NULL;
 
 	/* Create structs */
 	WebRtcIlbcfix_EncoderCreate(&d->estate20);
@@ -65,104 +69,138 @@ static ErlDrvData codec_drv_start(ErlDrvPort port, char *buff)
 	WebRtcIlbcfix_DecoderCreate(&d->dstate30);
 	WebRtcIlbcfix_DecoderInit(d->dstate20, 20);
 	WebRtcIlbcfix_DecoderInit(d->dstate30, 30);
+	d->last = d->dstate20;
+	d->last_frame = FRAME_SIZE_20;
 
-	set_port_control_flags(port, PORT_CONTROL_FLAG_BINARY);
-//	openlog("ilbc_codec_drv", LOG_NDELAY, LOG_USER);
-	return (ErlDrvData)d;
+	return d;
 }
 
-static void codec_drv_stop(ErlDrvData handle)
+static void ilbc_destroy(void* state)
 {
-	codec_data* d = (codec_data*)handle;
+	codec_data* d = (codec_data*)state;
 	WebRtcIlbcfix_EncoderFree(d->estate20);
 	WebRtcIlbcfix_EncoderFree(d->estate30);
 	WebRtcIlbcfix_DecoderFree(d->dstate20);
 	WebRtcIlbcfix_DecoderFree(d->dstate30);
-	driver_free((char*)d);
-//	closelog();
+	free(d);
+}
+
+static void ilbc_reset(void* state)
+{
+	codec_data* d = (codec_data*)state;
+	WebRtcIlbcfix_EncoderInit(d->estate20, 20);
+	WebRtcIlbcfix_EncoderInit(d->estate30, 30);
+	WebRtcIlbcfix_DecoderInit(d->dstate20, 20);
+	WebRtcIlbcfix_DecoderInit(d->dstate30, 30);
+	d->last = d->dstate20;
+	d->last_frame = FRAME_SIZE_20;
 }
 
-static ErlDrvSSizeT codec_drv_control(
-		ErlDrvData handle,
-		unsigned int command,
-		char *buf, ErlDrvSizeT len,
-		char **rbuf, ErlDrvSizeT rlen)
+/*
+ * Several frames may be passed at once. The mode follows from the length:
+ * multiples of the 20 msec frame are taken as 20 msec frames, otherwise
+ * multiples of the 30 msec frame as 30 msec ones.
+ */
+static int ilbc_encode(void* state, const int16_t* pcm, size_t samples, uint8_t* out, size_t out_len)
 {
-	codec_data* d = (codec_data*)handle;
-
-	int ret = 0;
-	ErlDrvBinary *out;
-	*rbuf = NULL;
-
-	int16_t i = 1;
-
-//	syslog(LOG_USER | LOG_WARNING, "INIT: %d %d\n", command, len);
-
-	switch(command) {
-		case CMD_ENCODE:
-			switch(len){
-				case 320: // 20 msec
-					out = driver_alloc_binary(38);
-					ret = WebRtcIlbcfix_Encode(d->estate20, (int16_t*)buf, 160, (int16_t*)out->orig_bytes);
-					*rbuf = (char *)out;
-					break;
-				case 480: // 30 msec
-					out = driver_alloc_binary(50);
-					ret = WebRtcIlbcfix_Encode(d->estate30, (int16_t*)buf, 240, (int16_t*)out->orig_bytes);
-					*rbuf = (char *)out;
-					break;
-				default:
-					break;
-			}
-			break;
-		 case CMD_DECODE:
-			switch(len){
-				case 38: // 20 msec
-					out = driver_alloc_binary(320);
-					ret = 2 * WebRtcIlbcfix_Decode(d->dstate20, (int16_t*)buf, len, (int16_t*)out->orig_bytes, &i);
-					*rbuf = (char *)out;
-					break;
-				case 50: // 30 msec
-					out = driver_alloc_binary(480);
-					ret = 2 * WebRtcIlbcfix_Decode(d->dstate30, (int16_t*)buf, len, (int16_t*)out->orig_bytes, &i);
-					*rbuf = (char *)out;
-					break;
-				default:
-					break;
-			}
-		 default:
-			break;
+	codec_data* d = (codec_data*)state;
+	iLBC_encinst_t* e;
+	size_t frame, size, n, i;
+
+	if (samples == 0)
+		return -1;
+	if (samples % FRAME_SIZE_20 == 0) {
+		e = d->estate20;
+		frame = FRAME_SIZE_20;
+		size = ILBC_SIZE_20;
+	}
+	else if (samples % FRAME_SIZE_30 == 0) {
+		e = d->estate30;
+		frame = FRAME_SIZE_30;
+		size = ILBC_SIZE_30;
 	}
-	return ret;
+	else
+		return -1;
+
+	n = samples / frame;
+	for (i = 0; i < n; i++)
+		if (WebRtcIlbcfix_Encode(e, pcm + frame * i, frame, (int16_t*)(out + size * i)) < 0)
+			return -1;
+
+	return n * size;
 }
 
-ErlDrvEntry codec_driver_entry = {
-	NULL,			/* F_PTR init, N/A */
-	codec_drv_start,	/* L_PTR start, called when port is opened */
-	codec_drv_stop,		/* F_PTR stop, called when port is closed */
-	NULL,			/* F_PTR output, called when erlang has sent */
-	NULL,			/* F_PTR ready_input, called when input descriptor ready */
-	NULL,			/* F_PTR ready_output, called when output descriptor ready */
-	(char*) "ilbc_codec_drv",		/* char *driver_name, the argument to open_port */
-	NULL,			/* F_PTR finish, called when unloaded */
-	NULL,			/* handle */
-	codec_drv_control,	/* F_PTR control, port_command callback */
-	NULL,			/* F_PTR timeout, reserved */
-	NULL,			/* F_PTR outputv, reserved */
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	(int) ERL_DRV_EXTENDED_MARKER,
-	(int) ERL_DRV_EXTENDED_MAJOR_VERSION,
-	(int) ERL_DRV_EXTENDED_MINOR_VERSION,
-	0,
-	NULL,
-	NULL,
-	NULL
-};
+static int ilbc_decode(void* state, const uint8_t* in, size_t len, int16_t* pcm, size_t max_samples)
+{
+	codec_data* d = (codec_data*)state;
+	iLBC_decinst_t* dec;
+	int16_t speech_type = 1;
+	size_t frame, size, n, i;
 
-DRIVER_INIT(codec_drv) /* must match name in driver_entry */
+	if (len == 0)
+		return -1;
+	if (len % ILBC_SIZE_20 == 0) {
+		dec = d->dstate20;
+		frame = FRAME_SIZE_20;
+		size = ILBC_SIZE_20;
+	}
+	else if (len % ILBC_SIZE_30 == 0) {
+		dec = d->dstate30;
+		frame = FRAME_SIZE_30;
+		size = ILBC_SIZE_30;
+	}
+	else
+		return -1;
+
+	d->last = dec;
+	d->last_frame = frame;
+
+	n = len / size;
+	for (i = 0; i < n; i++)
+		if (WebRtcIlbcfix_Decode(dec, (const int16_t*)(in + size * i), size, pcm + frame * i, &speech_type) < 0)
+			return -1;
+
+	return n * frame;
+}
+
+static int ilbc_plc(void* state, const uint8_t* next, size_t next_len, int16_t* pcm, size_t samples)
+{
+	codec_data* d = (codec_data*)state;
+	size_t n = samples / d->last_frame;
+
+	if (samples == 0 || samples % d->last_frame != 0)
+		return -1;
+	if (WebRtcIlbcfix_DecodePlc(d->last, pcm, n) < 0)
+		return -1;
+	return n * d->last_frame;
+}
+
+/* 20 msec frames give the larger output for a given input */
+static size_t ilbc_max_encoded(void* state, size_t samples)
+{
+	return (samples / FRAME_SIZE_20 + 1) * ILBC_SIZE_20;
+}
+
+static size_t ilbc_max_decoded(void* state, size_t len)
 {
-	return &codec_driver_entry;
+	return (len / ILBC_SIZE_20 + 1) * FRAME_SIZE_30;
 }
+
+const codec_ops ilbc_codec_ops = {
+	"ilbc",
+	ilbc_init,
+	ilbc_destroy,
+	ilbc_encode,
+	ilbc_decode,
+	ilbc_max_encoded,
+	ilbc_max_decoded,
+	ilbc_reset,
+	NULL,			/* ctl */
+	ilbc_plc
+};
+
+#define CODEC_OPS ilbc_codec_ops
+#define CODEC_NIF_FLAGS ERL_NIF_DIRTY_JOB_CPU_BOUND
+#include "codec_nif.h"
+
+CODEC_NIF_INIT(Elixir.XMediaLib.Codec.ILBC)
@@ -0,0 +1,489 @@
+/* ----------------------------------------------------------------------
+ *
+ * Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+ * for his excellent work in this area.
+ *
+ * @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+ *
+ * Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+ *
+ * Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+ *
+ * All rights reserved.
+ *
+ * XMediaLib is licensed by Xirsys, with permission, under the Apache
+ * License Version 2.0. (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See LICENSE for the full license text.
+ *
+ * ---------------------------------------------------------------------- */
+
+
+#include <string.h>
+#include <stdint.h>
+#include "erl_nif.h"
+
+/*
+ * Adaptive jitter buffer for one RTP stream. Packets go into a fixed ring
+ * indexed by sequence number, so reordering and duplicates cost nothing
+ * more than an in-order packet, and slot buffers are kept for the life of
+ * the stream. get/1 is called once per playout tick and hands out the next
+ * frame in sequence order, or says the frame is lost so the caller can run
+ * PLC.
+ *
+ * The depth follows the RFC 3550 interarrival jitter estimate between the
+ * configured limits. It grows when the buffer runs dry (playout stops until
+ * the new depth is buffered) and shrinks by dropping a frame now and then
+ * while the buffer holds more than it needs.
+ */
+
+/* power of two, 2.56 s of 20 ms frames */
+#define JB_SLOTS 128
+#define JB_MASK (JB_SLOTS - 1)
+/* don't drop frames to shrink the buffer more often than this */
+#define JB_TRIM_TICKS 50
+
+typedef struct {
+	uint8_t* data;
+	size_t size;
+	size_t capacity;
+	uint32_t ts;
+	uint16_t seq;
+	int used;
+} jb_slot;
+
+typedef struct {
+	ErlNifMutex* lock;
+	int clock_rate;
+	/* depth limits and the current target, in timestamp units */
+	uint32_t min_delay;
+	uint32_t max_delay;
+	uint32_t target;
+	/* timestamp units per packet, learnt from consecutive packets */
+	uint32_t frame;
+	int have_head;
+	int playing;
+	/* something was played, older packets are late from now on */
+	int started;
+	/* next packet to play out, or the oldest one while filling up */
+	uint16_t next_seq;
+	uint32_t next_ts;
+	/* newest packet buffered */
+	uint16_t top_seq;
+	uint32_t top_ts;
+	int count;
+	/* RFC 3550 A.8, scaled by 16 */
+	uint32_t jitter;
+	uint32_t transit;
+	int have_transit;
+	int ticks;
+	ErlNifUInt64 received;
+	ErlNifUInt64 played;
+	ErlNifUInt64 lost;
+	ErlNifUInt64 late;
+	ErlNifUInt64 dropped;
+	jb_slot slots[JB_SLOTS];
+} jitter_buffer;
+
+static ErlNifResourceType* jitter_buffer_type = NULL;
+
+static ERL_NIF_TERM atom_ok;
+static ERL_NIF_TERM atom_lost;
+static ERL_NIF_TERM atom_empty;
+static ERL_NIF_TERM atom_late;
+static ERL_NIF_TERM atom_duplicate;
+static ERL_NIF_TERM atom_depth;
+static ERL_NIF_TERM atom_target;
+static ERL_NIF_TERM atom_jitter;
+static ERL_NIF_TERM atom_received;
+static ERL_NIF_TERM atom_played;
+static ERL_NIF_TERM atom_dropped;
+
+static inline int seq_diff(uint16_t a, uint16_t b)
+{
+	return (int16_t)(uint16_t)(a - b);
+}
+
+static uint32_t ms_to_ts(const jitter_buffer* jb, int ms)
+{
+	return (uint32_t)((ErlNifUInt64)ms * jb->clock_rate / 1000);
+}
+
+static uint32_t ts_to_ms(const jitter_buffer* jb, uint32_t ts)
+{
+	return (uint32_t)((ErlNifUInt64)ts * 1000 / jb->clock_rate);
+}
+
+/* Timestamp span from the next frame to play to the end of the newest one */
+static uint32_t jb_buffered(const jitter_buffer* jb)
+{
+	int32_t span;
+
+	if (!jb->count)
+		return 0;
+	span = (int32_t)(jb->top_ts - jb->next_ts) + (int32_t)jb->frame;
+	/* a timestamp jump somewhere in the buffer, count packets instead */
+	if (span <= 0 || (uint32_t)span > JB_SLOTS * jb->frame)
+		return jb->count * jb->frame;
+	return (uint32_t)span;
+}
+
+static void jb_update_target(jitter_buffer* jb)
+{
+	uint32_t target = jb->frame + 3 * (jb->jitter >> 4);
+
+	if (target < jb->min_delay)
+		target = jb->min_delay;
+	if (target > jb->max_delay)
+		target = jb->max_delay;
+	jb->target = target;
+}
+
+static void jb_update_jitter(jitter_buffer* jb, uint32_t arrival, uint32_t ts)
+{
+	uint32_t transit = arrival - ts;
+	int32_t d;
+
+	if (jb->have_transit) {
+		d = (int32_t)(transit - jb->transit);
+		if (d < 0)
+			d = -d;
+		/* more than a second off is a timestamp jump, not jitter */
+		if (d < jb->clock_rate)
+			jb->jitter += d - ((jb->jitter + 8) >> 4);
+	}
+	jb->transit = transit;
+	jb->have_transit = 1;
+}
+
+static void jb_release(jitter_buffer* jb, jb_slot* s)
+{
+	s->used = 0;
+	jb->count--;
+}
+
+static void jb_flush(jitter_buffer* jb)
+{
+	int i;
+
+	for (i = 0; i < JB_SLOTS; i++)
+		jb->slots[i].used = 0;
+	jb->count = 0;
+	jb->have_head = 0;
+	jb->playing = 0;
+	jb->started = 0;
+	jb->ticks = 0;
+}
+
+static void jb_set_head(jitter_buffer* jb, uint16_t seq, uint32_t ts)
+{
+	jb->next_seq = seq;
+	jb->next_ts = ts;
+	jb->have_head = 1;
+}
+
+static ERL_NIF_TERM jb_put(ErlNifEnv* env, jitter_buffer* jb, uint16_t seq, uint32_t ts,
+		ErlNifBinary* payload, uint32_t arrival)
+{
+	jb_slot* s;
+	int d;
+
+	jb_update_jitter(jb, arrival, ts);
+	jb_update_target(jb);
+
+	if (!jb->have_head) {
+		jb_set_head(jb, seq, ts);
+		jb->top_seq = seq;
+		jb->top_ts = ts;
+	} else {
+		d = seq_diff(seq, jb->next_seq);
+		if (d >= JB_SLOTS || d < -JB_SLOTS) {
+			/* too far off either way for the ring, the stream was restarted */
+			jb_flush(jb);
+			jb_set_head(jb, seq, ts);
+			jb->top_seq = seq;
+			jb->top_ts = ts;
+		} else if (d < 0 && (jb->started || seq_diff(jb->top_seq, seq) >= JB_SLOTS)) {
+			jb->late++;
+			return atom_late;
+		} else if (d < 0) {
+			/* still filling up, an older packet becomes the head */
+			jb_set_head(jb, seq, ts);
+		}
+	}
+
+	s = &jb->slots[seq & JB_MASK];
+	if (s->used) {
+		if (s->seq == seq)
+			return atom_duplicate;
+		jb_release(jb, s);
+	}
+
+	if (payload->size > s->capacity) {
+		uint8_t* tmp = (uint8_t*)enif_realloc(s->data, payload->size);
+		if (!tmp)
+			return enif_make_badarg(env);
+		s->data = tmp;
+		s->capacity = payload->size;
+	}
+	if (payload->size)
+		memcpy(s->data, payload->data, payload->size);
+	s->size = payload->size;
+	s->seq = seq;
+	s->ts = ts;
+	s->used = 1;
+	jb->count++;
+	jb->received++;
+
+	d = seq_diff(seq, jb->top_seq);
+	if (d > 0) {
+		uint32_t delta = ts - jb->top_ts;
+		if (d == 1 && delta > 0 && delta <= (uint32_t)jb->clock_rate / 4) {
+			jb->frame = delta;
+			jb_update_target(jb);
+		}
+		jb->top_seq = seq;
+		jb->top_ts = ts;
+	}
+
+	return atom_ok;
+}
+
+/* Playout resumes at the oldest packet buffered */
+static void jb_seek_oldest(jitter_buffer* jb)
+{
+	jb_slot* s;
+	int i;
+
+	for (i = 0; i < JB_SLOTS; i++) {
+		s = &jb->slots[(uint16_t)(jb->next_seq + i) & JB_MASK];
+		if (s->used && s->seq == (uint16_t)(jb->next_seq + i)) {
+			jb_set_head(jb, s->seq, s->ts);
+			return;
+		}
+	}
+}
+
+static ERL_NIF_TERM jb_get(ErlNifEnv* env, jitter_buffer* jb)
+{
+	ERL_NIF_TERM payload;
+	jb_slot* s;
+	uint32_t ts;
+
+	if (!jb->have_head)
+		return atom_empty;
+
+	if (!jb->playing) {
+		if (!jb->count || jb_buffered(jb) < jb->target)
+			return atom_empty;
+		if (jb->started)
+			jb_seek_oldest(jb);
+		jb->playing = 1;
+		jb->started = 1;
+		jb->ticks = 0;
+	}
+
+	s = &jb->slots[jb->next_seq & JB_MASK];
+
+	if (++jb->ticks >= JB_TRIM_TICKS && jb->count > 1 &&
+			jb_buffered(jb) > jb->target + 2 * jb->frame) {
+		/* deeper than needed, skip a frame */
+		if (s->used && s->seq == jb->next_seq) {
+			jb->next_ts = s->ts;
+			jb_release(jb, s);
+			jb->dropped++;
+		}
+		jb->next_seq++;
+		jb->next_ts += jb->frame;
+		jb->ticks = 0;
+		s = &jb->slots[jb->next_seq & JB_MASK];
+	}
+
+	if (s->used && s->seq == jb->next_seq) {
+		ts = s->ts;
+		memcpy(enif_make_new_binary(env, s->size, &payload), s->data, s->size);
+		jb_release(jb, s);
+		jb->played++;
+		jb->next_seq++;
+		jb->next_ts = ts + jb->frame;
+		return enif_make_tuple3(env, atom_ok, payload, enif_make_uint(env, ts));
+	}
+
+	ts = jb->next_ts;
+	jb->next_seq++;
+	jb->next_ts += jb->frame;
+	jb->lost++;
+	/* ran dry, refill to the current target before playing again */
+	if (!jb->count)
+		jb->playing = 0;
+
+	return enif_make_tuple2(env, atom_lost, enif_make_uint(env, ts));
+}
+
+static void jitter_buffer_dtor(ErlNifEnv* env, void* obj)
+{
+	jitter_buffer* jb = (jitter_buffer*)obj;
+	int i;
+
+	for (i = 0; i < JB_SLOTS; i++)
+		if (jb->slots[i].data)
+			enif_free(jb->slots[i].data);
+	if (jb->lock)
+		enif_mutex_destroy(jb->lock);
+}
+
+static ERL_NIF_TERM jitter_new(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	jitter_buffer* jb;
+	ERL_NIF_TERM term;
+	int clock_rate, min_ms, max_ms;
+
+	if (!enif_get_int(env, argv[0], &clock_rate) || clock_rate <= 0 ||
+			!enif_get_int(env, argv[1], &min_ms) || min_ms < 0 ||
+			!enif_get_int(env, argv[2], &max_ms) || max_ms < min_ms)
+		return enif_make_badarg(env);
+
+	jb = (jitter_buffer*)enif_alloc_resource(jitter_buffer_type, sizeof(jitter_buffer));
+	memset(jb, 0, sizeof(jitter_buffer));
+	jb->clock_rate = clock_rate;
+	jb->min_delay = ms_to_ts(jb, min_ms);
+	jb->max_delay = ms_to_ts(jb, max_ms);
+	jb->frame = ms_to_ts(jb, 20);
+	jb_update_target(jb);
+	if (!(jb->lock = enif_mutex_create((char*)"jitter_buffer"))) {
+		enif_release_resource(jb);
+		return enif_make_badarg(env);
+	}
+
+	term = enif_make_resource(env, jb);
+	enif_release_resource(jb);
+
+	return enif_make_tuple2(env, atom_ok, term);
+}
+
+static ERL_NIF_TERM jitter_put(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	jitter_buffer* jb;
+	ErlNifBinary payload;
+	unsigned int seq;
+	ErlNifUInt64 ts;
+	ErlNifSInt64 arrival;
+	ERL_NIF_TERM ret;
+
+	if (!enif_get_resource(env, argv[0], jitter_buffer_type, (void**)&jb) ||
+			!enif_get_uint(env, argv[1], &seq) || seq > 0xFFFF ||
+			!enif_get_uint64(env, argv[2], &ts) || ts > 0xFFFFFFFF ||
+			!enif_inspect_binary(env, argv[3], &payload) ||
+			!enif_get_int64(env, argv[4], &arrival))
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(jb->lock);
+	ret = jb_put(env, jb, (uint16_t)seq, (uint32_t)ts, &payload,
+			(uint32_t)((ErlNifUInt64)arrival * jb->clock_rate / 1000));
+	enif_mutex_unlock(jb->lock);
+
+	return ret;
+}
+
+static ERL_NIF_TERM jitter_get(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	jitter_buffer* jb;
+	ERL_NIF_TERM ret;
+
+	if (!enif_get_resource(env, argv[0], jitter_buffer_type, (void**)&jb))
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(jb->lock);
+	ret = jb_get(env, jb);
+	enif_mutex_unlock(jb->lock);
+
+	return ret;
+}
+
+static ERL_NIF_TERM jitter_stats(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	jitter_buffer* jb;
+	ERL_NIF_TERM ret;
+
+	if (!enif_get_resource(env, argv[0], jitter_buffer_type, (void**)&jb))
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(jb->lock);
+	ret = enif_make_list(env, 8,
+			enif_make_tuple2(env, atom_depth, enif_make_uint(env, ts_to_ms(jb, jb_buffered(jb)))),
+			enif_make_tuple2(env, atom_target, enif_make_uint(env, ts_to_ms(jb, jb->target))),
+			enif_make_tuple2(env, atom_jitter, enif_make_uint(env, ts_to_ms(jb, jb->jitter >> 4))),
+			enif_make_tuple2(env, atom_received, enif_make_uint64(env, jb->received)),
+			enif_make_tuple2(env, atom_played, enif_make_uint64(env, jb->played)),
+			enif_make_tuple2(env, atom_lost, enif_make_uint64(env, jb->lost)),
+			enif_make_tuple2(env, atom_late, enif_make_uint64(env, jb->late)),
+			enif_make_tuple2(env, atom_dropped, enif_make_uint64(env, jb->dropped)));
+	enif_mutex_unlock(jb->lock);
+
+	return ret;
+}
+
+static ERL_NIF_TERM jitter_reset(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	jitter_buffer* jb;
+
+	if (!enif_get_resource(env, argv[0], jitter_buffer_type, (void**)&jb))
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(jb->lock);
+	jb_flush(jb);
+	jb->have_transit = 0;
+	jb->jitter = 0;
+	jb_update_target(jb);
+	enif_mutex_unlock(jb->lock);
+
+	return atom_ok;
+}
+
+static int load(ErlNifEnv* env, void** priv_data, ERL_NIF_TERM load_info)
+{
+	jitter_buffer_type = enif_open_resource_type(env, NULL, "jitter_buffer",
+			jitter_buffer_dtor, ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, NULL);
+	if (!jitter_buffer_type)
+		return -1;
+
+	atom_ok = enif_make_atom(env, "ok");
+	atom_lost = enif_make_atom(env, "lost");
+	atom_empty = enif_make_atom(env, "empty");
+	atom_late = enif_make_atom(env, "late");
+	atom_duplicate = enif_make_atom(env, "duplicate");
+	atom_depth = enif_make_atom(env, "depth");
+	atom_target = enif_make_atom(env, "target");
+	atom_jitter = enif_make_atom(env, "jitter");
+	atom_received = enif_make_atom(env, "received");
+	atom_played = enif_make_atom(env, "played");
+	atom_dropped = enif_make_atom(env, "dropped");
+
+	return 0;
+}
+
+static int upgrade(ErlNifEnv* env, void** priv_data, void** old_priv_data, ERL_NIF_TERM load_info)
+{
+	return load(env, priv_data, load_info);
+}
+
+static ErlNifFunc jitter_nif_funcs[] =
+{
+	{"new", 3, jitter_new, 0},
+	{"put", 5, jitter_put, 0},
+	{"get", 1, jitter_get, 0},
+	{"stats", 1, jitter_stats, 0},
+	{"reset", 1, jitter_reset, 0}
+};
+
+ERL_NIF_INIT(Elixir.XMediaLib.JitterBuffer,jitter_nif_funcs,load,NULL,upgrade,NULL)
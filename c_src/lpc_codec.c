@@ -28,103 +28,103 @@
  *
  * ---------------------------------------------------------------------- */
 
+
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
-#include "erl_driver.h"
+#include <stdlib.h>
 #include <spandsp/telephony.h>
 #include <spandsp/lpc10.h>
+#include <spandsp/plc.h>
+#include "codec.h"
 
 typedef struct {
-	ErlDrvPort port;
 	lpc10_decode_state_t* dstate;
 	lpc10_encode_state_t* estate;
+	/* loss concealment history, fed with everything decoded */
+	plc_state_t* plc;
 } codec_data;
 
-enum {
-	CMD_ENCODE = 1,
-	CMD_DECODE = 2
-};
+/* 180 samples (22.5 msec) are packed into 54 bits */
+#define LPC10_SAMPLES_PER_FRAME 180
+#define LPC10_BYTES_PER_FRAME 7
 
-static ErlDrvData codec_drv_start(ErlDrvPort port, char *buff)
+static void* lpc_init(int sample_rate, int channels)
 {
-	codec_data* d = (codec_data*)driver_alloc(sizeof(codec_data));
+	codec_data* d = (codec_data*)malloc(sizeof(codec_data));
+	if (!d)
+		return NULL;
 	/* no error correction */
 	d->dstate = lpc10_decode_init(NULL, 0);
 	d->estate = lpc10_encode_init(NULL, 0);
-	d->port = port;
-	set_port_control_flags(port, PORT_CONTROL_FLAG_BINARY);
-	return (ErlDrvData)d;
+	d->plc = plc_init(NULL);
+	return d;
 }
 
-static void codec_drv_stop(ErlDrvData handle)
+static void lpc_destroy(void* state)
 {
-	codec_data* d = (codec_data*)driver_alloc(sizeof(codec_data));
+	codec_data* d = (codec_data*)state;
 	lpc10_encode_free(d->estate);
 	lpc10_decode_free(d->dstate);
-	driver_free((char*)handle);
+	plc_free(d->plc);
+	free(d);
+}
+
+static void lpc_reset(void* state)
+{
+	codec_data* d = (codec_data*)state;
+	lpc10_decode_init(d->dstate, 0);
+	lpc10_encode_init(d->estate, 0);
+	plc_init(d->plc);
 }
 
-static ErlDrvSSizeT codec_drv_control(
-		ErlDrvData handle,
-		unsigned int command,
-		char *buf, ErlDrvSizeT len,
-		char **rbuf, ErlDrvSizeT rlen)
+static int lpc_encode(void* state, const int16_t* pcm, size_t samples, uint8_t* out, size_t out_len)
 {
-	codec_data* d = (codec_data*)handle;
-
-	int ret = 0;
-	ErlDrvBinary *out;
-	int16_t amp[240]; // for 30 msec sample
-	uint8_t data[480]; // no idea how big it could be - FIXME
-	*rbuf = NULL;
-
-	switch(command) {
-		case CMD_ENCODE:
-			ret = lpc10_encode(d->estate, data, (const int16_t*)buf, len >> 1);
-			out = driver_alloc_binary(ret);
-			memcpy(out->orig_bytes, data, ret);
-			*rbuf = (char *) out;
-			break;
-		 case CMD_DECODE:
-			ret = lpc10_decode(d->dstate, amp, (const uint8_t*)buf, len) >> 1;
-			out = driver_alloc_binary(ret);
-			memcpy(out->orig_bytes, amp, ret);
-			*rbuf = (char *) out;
-			break;
-		 default:
-			break;
-	}
+	codec_data* d = (codec_data*)state;
+	return lpc10_encode(d->estate, out, pcm, samples);
+}
+
+static int lpc_decode(void* state, const uint8_t* in, size_t len, int16_t* pcm, size_t max_samples)
+{
+	codec_data* d = (codec_data*)state;
+	int ret = lpc10_decode(d->dstate, pcm, in, len);
+
+	if (ret > 0)
+		plc_rx(d->plc, pcm, ret);
 	return ret;
 }
 
-ErlDrvEntry codec_driver_entry = {
-	NULL,			/* F_PTR init, N/A */
-	codec_drv_start,	/* L_PTR start, called when port is opened */
-	codec_drv_stop,		/* F_PTR stop, called when port is closed */
-	NULL,			/* F_PTR output, called when erlang has sent */
-	NULL,			/* F_PTR ready_input, called when input descriptor ready */
-	NULL,			/* F_PTR ready_output, called when output descriptor ready */
-	(char*) "lpc_codec_drv",		/* char *driver_name, the argument to open_port */
-	NULL,			/* F_PTR finish, called when unloaded */
-	NULL,			/* handle */
-	codec_drv_control,	/* F_PTR control, port_command callback */
-	NULL,			/* F_PTR timeout, reserved */
-	NULL,			/* F_PTR outputv, reserved */
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	(int) ERL_DRV_EXTENDED_MARKER,
-	(int) ERL_DRV_EXTENDED_MAJOR_VERSION,
-	(int) ERL_DRV_EXTENDED_MINOR_VERSION,
-	0,
-	NULL,
-	NULL,
-	NULL
-};
+static size_t lpc_max_encoded(void* state, size_t samples)
+{
+	return (samples / LPC10_SAMPLES_PER_FRAME + 1) * LPC10_BYTES_PER_FRAME;
+}
+
+static size_t lpc_max_decoded(void* state, size_t len)
+{
+	return (len / LPC10_BYTES_PER_FRAME + 1) * LPC10_SAMPLES_PER_FRAME;
+}
 
-DRIVER_INIT(codec_drv) /* must match name in driver_entry */
+/* no concealment in the codec, spandsp's PLC repeats the last pitch period */
+static int lpc_plc(void* state, const uint8_t* next, size_t next_len, int16_t* pcm, size_t samples)
 {
-	return &codec_driver_entry;
+	codec_data* d = (codec_data*)state;
+	return plc_fillin(d->plc, pcm, samples);
 }
+
+const codec_ops lpc_codec_ops = {
+	"lpc",
+	lpc_init,
+	lpc_destroy,
+	lpc_encode,
+	lpc_decode,
+	lpc_max_encoded,
+	lpc_max_decoded,
+	lpc_reset,
+	NULL,			/* ctl */
+	lpc_plc
+};
+
+#define CODEC_OPS lpc_codec_ops
+#include "codec_nif.h"
+
+CODEC_NIF_INIT(Elixir.XMediaLib.Codec.LPC)
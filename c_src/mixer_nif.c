@@ -0,0 +1,250 @@
+/* ----------------------------------------------------------------------
+ *
+ * Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+ * for his excellent work in this area.
+ *
+ * @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+ *
+ * Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+ *
+ * Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+ *
+ * All rights reserved.
+ *
+ * XMediaLib is licensed by Xirsys, with permission, under the Apache
+ * License Version 2.0. (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See LICENSE for the full license text.
+ *
+ * ---------------------------------------------------------------------- */
+
+
+#include <string.h>
+#include <stdint.h>
+#include "erl_nif.h"
+
+#if defined(__SSE2__)
+#define MIXER_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define MIXER_NEON 1
+#include <arm_neon.h>
+#endif
+
+/*
+ * Conference mixer. Every tick all the frames heard are summed once into a
+ * 32-bit accumulator, then each speaker gets the sum minus their own frame
+ * ("mix-minus"), saturated back to 16 bits. That's O(N) per tick instead of
+ * summing N-1 frames for each of N participants. Listeners who sent nothing
+ * all share the full mix.
+ *
+ * Frames are 16-bit native endian PCM, as XMediaLib.Codec decodes and
+ * encodes them.
+ */
+
+typedef struct {
+	ErlNifMutex* lock;
+	/* int16 samples per frame, all channels */
+	size_t samples;
+	int32_t* acc;
+} mixer;
+
+typedef struct {
+	ERL_NIF_TERM id;
+	const int16_t* pcm;
+} mixer_input;
+
+static ErlNifResourceType* mixer_type = NULL;
+
+static ERL_NIF_TERM atom_ok;
+
+static void mix_add(int32_t* acc, const int16_t* pcm, size_t n)
+{
+	size_t i = 0;
+
+#if defined(MIXER_SSE2)
+	for (; i + 8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(pcm + i));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		_mm_storeu_si128((__m128i*)(acc + i),
+				_mm_add_epi32(_mm_loadu_si128((const __m128i*)(acc + i)), lo));
+		_mm_storeu_si128((__m128i*)(acc + i + 4),
+				_mm_add_epi32(_mm_loadu_si128((const __m128i*)(acc + i + 4)), hi));
+	}
+#elif defined(MIXER_NEON)
+	for (; i + 8 <= n; i += 8) {
+		int16x8_t v = vld1q_s16(pcm + i);
+		vst1q_s32(acc + i, vaddw_s16(vld1q_s32(acc + i), vget_low_s16(v)));
+		vst1q_s32(acc + i + 4, vaddw_s16(vld1q_s32(acc + i + 4), vget_high_s16(v)));
+	}
+#endif
+	for (; i < n; i++)
+		acc[i] += pcm[i];
+}
+
+/* out = saturate(acc - own), own may be NULL for the full mix */
+static void mix_out(const int32_t* acc, const int16_t* own, int16_t* out, size_t n)
+{
+	size_t i = 0;
+	int32_t s;
+
+#if defined(MIXER_SSE2)
+	for (; i + 8 <= n; i += 8) {
+		__m128i lo = _mm_loadu_si128((const __m128i*)(acc + i));
+		__m128i hi = _mm_loadu_si128((const __m128i*)(acc + i + 4));
+		if (own) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(own + i));
+			lo = _mm_sub_epi32(lo, _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+			hi = _mm_sub_epi32(hi, _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+		}
+		_mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(lo, hi));
+	}
+#elif defined(MIXER_NEON)
+	for (; i + 8 <= n; i += 8) {
+		int32x4_t lo = vld1q_s32(acc + i);
+		int32x4_t hi = vld1q_s32(acc + i + 4);
+		if (own) {
+			int16x8_t v = vld1q_s16(own + i);
+			lo = vsubw_s16(lo, vget_low_s16(v));
+			hi = vsubw_s16(hi, vget_high_s16(v));
+		}
+		vst1q_s16(out + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+	}
+#endif
+	for (; i < n; i++) {
+		s = own ? acc[i] - own[i] : acc[i];
+		out[i] = s > INT16_MAX ? INT16_MAX : s < INT16_MIN ? INT16_MIN : (int16_t)s;
+	}
+}
+
+static void mixer_dtor(ErlNifEnv* env, void* obj)
+{
+	mixer* m = (mixer*)obj;
+
+	if (m->acc)
+		enif_free(m->acc);
+	if (m->lock)
+		enif_mutex_destroy(m->lock);
+}
+
+static ERL_NIF_TERM mixer_new(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	mixer* m;
+	ERL_NIF_TERM term;
+	int sample_rate, channels, ptime;
+
+	if (!enif_get_int(env, argv[0], &sample_rate) || sample_rate <= 0 ||
+			!enif_get_int(env, argv[1], &channels) || channels <= 0 ||
+			!enif_get_int(env, argv[2], &ptime) || ptime <= 0 ||
+			(long)sample_rate * channels * ptime / 1000 <= 0)
+		return enif_make_badarg(env);
+
+	m = (mixer*)enif_alloc_resource(mixer_type, sizeof(mixer));
+	memset(m, 0, sizeof(mixer));
+	m->samples = (size_t)sample_rate * channels * ptime / 1000;
+	m->acc = (int32_t*)enif_alloc(m->samples * sizeof(int32_t));
+	if (!m->acc || !(m->lock = enif_mutex_create((char*)"mixer"))) {
+		enif_release_resource(m);
+		return enif_make_badarg(env);
+	}
+
+	term = enif_make_resource(env, m);
+	enif_release_resource(m);
+
+	return enif_make_tuple2(env, atom_ok, term);
+}
+
+static ERL_NIF_TERM mixer_mix(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	mixer* m;
+	mixer_input* in;
+	ERL_NIF_TERM list, head, full, *outs;
+	const ERL_NIF_TERM* tuple;
+	ErlNifBinary bin;
+	unsigned int n, i;
+	int arity;
+
+	if (!enif_get_resource(env, argv[0], mixer_type, (void**)&m) ||
+			!enif_get_list_length(env, argv[1], &n))
+		return enif_make_badarg(env);
+
+	in = (mixer_input*)enif_alloc(n * sizeof(mixer_input) + 1);
+	outs = (ERL_NIF_TERM*)enif_alloc(n * sizeof(ERL_NIF_TERM) + 1);
+	if (!in || !outs) {
+		if (in)
+			enif_free(in);
+		if (outs)
+			enif_free(outs);
+		return enif_make_badarg(env);
+	}
+
+	list = argv[1];
+	for (i = 0; enif_get_list_cell(env, list, &head, &list); i++) {
+		if (!enif_get_tuple(env, head, &arity, &tuple) || arity != 2 ||
+				!enif_inspect_binary(env, tuple[1], &bin) ||
+				bin.size != m->samples * sizeof(int16_t)) {
+			enif_free(in);
+			enif_free(outs);
+			return enif_make_badarg(env);
+		}
+		in[i].id = tuple[0];
+		in[i].pcm = (const int16_t*)bin.data;
+	}
+
+	enif_mutex_lock(m->lock);
+	memset(m->acc, 0, m->samples * sizeof(int32_t));
+	for (i = 0; i < n; i++)
+		mix_add(m->acc, in[i].pcm, m->samples);
+
+	mix_out(m->acc, NULL, (int16_t*)enif_make_new_binary(env, m->samples * sizeof(int16_t), &full),
+			m->samples);
+	for (i = 0; i < n; i++) {
+		ERL_NIF_TERM pcm;
+		mix_out(m->acc, in[i].pcm,
+				(int16_t*)enif_make_new_binary(env, m->samples * sizeof(int16_t), &pcm), m->samples);
+		outs[i] = enif_make_tuple2(env, in[i].id, pcm);
+	}
+	enif_mutex_unlock(m->lock);
+
+	list = enif_make_list_from_array(env, outs, n);
+	enif_free(in);
+	enif_free(outs);
+
+	return enif_make_tuple3(env, atom_ok, full, list);
+}
+
+static int load(ErlNifEnv* env, void** priv_data, ERL_NIF_TERM load_info)
+{
+	mixer_type = enif_open_resource_type(env, NULL, "mixer",
+			mixer_dtor, ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, NULL);
+	if (!mixer_type)
+		return -1;
+
+	atom_ok = enif_make_atom(env, "ok");
+
+	return 0;
+}
+
+static int upgrade(ErlNifEnv* env, void** priv_data, void** old_priv_data, ERL_NIF_TERM load_info)
+{
+	return load(env, priv_data, load_info);
+}
+
+static ErlNifFunc mixer_nif_funcs[] =
+{
+	{"new", 3, mixer_new, 0},
+	{"mix", 2, mixer_mix, 0}
+};
+
+ERL_NIF_INIT(Elixir.XMediaLib.Mixer,mixer_nif_funcs,load,NULL,upgrade,NULL)
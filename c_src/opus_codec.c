@@ -28,141 +28,170 @@
  *
  * ---------------------------------------------------------------------- */
 
+
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
-#include "erl_driver.h"
+#include <stdlib.h>
 #include <opus.h>
+#include "codec.h"
 
 typedef struct {
 	OpusEncoder *encoder;
 	OpusDecoder *decoder;
 	int sampling_rate;
 	int number_of_channels;
-	ErlDrvPort port;
 } codec_data;
 
-enum {
-	CMD_SETUP = 0,
-	CMD_ENCODE = 1,
-	CMD_DECODE = 2
-};
+#define MAX_PACKET 1500
+/* 120 msec at 48 kHz is the longest frame Opus can carry */
+#define MAX_FRAME_SIZE (960*6)
 
-static ErlDrvData codec_drv_start(ErlDrvPort port, char *buff)
+static void opus_codec_destroy(void* state)
 {
-	codec_data* d = (codec_data*)driver_alloc(sizeof(codec_data));
-	d->encoder = NULL;
-	d->decoder = NULL;
-	d->sampling_rate = 0;
-	d->number_of_channels = 0;
+	codec_data *d = (codec_data *) state;
+	if (d->decoder)
+		opus_decoder_destroy(d->decoder);
+	if (d->encoder)
+		opus_encoder_destroy(d->encoder);
+	free(d);
+}
 
-	d->port = port;
-	set_port_control_flags(port, PORT_CONTROL_FLAG_BINARY);
+static void* opus_codec_init(int sample_rate, int channels)
+{
+	int err = 0;
+	codec_data* d = (codec_data*)malloc(sizeof(codec_data));
+	if (!d)
+		return NULL;
+
+	d->sampling_rate = sample_rate;
+	d->number_of_channels = channels;
+
+	d->encoder = opus_encoder_create(d->sampling_rate, d->number_of_channels, OPUS_APPLICATION_VOIP, &err);
+	d->decoder = opus_decoder_create(d->sampling_rate, d->number_of_channels, &err);
+	if (!d->encoder || !d->decoder) {
+		opus_codec_destroy(d);
+		return NULL;
+	}
 
-	return (ErlDrvData)d;
+	return d;
 }
 
-static void codec_drv_stop(ErlDrvData handle)
+/* Clears the stream history, the encoder settings stay as they are */
+static void opus_codec_reset(void* state)
 {
-	codec_data *d = (codec_data *) handle;
-	if (d->decoder)
-		opus_decoder_destroy(d->decoder);
-	if (d->encoder)
-		opus_encoder_destroy(d->encoder);
-	driver_free((char*)handle);
+	codec_data* d = (codec_data*)state;
+	opus_encoder_ctl(d->encoder, OPUS_RESET_STATE);
+	opus_decoder_ctl(d->decoder, OPUS_RESET_STATE);
 }
 
-static ErlDrvSSizeT codec_drv_control(
-		ErlDrvData handle,
-		unsigned int command,
-		char *buf, ErlDrvSizeT len,
-		char **rbuf, ErlDrvSizeT rlen)
+static int opus_codec_encode(void* state, const int16_t* pcm, size_t samples, uint8_t* out, size_t out_len)
 {
-#define MAX_PACKET 1500
-#define STEREO 2
+	codec_data* d = (codec_data*)state;
+	int ret;
 
-	codec_data* d = (codec_data*)handle;
+	if (samples % d->number_of_channels != 0)
+		return -1;
 
-	int ret = 0;
-	ErlDrvBinary *out;
-	*rbuf = NULL;
-	opus_int16 pcm[960*6*STEREO];
-	unsigned char opus[MAX_PACKET];
+	ret = opus_encode(d->encoder, pcm, samples / d->number_of_channels, out, out_len);
+	return ret < 0 ? -1 : ret;
+}
 
-	// required for the SETUP
-	int err = 0;
+static int opus_codec_decode(void* state, const uint8_t* in, size_t len, int16_t* pcm, size_t max_samples)
+{
+	codec_data* d = (codec_data*)state;
+	int ret;
 
-	switch(command) {
-		case CMD_ENCODE:
-			ret = opus_encode(d->encoder, (const opus_int16 *)buf, len >> 1, opus, MAX_PACKET);
-			out = driver_alloc_binary(ret);
-			memcpy(out->orig_bytes, opus, ret);
-			*rbuf = (char *) out;
-			break;
-		 case CMD_DECODE:
-			ret = d->number_of_channels * 2 * opus_decode(d->decoder, (const unsigned char *)buf, len, pcm, 960*6*STEREO, 0);
-			out = driver_alloc_binary(ret);
-			memcpy(out->orig_bytes, pcm, ret);
-			*rbuf = (char *) out;
-			break;
-		case CMD_SETUP:
-			d->sampling_rate = ((uint32_t*)buf)[0];
-			d->number_of_channels = ((uint32_t*)buf)[1];
-
-			/* come up with a way to specify these */
-//			int bitrate_bps = bits_per_second;
-//			int mode = MODE_HYBRID;
-//			int use_vbr = 1;
-//			int complexity = 10;
-//			int use_inbandfec = 1;
-//			int use_dtx = 1;
-//			int bandwidth = BANDWIDTH_FULLBAND;
-
-			if (!d->encoder && !d->decoder){
-				d->encoder = opus_encoder_create(d->sampling_rate, d->number_of_channels, OPUS_APPLICATION_VOIP, &err);
-				d->decoder = opus_decoder_create(d->sampling_rate, d->number_of_channels, &err);
-			}
-//			opus_encoder_ctl(d->encoder, OPUS_SET_MODE(mode));
-//			opus_encoder_ctl(d->encoder, OPUS_SET_BITRATE(bitrate_bps));
-//			opus_encoder_ctl(d->encoder, OPUS_SET_BANDWIDTH(bandwidth));
-//			opus_encoder_ctl(d->encoder, OPUS_SET_VBR_FLAG(use_vbr));
-//			opus_encoder_ctl(d->encoder, OPUS_SET_COMPLEXITY(complexity));
-//			opus_encoder_ctl(d->encoder, OPUS_SET_INBAND_FEC_FLAG(use_inbandfec));
-//			opus_encoder_ctl(d->encoder, OPUS_SET_DTX_FLAG(use_dtx));
-			break;
-		 default:
-			break;
+	ret = opus_decode(d->decoder, in, len, pcm, max_samples / d->number_of_channels, 0);
+	return ret < 0 ? -1 : ret * d->number_of_channels;
+}
+
+static size_t opus_max_encoded(void* state, size_t samples)
+{
+	return MAX_PACKET;
+}
+
+static size_t opus_max_decoded(void* state, size_t len)
+{
+	codec_data* d = (codec_data*)state;
+	return MAX_FRAME_SIZE * d->number_of_channels;
+}
+
+static int opus_bandwidth(int hz)
+{
+	switch (hz) {
+	case 4000: return OPUS_BANDWIDTH_NARROWBAND;
+	case 6000: return OPUS_BANDWIDTH_MEDIUMBAND;
+	case 8000: return OPUS_BANDWIDTH_WIDEBAND;
+	case 12000: return OPUS_BANDWIDTH_SUPERWIDEBAND;
+	case 20000: return OPUS_BANDWIDTH_FULLBAND;
 	}
-	return ret;
+	return -1;
 }
 
-ErlDrvEntry codec_driver_entry = {
-	NULL,			/* F_PTR init, N/A */
-	codec_drv_start,	/* L_PTR start, called when port is opened */
-	codec_drv_stop,		/* F_PTR stop, called when port is closed */
-	NULL,			/* F_PTR output, called when erlang has sent */
-	NULL,			/* F_PTR ready_input, called when input descriptor ready */
-	NULL,			/* F_PTR ready_output, called when output descriptor ready */
-	(char*) "opus_codec_drv",	/* char *driver_name, the argument to open_port */
-	NULL,			/* F_PTR finish, called when unloaded */
-	NULL,			/* handle */
-	codec_drv_control,	/* F_PTR control, port_command callback */
-	NULL,			/* F_PTR timeout, reserved */
-	NULL,			/* F_PTR outputv, reserved */
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	(int) ERL_DRV_EXTENDED_MARKER,
-	(int) ERL_DRV_EXTENDED_MAJOR_VERSION,
-	(int) ERL_DRV_EXTENDED_MINOR_VERSION,
-	0,
-	NULL,
-	NULL,
-	NULL
-};
+/*
+ * Encoder settings, all of which libopus allows to change between frames.
+ * The encoder starts with libopus defaults. bitrate 0 means OPUS_AUTO and
+ * max_bandwidth is the audio bandwidth in Hz (4000 - 20000).
+ */
+static int opus_codec_ctl(void* state, const char* option, int value)
+{
+	codec_data* d = (codec_data*)state;
+	int ret;
+
+	if (!strcmp(option, "bitrate"))
+		ret = opus_encoder_ctl(d->encoder, OPUS_SET_BITRATE(value ? value : OPUS_AUTO));
+	else if (!strcmp(option, "complexity"))
+		ret = opus_encoder_ctl(d->encoder, OPUS_SET_COMPLEXITY(value));
+	else if (!strcmp(option, "vbr"))
+		ret = opus_encoder_ctl(d->encoder, OPUS_SET_VBR(value));
+	else if (!strcmp(option, "fec"))
+		ret = opus_encoder_ctl(d->encoder, OPUS_SET_INBAND_FEC(value));
+	else if (!strcmp(option, "packet_loss"))
+		ret = opus_encoder_ctl(d->encoder, OPUS_SET_PACKET_LOSS_PERC(value));
+	else if (!strcmp(option, "dtx"))
+		ret = opus_encoder_ctl(d->encoder, OPUS_SET_DTX(value));
+	else if (!strcmp(option, "max_bandwidth") && opus_bandwidth(value) >= 0)
+		ret = opus_encoder_ctl(d->encoder, OPUS_SET_MAX_BANDWIDTH(opus_bandwidth(value)));
+	else
+		return -1;
+
+	return ret == OPUS_OK ? 0 : -1;
+}
 
-DRIVER_INIT(codec_drv) /* must match name in driver_entry */
+/*
+ * Concealment by libopus, or FEC when the packet after the loss is at hand
+ * and carries it (fec enabled on the far end). For FEC, samples has to be
+ * the duration of the lost packet.
+ */
+static int opus_codec_plc(void* state, const uint8_t* next, size_t next_len, int16_t* pcm, size_t samples)
 {
-	return &codec_driver_entry;
+	codec_data* d = (codec_data*)state;
+	int ret;
+
+	if (samples == 0 || samples % d->number_of_channels != 0)
+		return -1;
+
+	ret = opus_decode(d->decoder, next, next ? next_len : 0, pcm,
+			samples / d->number_of_channels, next != NULL);
+	return ret < 0 ? -1 : ret * d->number_of_channels;
 }
+
+const codec_ops opus_codec_ops = {
+	"opus",
+	opus_codec_init,
+	opus_codec_destroy,
+	opus_codec_encode,
+	opus_codec_decode,
+	opus_max_encoded,
+	opus_max_decoded,
+	opus_codec_reset,
+	opus_codec_ctl,
+	opus_codec_plc
+};
+
+#define CODEC_OPS opus_codec_ops
+#define CODEC_NIF_FLAGS ERL_NIF_DIRTY_JOB_CPU_BOUND
+#include "codec_nif.h"
+
+CODEC_NIF_INIT(Elixir.XMediaLib.Codec.OPUS)
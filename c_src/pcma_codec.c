@@ -28,101 +28,98 @@
  *
  * ---------------------------------------------------------------------- */
 
+
 /* Loosely based on Evgeniy Khramtsov's original approach - erlrtp */
 
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
-#include <erl_driver.h>
 #include <spandsp/telephony.h>
-#include <spandsp/bit_operations.h>
-#include <spandsp/g711.h>
+#include <spandsp/plc.h>
+#include "codec.h"
+#include "g711_lut.h"
 
-typedef struct {
-	ErlDrvPort port;
-} codec_data;
+/*
+ * The codec itself is stateless, the state is the loss concealment history
+ * (spandsp's PLC, after G.711 Appendix I). Decoded audio feeds it, so a
+ * lost packet can be filled from the last pitch period.
+ */
+static void* pcma_init(int sample_rate, int channels)
+{
+	return plc_init(NULL);
+}
 
-enum {
-	CMD_ENCODE = 1,
-	CMD_DECODE = 2
-};
+static void pcma_destroy(void* state)
+{
+	plc_free((plc_state_t*)state);
+}
+
+static void pcma_reset(void* state)
+{
+	plc_init((plc_state_t*)state);
+}
+
+static int pcma_encode(void* state, const int16_t* pcm, size_t samples, uint8_t* out, size_t out_len)
+{
+	g711_encode(g711_alaw_enc, pcm, out, samples);
+	return samples;
+}
+
+static int pcma_decode(void* state, const uint8_t* in, size_t len, int16_t* pcm, size_t max_samples)
+{
+	g711_decode(g711_alaw_dec, in, pcm, len);
+	plc_rx((plc_state_t*)state, pcm, len);
+	return len;
+}
 
-static ErlDrvData codec_drv_start(ErlDrvPort port, char *buff)
+static int pcma_plc(void* state, const uint8_t* next, size_t next_len, int16_t* pcm, size_t samples)
 {
-	codec_data* d = (codec_data*)driver_alloc(sizeof(codec_data));
-	d->port = port;
-	set_port_control_flags(port, PORT_CONTROL_FLAG_BINARY);
-	return (ErlDrvData)d;
+	return plc_fillin((plc_state_t*)state, pcm, samples);
 }
 
-static void codec_drv_stop(ErlDrvData handle)
+static size_t pcma_max_encoded(void* state, size_t samples)
 {
-	driver_free((char*)handle);
+	return samples;
 }
 
-static ErlDrvSSizeT codec_drv_control(
-		ErlDrvData handle,
-		unsigned int command,
-		char *buf, ErlDrvSizeT len,
-		char **rbuf, ErlDrvSizeT rlen)
+static size_t pcma_max_decoded(void* state, size_t len)
 {
-	int i;
-	int ret = 0;
-	ErlDrvBinary *out;
-	*rbuf = NULL;
-
-	switch(command) {
-		case CMD_ENCODE:
-			if (len % 2 != 0)
-				break;
-			out = driver_alloc_binary(len >> 1);
-
-			for (i = 0; i < (len >> 1); i++)
-				out->orig_bytes[i] = linear_to_alaw(((int16_t*)buf)[i]);
-			*rbuf = (char *) out;
-			ret = (len >> 1);
-			break;
-		 case CMD_DECODE:
-			out = driver_alloc_binary(len << 1);
-			for (i = 0; i < len; i++)
-				((int16_t*)out->orig_bytes)[i] = alaw_to_linear((unsigned char) buf[i]);
-			*rbuf = (char *) out;
-			ret = (len << 1);
-
-			break;
-		 default:
-			break;
-	}
-	return ret;
+	return len;
 }
 
-ErlDrvEntry codec_driver_entry = {
-	NULL,			/* F_PTR init, N/A */
-	codec_drv_start,	/* L_PTR start, called when port is opened */
-	codec_drv_stop,		/* F_PTR stop, called when port is closed */
-	NULL,			/* F_PTR output, called when erlang has sent */
-	NULL,			/* F_PTR ready_input, called when input descriptor ready */
-	NULL,			/* F_PTR ready_output, called when output descriptor ready */
-	(char*) "pcma_codec_drv",		/* char *driver_name, the argument to open_port */
-	NULL,			/* F_PTR finish, called when unloaded */
-	NULL,			/* handle */
-	codec_drv_control,	/* F_PTR control, port_command callback */
-	NULL,			/* F_PTR timeout, reserved */
-	NULL,			/* F_PTR outputv, reserved */
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	(int) ERL_DRV_EXTENDED_MARKER,
-	(int) ERL_DRV_EXTENDED_MAJOR_VERSION,
-	(int) ERL_DRV_EXTENDED_MINOR_VERSION,
-	0,
-	NULL,
-	NULL,
-	NULL
+const codec_ops pcma_codec_ops = {
+	"pcma",
+	pcma_init,
+	pcma_destroy,
+	pcma_encode,
+	pcma_decode,
+	pcma_max_encoded,
+	pcma_max_decoded,
+	pcma_reset,
+	NULL,			/* ctl */
+	pcma_plc
 };
 
-DRIVER_INIT(codec_drv) /* must match name in driver_entry */
+#ifndef CODEC_NO_NIF
+#include "erl_nif.h"
+
+/* Straight PCMA to PCMU, without going through linear PCM */
+static ERL_NIF_TERM pcma_to_pcmu(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
 {
-	return &codec_driver_entry;
+	ErlNifBinary in;
+	ERL_NIF_TERM out;
+
+	if (!enif_inspect_binary(env, argv[0], &in))
+		return enif_make_badarg(env);
+
+	g711_transcode(g711_alaw_to_ulaw, in.data, enif_make_new_binary(env, in.size, &out), in.size);
+	return out;
 }
+#endif
+
+#define CODEC_OPS pcma_codec_ops
+#define CODEC_NIF_LOAD g711_lut_init
+#define CODEC_NIF_EXTRA_FUNCS {"to_pcmu", 1, pcma_to_pcmu, 0}
+#include "codec_nif.h"
+
+CODEC_NIF_INIT(Elixir.XMediaLib.Codec.PCMA)
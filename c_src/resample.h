@@ -0,0 +1,264 @@
+/* ----------------------------------------------------------------------
+ *
+ * Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+ * for his excellent work in this area.
+ *
+ * @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+ *
+ * Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+ *
+ * Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+ *
+ * All rights reserved.
+ *
+ * XMediaLib is licensed by Xirsys, with permission, under the Apache
+ * License Version 2.0. (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See LICENSE for the full license text.
+ *
+ * ---------------------------------------------------------------------- */
+
+
+#ifndef __RESAMPLE_H__
+#define __RESAMPLE_H__
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <samplerate.h>
+
+/*
+ * Streaming resampler on top of libsamplerate, shared by resampler_nif.c and
+ * transcoder_nif.c. The SRC_STATE lives as long as the resample_state, so
+ * the filter history carries over frame boundaries and there is no warm-up
+ * cost (and no click) at the start of each 20 ms frame. The float buffers
+ * belong to it as well and only ever grow.
+ *
+ * libsamplerate can't change the channel count, so mono <-> stereo is done
+ * here: stereo input is downmixed before resampling, mono output is
+ * duplicated after.
+ *
+ * resample_run() converts a frame into the internal buffer and returns the
+ * number of frames produced, resample_output() then writes them out as
+ * 16-bit PCM, so callers can size the destination first.
+ *
+ * Every call produces as many frames as the input so far is worth at the
+ * output rate, so a 20 ms frame in is a 20 ms frame out and fixed frame
+ * encoders (GSM, G.729, iLBC, Opus) can take it as is. The filter delay the
+ * converter holds back at the start of a stream is filled with silence,
+ * plus RESAMPLE_SLACK frames, and whatever it produces beyond the count is
+ * kept for the next call. The slack covers the frame or so by which the
+ * converter's output wobbles later on. Should it ever run short mid-stream,
+ * the call returns fewer frames and the next one makes up for it, rather
+ * than silence being inserted into the audio.
+ */
+
+/* output frames of silence buffered on top of the filter delay */
+#define RESAMPLE_SLACK 4
+
+typedef struct {
+	SRC_STATE* src;
+	int to_samplerate;
+	int to_channels;
+	/* input format the current SRC_STATE was set up for */
+	int from_samplerate;
+	int from_channels;
+	/* channels going through the converter */
+	int channels;
+	float* in;
+	size_t in_size;
+	float* out;
+	size_t out_size;
+	/* frames at the start of out kept back by the last call, and how many it returned */
+	size_t pending;
+	size_t emitted;
+	/* input and output frames since the converter was set up or reset */
+	uint64_t frames_in;
+	uint64_t frames_out;
+	/* the converter has put out something, padding is over */
+	int primed;
+} resample_state;
+
+static int resample_is_supported_channels(int channels)
+{
+	return channels == 1 || channels == 2;
+}
+
+static int resample_ensure(float** buf, size_t* size, size_t wanted)
+{
+	float* tmp;
+
+	if (wanted <= *size)
+		return 1;
+	tmp = (float*)realloc(*buf, wanted * sizeof(float));
+	if (!tmp)
+		return 0;
+	*buf = tmp;
+	*size = wanted;
+	return 1;
+}
+
+static void resample_init(resample_state* r, int to_samplerate, int to_channels)
+{
+	memset(r, 0, sizeof(resample_state));
+	r->to_samplerate = to_samplerate;
+	r->to_channels = to_channels;
+}
+
+static void resample_free(resample_state* r)
+{
+	if (r->src)
+		src_delete(r->src);
+	free(r->in);
+	free(r->out);
+	memset(r, 0, sizeof(resample_state));
+}
+
+static void resample_restart(resample_state* r)
+{
+	r->pending = 0;
+	r->emitted = 0;
+	r->frames_in = 0;
+	r->frames_out = 0;
+	r->primed = 0;
+}
+
+static void resample_reset(resample_state* r)
+{
+	if (r->src)
+		src_reset(r->src);
+	resample_restart(r);
+}
+
+/* (Re)create the converter if the input format differs from the last call */
+static int resample_setup(resample_state* r, int from_samplerate, int from_channels)
+{
+	int error = 0;
+
+	if (r->src && r->from_samplerate == from_samplerate && r->from_channels == from_channels)
+		return 1;
+
+	if (r->src)
+		r->src = src_delete(r->src);
+
+	/* downmix happens before the converter, upmix after */
+	r->channels = from_channels < r->to_channels ? from_channels : r->to_channels;
+	r->src = src_new(SRC_SINC_FASTEST, r->channels, &error);
+	if (!r->src)
+		return 0;
+
+	r->from_samplerate = from_samplerate;
+	r->from_channels = from_channels;
+	resample_restart(r);
+	return 1;
+}
+
+/* samples counts all channels. Returns output frames, or -1 */
+static long resample_run(resample_state* r, const int16_t* pcm, size_t samples, int from_samplerate, int from_channels)
+{
+	SRC_DATA data;
+	size_t frames, out_frames, done, wanted, i;
+	int channels;
+
+	if (!resample_setup(r, from_samplerate, from_channels))
+		return -1;
+
+	channels = r->channels;
+	frames = samples / from_channels;
+
+	/* drop what the last call returned, keep what it held over */
+	if (r->emitted && r->pending)
+		memmove(r->out, r->out + r->emitted * channels, r->pending * channels * sizeof(float));
+	r->emitted = 0;
+
+	if (!resample_ensure(&r->in, &r->in_size, frames * from_channels))
+		return -1;
+	src_short_to_float_array((const short*)pcm, r->in, frames * from_channels);
+
+	if (from_channels > channels)
+		for (i = 0; i < frames; i++)
+			r->in[i] = (r->in[2 * i] + r->in[2 * i + 1]) * 0.5f;
+
+	r->frames_in += frames;
+	wanted = (size_t)(r->frames_in * r->to_samplerate / from_samplerate - r->frames_out);
+
+	/* a little headroom, the converter may flush a few frames it held back */
+	out_frames = r->pending + wanted + 64;
+	if (!resample_ensure(&r->out, &r->out_size, out_frames * r->to_channels))
+		return -1;
+
+	data.data_in = r->in;
+	data.input_frames = frames;
+	data.end_of_input = 0;
+	data.src_ratio = (double)r->to_samplerate / (double)from_samplerate;
+	done = r->pending;
+
+	while (data.input_frames > 0) {
+		data.data_out = r->out + done * channels;
+		data.output_frames = out_frames - done;
+		if (src_process(r->src, &data) != 0)
+			return -1;
+
+		done += data.output_frames_gen;
+		data.data_in += data.input_frames_used * channels;
+		data.input_frames -= data.input_frames_used;
+
+		if (data.input_frames == 0)
+			break;
+		if (data.input_frames_used == 0 && data.output_frames_gen == 0)
+			break;
+		if (done == out_frames) {
+			out_frames += out_frames / 2;
+			if (!resample_ensure(&r->out, &r->out_size, out_frames * r->to_channels))
+				return -1;
+		}
+	}
+
+	/* the filter delay at the start, nothing real has gone out yet: pad in front */
+	if (!r->primed) {
+		if (done > r->pending)
+			r->primed = 1;
+		if (done < wanted + RESAMPLE_SLACK) {
+			size_t pad = wanted + RESAMPLE_SLACK - done;
+			memmove(r->out + pad * channels, r->out, done * channels * sizeof(float));
+			memset(r->out, 0, pad * channels * sizeof(float));
+			done += pad;
+		}
+	}
+
+	/* short later on, the next call makes up for it */
+	if (done < wanted)
+		wanted = done;
+
+	r->pending = done - wanted;
+	r->emitted = wanted;
+	r->frames_out += wanted;
+
+	return wanted;
+}
+
+/* Writes the frames from the last resample_run(), frames * to_channels samples */
+static void resample_output(resample_state* r, size_t frames, int16_t* out)
+{
+	size_t i;
+
+	src_float_to_short_array(r->out, out, frames * r->channels);
+
+	if (r->to_channels > r->channels)
+		for (i = frames; i-- > 0; ) {
+			out[2 * i] = out[i];
+			out[2 * i + 1] = out[i];
+		}
+}
+
+#endif /* __RESAMPLE_H__ */
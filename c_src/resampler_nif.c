@@ -0,0 +1,166 @@
+/* ----------------------------------------------------------------------
+ *
+ * Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+ * for his excellent work in this area.
+ *
+ * @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+ *
+ * Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+ *
+ * Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+ *
+ * All rights reserved.
+ *
+ * XMediaLib is licensed by Xirsys, with permission, under the Apache
+ * License Version 2.0. (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See LICENSE for the full license text.
+ *
+ * ---------------------------------------------------------------------- */
+
+#include <string.h>
+#include <stdint.h>
+#include "erl_nif.h"
+#include "resample.h"
+
+/*
+ * Streaming resampler as a NIF resource, see resample.h for how the
+ * conversion itself works.
+ */
+
+typedef struct {
+	ErlNifMutex* lock;
+	resample_state rs;
+} resampler;
+
+static ErlNifResourceType* resampler_type = NULL;
+
+static ERL_NIF_TERM atom_ok;
+static ERL_NIF_TERM atom_error;
+static ERL_NIF_TERM atom_unsupported;
+static ERL_NIF_TERM atom_resampler_error;
+
+static void resampler_dtor(ErlNifEnv* env, void* obj)
+{
+	resampler* r = (resampler*)obj;
+
+	resample_free(&r->rs);
+	if (r->lock)
+		enif_mutex_destroy(r->lock);
+}
+
+static ERL_NIF_TERM resampler_new(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	int to_samplerate, to_channels;
+	resampler* r;
+	ERL_NIF_TERM term;
+
+	if (!enif_get_int(env, argv[0], &to_samplerate) || !enif_get_int(env, argv[1], &to_channels))
+		return enif_make_badarg(env);
+
+	if (to_samplerate <= 0 || !resample_is_supported_channels(to_channels))
+		return enif_make_tuple2(env, atom_error, atom_unsupported);
+
+	r = (resampler*)enif_alloc_resource(resampler_type, sizeof(resampler));
+	resample_init(&r->rs, to_samplerate, to_channels);
+	if (!(r->lock = enif_mutex_create((char*)"resampler"))) {
+		enif_release_resource(r);
+		return enif_make_tuple2(env, atom_error, atom_resampler_error);
+	}
+
+	term = enif_make_resource(env, r);
+	enif_release_resource(r);
+
+	return enif_make_tuple2(env, atom_ok, term);
+}
+
+static ERL_NIF_TERM do_process(ErlNifEnv* env, resampler* r, ErlNifBinary* pcm, int from_samplerate, int from_channels)
+{
+	ERL_NIF_TERM result;
+	long frames;
+
+	frames = resample_run(&r->rs, (const int16_t*)pcm->data, pcm->size / 2, from_samplerate, from_channels);
+	if (frames < 0)
+		return enif_make_tuple2(env, atom_error, atom_resampler_error);
+
+	resample_output(&r->rs, frames,
+			(int16_t*)enif_make_new_binary(env, frames * r->rs.to_channels * 2, &result));
+
+	return enif_make_tuple2(env, atom_ok, result);
+}
+
+static ERL_NIF_TERM resampler_process(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	resampler* r;
+	ErlNifBinary pcm;
+	int from_samplerate, from_channels;
+	ERL_NIF_TERM ret;
+
+	if (!enif_get_resource(env, argv[0], resampler_type, (void**)&r) ||
+			!enif_inspect_binary(env, argv[1], &pcm) ||
+			!enif_get_int(env, argv[2], &from_samplerate) ||
+			!enif_get_int(env, argv[3], &from_channels))
+		return enif_make_badarg(env);
+
+	if (from_samplerate <= 0 || !resample_is_supported_channels(from_channels))
+		return enif_make_tuple2(env, atom_error, atom_unsupported);
+
+	enif_mutex_lock(r->lock);
+	ret = do_process(env, r, &pcm, from_samplerate, from_channels);
+	enif_mutex_unlock(r->lock);
+
+	return ret;
+}
+
+static ERL_NIF_TERM resampler_reset(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	resampler* r;
+
+	if (!enif_get_resource(env, argv[0], resampler_type, (void**)&r))
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(r->lock);
+	resample_reset(&r->rs);
+	enif_mutex_unlock(r->lock);
+
+	return atom_ok;
+}
+
+static int load(ErlNifEnv* env, void** priv_data, ERL_NIF_TERM load_info)
+{
+	resampler_type = enif_open_resource_type(env, NULL, "resampler",
+			resampler_dtor, ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, NULL);
+	if (!resampler_type)
+		return -1;
+
+	atom_ok = enif_make_atom(env, "ok");
+	atom_error = enif_make_atom(env, "error");
+	atom_unsupported = enif_make_atom(env, "unsupported");
+	atom_resampler_error = enif_make_atom(env, "resampler_error");
+
+	return 0;
+}
+
+static int upgrade(ErlNifEnv* env, void** priv_data, void** old_priv_data, ERL_NIF_TERM load_info)
+{
+	return load(env, priv_data, load_info);
+}
+
+static ErlNifFunc resampler_nif_funcs[] =
+{
+	{"new", 2, resampler_new, 0},
+	{"process", 4, resampler_process, 0},
+	{"reset", 1, resampler_reset, 0}
+};
+
+ERL_NIF_INIT(Elixir.XMediaLib.Resampler,resampler_nif_funcs,load,NULL,upgrade,NULL)
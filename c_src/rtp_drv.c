@@ -0,0 +1,689 @@
+/* ----------------------------------------------------------------------
+ *
+ * Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+ * for his excellent work in this area.
+ *
+ * @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+ *
+ * Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+ *
+ * Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+ *
+ * All rights reserved.
+ *
+ * XMediaLib is licensed by Xirsys, with permission, under the Apache
+ * License Version 2.0. (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See LICENSE for the full license text.
+ *
+ * ---------------------------------------------------------------------- */
+
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "erl_driver.h"
+
+/*
+ * RTP/RTCP socket pair driven by GenRtpChannel. The driver owns two adjacent
+ * UDP sockets (RTP on the even port, RTCP on the next one) and talks to the
+ * owning process with messages rather than through gen_udp:
+ *
+ *   {rtp, Port, Ip, IpPort, Packet}     - RTP (or muxed RTCP) from the peer
+ *   {rtcp, Port, Ip, IpPort, Packet}    - RTCP
+ *   {peer, PosixFd, Ip, IpPort}         - remote address learned/changed
+ *   {timeout, Port}                     - nothing received for a while
+ *
+ * Readable sockets are drained with recvmmsg() in batches of RTP_BATCH. Once
+ * another channel's socket has been attached with RTP_SET_FD, media is
+ * relayed to it straight from the receive buffers with one sendmmsg() per
+ * batch and never reaches the VM. RTCP and DTMF events are still passed up.
+ *
+ * Control commands:
+ *
+ *   1 RTP_BIND      <<Port:16, Family:8, Addr/binary, Early:32, Main:32>>
+ *   2 RTP_GET_PORTS -> <<Addr/binary, RtpPort:16, RtcpPort:16>>
+ *   4 RTP_SET_FD    <<PosixFd:32, Port:16, Family:8, Addr/binary>>, or <<>>
+ *   5 RTP_GET_STATS -> <<Ssrc:32, Type:8, RxBytes:32, RxPackets:32,
+ *                        TxBytes:32, TxPackets:32, TxBytes2:32, TxPackets2:32>>
+ *   6 RTP_SET_DTMF  <<PayloadType:8>>
+ *
+ * Family is 4 or 6, timeouts are in milliseconds (0 disables the timer).
+ */
+
+#define RTP_BIND 1
+#define RTP_GET_PORTS 2
+#define RTP_SET_FD 4
+#define RTP_GET_STATS 5
+#define RTP_SET_DTMF 6
+
+#define RTP_BATCH 32
+#define RTP_MTU 1500
+/* recvmmsg() rounds per ready_input, so one busy socket can't hog a scheduler */
+#define RTP_MAX_ROUNDS 4
+#define RTP_BIND_ATTEMPTS 64
+
+#if defined(__linux__)
+#define rtp_mmsghdr mmsghdr
+#define rtp_recvmmsg recvmmsg
+#define rtp_sendmmsg sendmmsg
+#else
+/*
+ * recvmmsg/sendmmsg are only relied on under Linux - elsewhere fall back to
+ * one syscall per packet behind the same interface. The names are our own,
+ * so systems that do declare them (the BSDs) don't clash with it.
+ */
+struct rtp_mmsghdr {
+	struct msghdr msg_hdr;
+	unsigned int msg_len;
+};
+
+static int rtp_recvmmsg(int fd, struct rtp_mmsghdr* msgs, unsigned int n, int flags, void* timeout)
+{
+	unsigned int i;
+	ssize_t ret;
+
+	for (i = 0; i < n; i++) {
+		if ((ret = recvmsg(fd, &msgs[i].msg_hdr, flags)) < 0)
+			return i ? (int)i : -1;
+		msgs[i].msg_len = ret;
+	}
+	return n;
+}
+
+static int rtp_sendmmsg(int fd, struct rtp_mmsghdr* msgs, unsigned int n, int flags)
+{
+	unsigned int i;
+	ssize_t ret;
+
+	for (i = 0; i < n; i++) {
+		if ((ret = sendmsg(fd, &msgs[i].msg_hdr, flags)) < 0)
+			return i ? (int)i : -1;
+		msgs[i].msg_len = ret;
+	}
+	return n;
+}
+#endif
+
+typedef struct {
+	ErlDrvPort port;
+	ErlDrvTermData port_term;
+
+	int family;
+	int rtp_fd;
+	int rtcp_fd;
+	struct sockaddr_storage local;
+	uint16_t rtp_port;
+	uint16_t rtcp_port;
+
+	/* remote side, latched from the incoming traffic */
+	struct sockaddr_storage peer_rtp;
+	struct sockaddr_storage peer_rtcp;
+	int has_peer_rtp;
+	int has_peer_rtcp;
+
+	/* another channel's socket and peer to relay media to (RTP_SET_FD) */
+	int other_fd;
+	struct sockaddr_storage other_peer;
+
+	int dtmf;
+	uint32_t ssrc;
+	uint8_t type;
+	uint32_t rx_bytes;
+	uint32_t rx_packets;
+	uint32_t tx_bytes;
+	uint32_t tx_packets;
+	uint32_t tx_bytes2;
+	uint32_t tx_packets2;
+
+	unsigned long timeout_early;
+	unsigned long timeout_main;
+	int received;
+
+	struct rtp_mmsghdr rx[RTP_BATCH];
+	struct iovec rx_iov[RTP_BATCH];
+	struct sockaddr_storage rx_addr[RTP_BATCH];
+	struct rtp_mmsghdr tx[RTP_BATCH];
+	struct iovec tx_iov[RTP_BATCH];
+	uint8_t buf[RTP_BATCH][RTP_MTU];
+} rtp_data;
+
+static ErlDrvTermData atom_rtp;
+static ErlDrvTermData atom_rtcp;
+static ErlDrvTermData atom_peer;
+static ErlDrvTermData atom_timeout;
+
+static socklen_t sockaddr_len(int family)
+{
+	return family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+}
+
+static uint16_t sockaddr_port(const struct sockaddr_storage* ss)
+{
+	if (ss->ss_family == AF_INET6)
+		return ntohs(((const struct sockaddr_in6*)ss)->sin6_port);
+	return ntohs(((const struct sockaddr_in*)ss)->sin_port);
+}
+
+static void sockaddr_set_port(struct sockaddr_storage* ss, uint16_t port)
+{
+	if (ss->ss_family == AF_INET6)
+		((struct sockaddr_in6*)ss)->sin6_port = htons(port);
+	else
+		((struct sockaddr_in*)ss)->sin_port = htons(port);
+}
+
+static int sockaddr_equal(const struct sockaddr_storage* a, const struct sockaddr_storage* b)
+{
+	if (a->ss_family != b->ss_family)
+		return 0;
+	if (a->ss_family == AF_INET6) {
+		const struct sockaddr_in6* a6 = (const struct sockaddr_in6*)a;
+		const struct sockaddr_in6* b6 = (const struct sockaddr_in6*)b;
+		return a6->sin6_port == b6->sin6_port &&
+			!memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr));
+	}
+	return ((const struct sockaddr_in*)a)->sin_port == ((const struct sockaddr_in*)b)->sin_port &&
+		((const struct sockaddr_in*)a)->sin_addr.s_addr == ((const struct sockaddr_in*)b)->sin_addr.s_addr;
+}
+
+/* <<Family:8, Addr/binary>> as sent by GenRtpChannel, returns bytes consumed */
+static int parse_addr(const uint8_t* buf, ErlDrvSizeT len, uint16_t port, struct sockaddr_storage* ss)
+{
+	memset(ss, 0, sizeof(*ss));
+
+	if (len >= 5 && buf[0] == 4) {
+		struct sockaddr_in* sin = (struct sockaddr_in*)ss;
+		sin->sin_family = AF_INET;
+		sin->sin_port = htons(port);
+		memcpy(&sin->sin_addr, buf + 1, 4);
+		return 5;
+	}
+	if (len >= 17 && buf[0] == 6) {
+		struct sockaddr_in6* sin6 = (struct sockaddr_in6*)ss;
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_port = htons(port);
+		memcpy(&sin6->sin6_addr, buf + 1, 16);
+		return 17;
+	}
+	return -1;
+}
+
+/* Appends the {A,B,C,D} / {A,B,C,D,E,F,G,H} tuple for ss to spec */
+static int put_addr(ErlDrvTermData* spec, int i, const struct sockaddr_storage* ss)
+{
+	int j;
+
+	if (ss->ss_family == AF_INET6) {
+		const uint8_t* a = ((const struct sockaddr_in6*)ss)->sin6_addr.s6_addr;
+		for (j = 0; j < 8; j++) {
+			spec[i++] = ERL_DRV_UINT;
+			spec[i++] = (a[2 * j] << 8) | a[2 * j + 1];
+		}
+		spec[i++] = ERL_DRV_TUPLE;
+		spec[i++] = 8;
+	} else {
+		const uint8_t* a = (const uint8_t*)&((const struct sockaddr_in*)ss)->sin_addr;
+		for (j = 0; j < 4; j++) {
+			spec[i++] = ERL_DRV_UINT;
+			spec[i++] = a[j];
+		}
+		spec[i++] = ERL_DRV_TUPLE;
+		spec[i++] = 4;
+	}
+	return i;
+}
+
+static void send_packet(rtp_data* d, ErlDrvTermData tag, const struct sockaddr_storage* from,
+		const uint8_t* buf, size_t len)
+{
+	ErlDrvTermData spec[32];
+	int i = 0;
+
+	spec[i++] = ERL_DRV_ATOM;
+	spec[i++] = tag;
+	spec[i++] = ERL_DRV_PORT;
+	spec[i++] = d->port_term;
+	i = put_addr(spec, i, from);
+	spec[i++] = ERL_DRV_UINT;
+	spec[i++] = sockaddr_port(from);
+	spec[i++] = ERL_DRV_BUF2BINARY;
+	spec[i++] = (ErlDrvTermData)buf;
+	spec[i++] = len;
+	spec[i++] = ERL_DRV_TUPLE;
+	spec[i++] = 5;
+
+	erl_drv_output_term(d->port_term, spec, i);
+}
+
+static void send_peer(rtp_data* d)
+{
+	ErlDrvTermData spec[32];
+	int i = 0;
+
+	spec[i++] = ERL_DRV_ATOM;
+	spec[i++] = atom_peer;
+	spec[i++] = ERL_DRV_INT;
+	spec[i++] = d->rtp_fd;
+	i = put_addr(spec, i, &d->peer_rtp);
+	spec[i++] = ERL_DRV_UINT;
+	spec[i++] = sockaddr_port(&d->peer_rtp);
+	spec[i++] = ERL_DRV_TUPLE;
+	spec[i++] = 4;
+
+	erl_drv_output_term(d->port_term, spec, i);
+}
+
+static int open_socket(int family, const struct sockaddr_storage* addr)
+{
+	int fd = socket(family, SOCK_DGRAM, 0);
+	int flags;
+
+	if (fd < 0)
+		return -1;
+
+	if ((flags = fcntl(fd, F_GETFL, 0)) < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+			fcntl(fd, F_SETFD, FD_CLOEXEC) < 0 ||
+			bind(fd, (const struct sockaddr*)addr, sockaddr_len(family)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * Binds RTP to an even port and RTCP to the one right after it. With no port
+ * given we let the kernel pick and retry until we get an even one whose
+ * neighbour is free.
+ */
+static int bind_pair(rtp_data* d, uint16_t port)
+{
+	struct sockaddr_storage addr = d->local;
+	socklen_t len;
+	int attempt;
+
+	for (attempt = 0; attempt < RTP_BIND_ATTEMPTS; attempt++) {
+		sockaddr_set_port(&addr, port);
+		if ((d->rtp_fd = open_socket(d->family, &addr)) < 0)
+			return -1;
+
+		len = sizeof(addr);
+		getsockname(d->rtp_fd, (struct sockaddr*)&addr, &len);
+		d->rtp_port = sockaddr_port(&addr);
+
+		if (port || (d->rtp_port % 2 == 0 && d->rtp_port < 65535)) {
+			sockaddr_set_port(&addr, d->rtp_port + 1);
+			if ((d->rtcp_fd = open_socket(d->family, &addr)) >= 0) {
+				d->rtcp_port = d->rtp_port + 1;
+				return 0;
+			}
+			if (port)
+				break;
+		}
+
+		close(d->rtp_fd);
+		d->rtp_fd = -1;
+	}
+
+	if (d->rtp_fd >= 0) {
+		close(d->rtp_fd);
+		d->rtp_fd = -1;
+	}
+	return -1;
+}
+
+static ErlDrvData rtp_drv_start(ErlDrvPort port, char* command)
+{
+	rtp_data* d = (rtp_data*)driver_alloc(sizeof(rtp_data));
+	int i;
+
+	memset(d, 0, sizeof(rtp_data));
+	d->port = port;
+	d->port_term = driver_mk_port(port);
+	d->rtp_fd = -1;
+	d->rtcp_fd = -1;
+	d->other_fd = -1;
+	d->dtmf = -1;
+
+	for (i = 0; i < RTP_BATCH; i++) {
+		d->rx_iov[i].iov_base = d->buf[i];
+		d->rx_iov[i].iov_len = RTP_MTU;
+		d->rx[i].msg_hdr.msg_iov = &d->rx_iov[i];
+		d->rx[i].msg_hdr.msg_iovlen = 1;
+		d->rx[i].msg_hdr.msg_name = &d->rx_addr[i];
+
+		d->tx[i].msg_hdr.msg_iov = &d->tx_iov[i];
+		d->tx[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	set_port_control_flags(port, PORT_CONTROL_FLAG_BINARY);
+
+	return (ErlDrvData)d;
+}
+
+static void rtp_drv_stop(ErlDrvData handle)
+{
+	rtp_data* d = (rtp_data*)handle;
+
+	driver_cancel_timer(d->port);
+
+	/* the sockets are closed in stop_select once the VM is done with them */
+	if (d->rtp_fd >= 0)
+		driver_select(d->port, (ErlDrvEvent)(intptr_t)d->rtp_fd, ERL_DRV_USE, 0);
+	if (d->rtcp_fd >= 0)
+		driver_select(d->port, (ErlDrvEvent)(intptr_t)d->rtcp_fd, ERL_DRV_USE, 0);
+
+	driver_free(d);
+}
+
+static void rtp_drv_stop_select(ErlDrvEvent event, void* reserved)
+{
+	close((int)(intptr_t)event);
+}
+
+static int is_rtcp(const uint8_t* buf, size_t len)
+{
+	/* RFC 5761 - RTCP packet types 192-223 never clash with RTP payload types */
+	return len >= 8 && (buf[0] >> 6) == 2 && buf[1] >= 192 && buf[1] <= 223;
+}
+
+/*
+ * Relays the first n entries of d->tx to the attached socket. Whatever does
+ * not fit into the socket buffer is dropped, as it would be on the wire.
+ */
+static void relay(rtp_data* d, int n)
+{
+	int sent = 0, ret, i;
+
+	while (sent < n) {
+		ret = rtp_sendmmsg(d->other_fd, d->tx + sent, n - sent, MSG_DONTWAIT);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			/* the other channel went away */
+			if (errno == EBADF || errno == ENOTSOCK)
+				d->other_fd = -1;
+			break;
+		}
+		for (i = sent; i < sent + ret; i++) {
+			d->tx_bytes2 += d->tx[i].msg_len;
+			d->tx_packets2++;
+		}
+		sent += ret;
+	}
+}
+
+static void receive(rtp_data* d, int fd)
+{
+	ErlDrvTermData tag = fd == d->rtp_fd ? atom_rtp : atom_rtcp;
+	int round, n, i, relayed;
+
+	d->received = 1;
+
+	for (round = 0; round < RTP_MAX_ROUNDS; round++) {
+		for (i = 0; i < RTP_BATCH; i++)
+			d->rx[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+
+		n = rtp_recvmmsg(fd, d->rx, RTP_BATCH, MSG_DONTWAIT, NULL);
+		if (n <= 0)
+			return;
+
+		relayed = 0;
+		for (i = 0; i < n; i++) {
+			const uint8_t* buf = d->buf[i];
+			size_t len = d->rx[i].msg_len;
+			struct sockaddr_storage* from = &d->rx_addr[i];
+
+			if (d->rx[i].msg_hdr.msg_flags & MSG_TRUNC)
+				continue;
+
+			d->rx_bytes += len;
+			d->rx_packets++;
+
+			if (fd == d->rtcp_fd) {
+				if (!d->has_peer_rtcp || !sockaddr_equal(&d->peer_rtcp, from)) {
+					d->peer_rtcp = *from;
+					d->has_peer_rtcp = 1;
+				}
+				send_packet(d, atom_rtcp, from, buf, len);
+				continue;
+			}
+
+			if (!d->has_peer_rtp || !sockaddr_equal(&d->peer_rtp, from)) {
+				d->peer_rtp = *from;
+				d->has_peer_rtp = 1;
+				send_peer(d);
+			}
+
+			if (is_rtcp(buf, len)) {
+				send_packet(d, atom_rtcp, from, buf, len);
+				continue;
+			}
+
+			if (len >= 12) {
+				d->type = buf[1] & 0x7f;
+				d->ssrc = ((uint32_t)buf[8] << 24) | (buf[9] << 16) | (buf[10] << 8) | buf[11];
+			}
+
+			/* relay plain media, DTMF events go up for the application to see */
+			if (d->other_fd >= 0 && len >= 12 && d->type != d->dtmf) {
+				d->tx_iov[relayed].iov_base = (void*)buf;
+				d->tx_iov[relayed].iov_len = len;
+				d->tx[relayed].msg_hdr.msg_name = &d->other_peer;
+				d->tx[relayed].msg_hdr.msg_namelen = sockaddr_len(d->other_peer.ss_family);
+				relayed++;
+				continue;
+			}
+
+			send_packet(d, tag, from, buf, len);
+		}
+
+		if (relayed)
+			relay(d, relayed);
+
+		if (n < RTP_BATCH)
+			return;
+	}
+}
+
+static void rtp_drv_ready_input(ErlDrvData handle, ErlDrvEvent event)
+{
+	receive((rtp_data*)handle, (int)(intptr_t)event);
+}
+
+/* Packets from the owner, sent to whatever peer we've latched on to */
+static void rtp_drv_output(ErlDrvData handle, char* buf, ErlDrvSizeT len)
+{
+	rtp_data* d = (rtp_data*)handle;
+	const struct sockaddr_storage* to = &d->peer_rtp;
+	int fd = d->rtp_fd;
+	ssize_t ret;
+
+	if (is_rtcp((const uint8_t*)buf, len) && d->has_peer_rtcp) {
+		to = &d->peer_rtcp;
+		fd = d->rtcp_fd;
+	} else if (!d->has_peer_rtp)
+		return;
+
+	do {
+		ret = sendto(fd, buf, len, MSG_DONTWAIT, (const struct sockaddr*)to, sockaddr_len(to->ss_family));
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret > 0) {
+		d->tx_bytes += ret;
+		d->tx_packets++;
+	}
+}
+
+static void rtp_drv_timeout(ErlDrvData handle)
+{
+	rtp_data* d = (rtp_data*)handle;
+	ErlDrvTermData spec[] = {
+		ERL_DRV_ATOM, atom_timeout,
+		ERL_DRV_PORT, d->port_term,
+		ERL_DRV_TUPLE, 2
+	};
+
+	if (!d->received)
+		erl_drv_output_term(d->port_term, spec, sizeof(spec) / sizeof(spec[0]));
+
+	d->received = 0;
+	if (d->timeout_main)
+		driver_set_timer(d->port, d->timeout_main);
+}
+
+static uint32_t get_uint32(const uint8_t* p)
+{
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static char* put_uint32(char* p, uint32_t v)
+{
+	*p++ = v >> 24;
+	*p++ = v >> 16;
+	*p++ = v >> 8;
+	*p++ = v;
+	return p;
+}
+
+static ErlDrvSSizeT reply(char** rbuf, ErlDrvSizeT rlen, const char* buf, ErlDrvSizeT len)
+{
+	ErlDrvBinary* bin = driver_alloc_binary(len);
+
+	if (!bin)
+		return -1;
+	memcpy(bin->orig_bytes, buf, len);
+	*rbuf = (char*)bin;
+	return len;
+}
+
+static ErlDrvSSizeT rtp_drv_control(ErlDrvData handle, unsigned int command,
+		char* buf, ErlDrvSizeT len, char** rbuf, ErlDrvSizeT rlen)
+{
+	rtp_data* d = (rtp_data*)handle;
+	const uint8_t* in = (const uint8_t*)buf;
+	struct sockaddr_storage addr;
+	char out[64], *p = out;
+	uint16_t port;
+	int n;
+
+	switch (command) {
+	case RTP_BIND:
+		if (d->rtp_fd >= 0 || len < 3)
+			return -1;
+		port = (in[0] << 8) | in[1];
+		if ((n = parse_addr(in + 2, len - 2, 0, &d->local)) < 0 || len != (ErlDrvSizeT)(2 + n + 8))
+			return -1;
+		d->family = d->local.ss_family;
+		d->timeout_early = get_uint32(in + 2 + n);
+		d->timeout_main = get_uint32(in + 2 + n + 4);
+
+		if (bind_pair(d, port) < 0)
+			return -1;
+
+		driver_select(d->port, (ErlDrvEvent)(intptr_t)d->rtp_fd, ERL_DRV_READ | ERL_DRV_USE, 1);
+		driver_select(d->port, (ErlDrvEvent)(intptr_t)d->rtcp_fd, ERL_DRV_READ | ERL_DRV_USE, 1);
+
+		if (d->timeout_early)
+			driver_set_timer(d->port, d->timeout_early);
+		return reply(rbuf, rlen, out, 0);
+
+	case RTP_GET_PORTS:
+		if (d->rtp_fd < 0)
+			return -1;
+		if (d->family == AF_INET6) {
+			memcpy(p, &((struct sockaddr_in6*)&d->local)->sin6_addr, 16);
+			p += 16;
+		} else {
+			memcpy(p, &((struct sockaddr_in*)&d->local)->sin_addr, 4);
+			p += 4;
+		}
+		*p++ = d->rtp_port >> 8;
+		*p++ = d->rtp_port;
+		*p++ = d->rtcp_port >> 8;
+		*p++ = d->rtcp_port;
+		return reply(rbuf, rlen, out, p - out);
+
+	case RTP_SET_FD:
+		if (len == 0) {
+			d->other_fd = -1;
+			return reply(rbuf, rlen, out, 0);
+		}
+		if (len < 6)
+			return -1;
+		port = (in[4] << 8) | in[5];
+		if (parse_addr(in + 6, len - 6, port, &addr) < 0)
+			return -1;
+		d->other_peer = addr;
+		d->other_fd = get_uint32(in);
+		return reply(rbuf, rlen, out, 0);
+
+	case RTP_GET_STATS:
+		p = put_uint32(p, d->ssrc);
+		*p++ = d->type;
+		p = put_uint32(p, d->rx_bytes);
+		p = put_uint32(p, d->rx_packets);
+		p = put_uint32(p, d->tx_bytes);
+		p = put_uint32(p, d->tx_packets);
+		p = put_uint32(p, d->tx_bytes2);
+		p = put_uint32(p, d->tx_packets2);
+		return reply(rbuf, rlen, out, p - out);
+
+	case RTP_SET_DTMF:
+		if (len != 1)
+			return -1;
+		d->dtmf = in[0];
+		return reply(rbuf, rlen, out, 0);
+	}
+
+	return -1;
+}
+
+static int rtp_drv_init(void)
+{
+	atom_rtp = driver_mk_atom("rtp");
+	atom_rtcp = driver_mk_atom("rtcp");
+	atom_peer = driver_mk_atom("peer");
+	atom_timeout = driver_mk_atom("timeout");
+	return 0;
+}
+
+static ErlDrvEntry rtp_driver_entry = {
+	.init = rtp_drv_init,
+	.start = rtp_drv_start,
+	.stop = rtp_drv_stop,
+	.output = rtp_drv_output,
+	.ready_input = rtp_drv_ready_input,
+	.driver_name = "rtp_drv",
+	.control = rtp_drv_control,
+	.timeout = rtp_drv_timeout,
+	.extended_marker = ERL_DRV_EXTENDED_MARKER,
+	.major_version = ERL_DRV_EXTENDED_MAJOR_VERSION,
+	.minor_version = ERL_DRV_EXTENDED_MINOR_VERSION,
+	.driver_flags = ERL_DRV_FLAG_USE_PORT_LOCKING,
+	.stop_select = rtp_drv_stop_select
+};
+
+DRIVER_INIT(rtp_drv)
+{
+	return &rtp_driver_entry;
+}
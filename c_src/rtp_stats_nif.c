@@ -0,0 +1,576 @@
+/* ----------------------------------------------------------------------
+ *
+ * Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+ * for his excellent work in this area.
+ *
+ * @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+ *
+ * Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+ *
+ * Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+ *
+ * All rights reserved.
+ *
+ * XMediaLib is licensed by Xirsys, with permission, under the Apache
+ * License Version 2.0. (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See LICENSE for the full license text.
+ *
+ * ---------------------------------------------------------------------- */
+
+
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "erl_nif.h"
+
+/*
+ * Receiver statistics for one RTP source (SSRC), RFC 3550. update/4 runs
+ * the A.1 sequence number validation and the A.8 interarrival jitter
+ * estimate for every received packet, in constant time and without
+ * allocating. report/2 turns the counters into the fields of an RTCP report
+ * block (A.3 for the loss figures, 6.4.1 for LSR and DLSR).
+ *
+ * Arrival times are monotonic microseconds. They are only ever used as
+ * differences from the first packet, so any origin will do.
+ *
+ * The same packet stream also drives the RFC 3611 VoIP metrics: the
+ * Appendix A.2 burst/gap counters are updated per loss or discard event in
+ * constant time, and voip_metrics/5 derives the densities, durations and
+ * the E-model (ITU-T G.107) R factor and MOS from them when an XR block is
+ * due.
+ */
+
+#define RTP_SEQ_MOD (1 << 16)
+#define MAX_DROPOUT 3000
+#define MAX_MISORDER 100
+#define MIN_SEQUENTIAL 2
+
+/* the cumulative lost field is 24 bit signed */
+#define MAX_LOST 0x7FFFFF
+#define MIN_LOST (-0x800000)
+
+/* RFC 3611 4.7.2, the recommended minimum gap length in packets */
+#define GMIN 16
+
+typedef struct {
+	ErlNifMutex* lock;
+	uint32_t ssrc;
+	int clock_rate;
+	int started;
+	ErlNifSInt64 origin;
+	/* RFC 3550 A.1 */
+	uint16_t max_seq;
+	uint32_t cycles;
+	uint32_t base_seq;
+	uint32_t bad_seq;
+	uint32_t probation;
+	uint32_t received;
+	uint32_t expected_prior;
+	uint32_t received_prior;
+	/* RFC 3550 A.8, scaled by 16 */
+	uint32_t transit;
+	uint32_t jitter;
+	int have_transit;
+	/* middle 32 bits of the NTP time of the last SR and when it came */
+	uint32_t lsr;
+	ErlNifSInt64 lsr_arrival;
+	int have_lsr;
+	/* timestamp units per packet, from consecutive packets */
+	uint32_t frame;
+	uint32_t last_ts;
+	/* RFC 3611 A.2, lost and discarded packets are both loss events */
+	uint32_t pkt;
+	uint32_t burst_lost;
+	uint32_t c11, c13, c14, c22, c23, c33;
+	uint32_t loss_events;
+	uint32_t discarded;
+} rtp_stats;
+
+static ErlNifResourceType* rtp_stats_type = NULL;
+
+static ERL_NIF_TERM atom_ok;
+static ERL_NIF_TERM atom_invalid;
+static ERL_NIF_TERM atom_nil;
+static ERL_NIF_TERM atom_received;
+static ERL_NIF_TERM atom_expected;
+static ERL_NIF_TERM atom_lost;
+static ERL_NIF_TERM atom_jitter;
+static ERL_NIF_TERM atom_last_seq;
+static ERL_NIF_TERM atom_discarded;
+
+static void init_seq(rtp_stats* s, uint16_t seq)
+{
+	s->base_seq = seq;
+	s->max_seq = seq;
+	s->bad_seq = RTP_SEQ_MOD + 1;
+	s->cycles = 0;
+	s->received = 0;
+	s->received_prior = 0;
+	s->expected_prior = 0;
+}
+
+/* RFC 3550 A.1, 1 if the packet counts */
+static int update_seq(rtp_stats* s, uint16_t seq)
+{
+	uint16_t udelta = seq - s->max_seq;
+
+	if (s->probation) {
+		/* packets must be in sequence until the source is valid */
+		if (seq == (uint16_t)(s->max_seq + 1)) {
+			s->probation--;
+			s->max_seq = seq;
+			if (s->probation == 0) {
+				init_seq(s, seq);
+				s->received++;
+				return 1;
+			}
+		}
+		else {
+			s->probation = MIN_SEQUENTIAL - 1;
+			s->max_seq = seq;
+		}
+		return 0;
+	}
+	else if (udelta < MAX_DROPOUT) {
+		/* in order, with permissible gap */
+		if (seq < s->max_seq)
+			s->cycles += RTP_SEQ_MOD;
+		s->max_seq = seq;
+	}
+	else if (udelta <= RTP_SEQ_MOD - MAX_MISORDER) {
+		/* a big jump, the source restarted if the next packet follows it */
+		if (seq == s->bad_seq)
+			init_seq(s, seq);
+		else {
+			s->bad_seq = (seq + 1) & (RTP_SEQ_MOD - 1);
+			return 0;
+		}
+	}
+	/* otherwise a duplicate or reordered packet */
+
+	s->received++;
+	return 1;
+}
+
+/* RFC 3550 A.8, arrival in timestamp units */
+static void update_jitter(rtp_stats* s, uint32_t ts, uint32_t arrival)
+{
+	uint32_t transit = arrival - ts;
+	int32_t d = (int32_t)(transit - s->transit);
+
+	s->transit = transit;
+	if (!s->have_transit) {
+		s->have_transit = 1;
+		return;
+	}
+	if (d < 0)
+		d = -d;
+	s->jitter += d - ((s->jitter + 8) >> 4);
+}
+
+static inline uint32_t extended_max(const rtp_stats* s)
+{
+	return s->cycles + s->max_seq;
+}
+
+/* RFC 3611 A.2 for n loss events in a row */
+static void loss_run(rtp_stats* s, uint32_t n)
+{
+	if (n == 0)
+		return;
+
+	if (s->pkt >= GMIN) {
+		/* the gap before was long enough, so the previous loss run is over:
+		 * a single loss was part of the gap, more made a burst */
+		if (s->burst_lost == 1)
+			s->c14++;
+		else if (s->burst_lost > 1)
+			s->c13++;
+		s->burst_lost = 1;
+		s->c11 += s->pkt;
+	}
+	else {
+		s->burst_lost++;
+		if (s->pkt == 0)
+			s->c33++;
+		else {
+			s->c23++;
+			s->c22 += s->pkt - 1;
+		}
+	}
+
+	/* the rest of the run are losses straight after a loss */
+	s->burst_lost += n - 1;
+	s->c33 += n - 1;
+	s->loss_events += n;
+	s->pkt = 0;
+}
+
+static ERL_NIF_TERM stats_new(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	rtp_stats* s;
+	ERL_NIF_TERM term;
+	unsigned int ssrc;
+	int clock_rate;
+
+	if (!enif_get_uint(env, argv[0], &ssrc) ||
+			!enif_get_int(env, argv[1], &clock_rate) || clock_rate <= 0)
+		return enif_make_badarg(env);
+
+	s = (rtp_stats*)enif_alloc_resource(rtp_stats_type, sizeof(rtp_stats));
+	memset(s, 0, sizeof(rtp_stats));
+	s->ssrc = ssrc;
+	s->clock_rate = clock_rate;
+	if (!(s->lock = enif_mutex_create((char*)"rtp_stats"))) {
+		enif_release_resource(s);
+		return enif_make_badarg(env);
+	}
+
+	term = enif_make_resource(env, s);
+	enif_release_resource(s);
+
+	return enif_make_tuple2(env, atom_ok, term);
+}
+
+static ERL_NIF_TERM stats_update(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	rtp_stats* s;
+	unsigned int seq;
+	ErlNifUInt64 ts;
+	ErlNifSInt64 arrival;
+	int valid;
+	uint32_t prev, d;
+
+	if (!enif_get_resource(env, argv[0], rtp_stats_type, (void**)&s) ||
+			!enif_get_uint(env, argv[1], &seq) || seq > 0xFFFF ||
+			!enif_get_uint64(env, argv[2], &ts) || ts > 0xFFFFFFFF ||
+			!enif_get_int64(env, argv[3], &arrival))
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(s->lock);
+	if (!s->started) {
+		init_seq(s, seq);
+		s->max_seq = seq - 1;
+		s->probation = MIN_SEQUENTIAL;
+		s->origin = arrival;
+		s->started = 1;
+	}
+	prev = extended_max(s);
+
+	if ((valid = update_seq(s, seq))) {
+		update_jitter(s, (uint32_t)ts,
+				(uint32_t)((arrival - s->origin) * s->clock_rate / 1000000));
+
+		/* the packets skipped are losses. A late packet was already
+		 * counted as one, a (re)started source has nothing skipped */
+		d = extended_max(s) - prev;
+		if (s->received == 1 || (d >= 1 && d <= MAX_DROPOUT)) {
+			if (s->received > 1) {
+				loss_run(s, d - 1);
+				if (d == 1 && (uint32_t)ts - s->last_ts - 1 < (uint32_t)s->clock_rate - 1)
+					s->frame = (uint32_t)ts - s->last_ts;
+			}
+			s->last_ts = (uint32_t)ts;
+			s->pkt++;
+		}
+	}
+	enif_mutex_unlock(s->lock);
+
+	return valid ? atom_ok : atom_invalid;
+}
+
+/* packets received but thrown away, e.g. too late for the jitter buffer */
+static ERL_NIF_TERM stats_discarded(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	rtp_stats* s;
+	unsigned int n;
+
+	if (!enif_get_resource(env, argv[0], rtp_stats_type, (void**)&s) ||
+			!enif_get_uint(env, argv[1], &n))
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(s->lock);
+	s->discarded += n;
+	loss_run(s, n);
+	enif_mutex_unlock(s->lock);
+
+	return atom_ok;
+}
+
+static ERL_NIF_TERM stats_sr_received(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	rtp_stats* s;
+	ErlNifUInt64 ntp;
+	ErlNifSInt64 arrival;
+
+	if (!enif_get_resource(env, argv[0], rtp_stats_type, (void**)&s) ||
+			!enif_get_uint64(env, argv[1], &ntp) ||
+			!enif_get_int64(env, argv[2], &arrival))
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(s->lock);
+	s->lsr = (uint32_t)(ntp >> 16);
+	s->lsr_arrival = arrival;
+	s->have_lsr = 1;
+	enif_mutex_unlock(s->lock);
+
+	return atom_ok;
+}
+
+/*
+ * {ssrc, fraction, lost, extended highest seq, jitter, lsr, dlsr}, or nil before
+ * the source is valid. Moves the interval used for the fraction lost on,
+ * so it's meant to be called once per report sent.
+ */
+static ERL_NIF_TERM stats_report(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	rtp_stats* s;
+	ErlNifSInt64 now, lost;
+	uint32_t expected, expected_interval, received_interval, dlsr = 0;
+	int32_t lost_interval;
+	unsigned int fraction;
+	ERL_NIF_TERM block[7];
+
+	if (!enif_get_resource(env, argv[0], rtp_stats_type, (void**)&s) ||
+			!enif_get_int64(env, argv[1], &now))
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(s->lock);
+	if (!s->started || s->probation) {
+		enif_mutex_unlock(s->lock);
+		return atom_nil;
+	}
+
+	expected = extended_max(s) - s->base_seq + 1;
+	lost = (ErlNifSInt64)expected - s->received;
+	if (lost > MAX_LOST)
+		lost = MAX_LOST;
+	else if (lost < MIN_LOST)
+		lost = MIN_LOST;
+
+	expected_interval = expected - s->expected_prior;
+	s->expected_prior = expected;
+	received_interval = s->received - s->received_prior;
+	s->received_prior = s->received;
+	lost_interval = (int32_t)(expected_interval - received_interval);
+	fraction = (expected_interval == 0 || lost_interval <= 0) ? 0 :
+		((uint32_t)lost_interval << 8) / expected_interval;
+	if (fraction > 255)
+		fraction = 255;
+
+	/* in units of 1/65536 seconds */
+	if (s->have_lsr && now > s->lsr_arrival)
+		dlsr = (uint32_t)((now - s->lsr_arrival) * 65536 / 1000000);
+
+	block[0] = enif_make_uint(env, s->ssrc);
+	block[1] = enif_make_uint(env, fraction);
+	block[2] = enif_make_int(env, (int)lost);
+	block[3] = enif_make_uint(env, extended_max(s));
+	block[4] = enif_make_uint(env, s->jitter >> 4);
+	block[5] = enif_make_uint(env, s->have_lsr ? s->lsr : 0);
+	block[6] = enif_make_uint(env, dlsr);
+	enif_mutex_unlock(s->lock);
+
+	return enif_make_tuple_from_array(env, block, 7);
+}
+
+static unsigned int rate256(ErlNifSInt64 n, ErlNifSInt64 total)
+{
+	if (n <= 0 || total <= 0)
+		return 0;
+	return n >= total ? 255 : (unsigned int)(n * 256 / total);
+}
+
+/* ITU-T G.107 Annex B */
+static double r_to_mos(double r)
+{
+	if (r <= 0)
+		return 1.0;
+	if (r >= 100)
+		return 4.5;
+	return 1 + 0.035 * r + r * (r - 60) * (100 - r) * 7e-6;
+}
+
+/*
+ * The computed fields of an RFC 3611 VoIP metrics block:
+ * {ssrc, loss rate, discard rate, burst density, gap density, burst
+ * duration, gap duration, R factor, MOS-LQ, MOS-CQ}, or nil before the
+ * source is valid. The E-model takes the round trip and end system delays
+ * in milliseconds and the codec's equipment impairment factor Ie and packet
+ * loss robustness Bpl (ITU-T G.113 Appendix I), everything else at the
+ * G.107 defaults. MOS values are scaled by 10.
+ */
+static ERL_NIF_TERM stats_voip_metrics(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	rtp_stats* s;
+	unsigned int rtt, esd;
+	double ie, bpl, m, p32, p23, gap_len, burst_len, ppl, p, q, burst_r, ie_eff, ta, id, r_lq, r_cq;
+	uint32_t expected, c11, c13, c14, c22, c23, c31, c32, c33, ctotal;
+	unsigned int loss_rate, discard_rate, burst_density, gap_density, r;
+	ERL_NIF_TERM block[10];
+
+	if (!enif_get_resource(env, argv[0], rtp_stats_type, (void**)&s) ||
+			!enif_get_uint(env, argv[1], &rtt) || !enif_get_uint(env, argv[2], &esd) ||
+			!enif_get_double(env, argv[3], &ie) || !enif_get_double(env, argv[4], &bpl) || bpl <= 0)
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(s->lock);
+	if (!s->started || s->probation) {
+		enif_mutex_unlock(s->lock);
+		return atom_nil;
+	}
+
+	expected = extended_max(s) - s->base_seq + 1;
+	loss_rate = rate256((ErlNifSInt64)expected - s->received, expected);
+	discard_rate = rate256(s->discarded, expected);
+
+	/* RFC 3611 A.2, closing the current loss run if a gap has started since */
+	m = (s->frame ? s->frame : (uint32_t)s->clock_rate / 50) * 1000.0 / s->clock_rate;
+	c11 = s->c11;
+	c13 = s->c13;
+	c14 = s->c14;
+	if (s->pkt >= GMIN) {
+		c11 += s->pkt;
+		if (s->burst_lost == 1)
+			c14++;
+		else if (s->burst_lost > 1)
+			c13++;
+	}
+	c22 = s->c22;
+	c23 = s->c23;
+	c33 = s->c33;
+	c31 = c13;
+	c32 = c23;
+	ctotal = c11 + c14 + c13 + c22 + c23 + c31 + c32 + c33;
+
+	if (c13 > 0) {
+		p32 = (c31 + c32 + c33) ? (double)c32 / (c31 + c32 + c33) : 0;
+		p23 = (c22 + c23) < 1 ? 1 : 1 - (double)c22 / (c22 + c23);
+		burst_density = (p23 + p32) > 0 ? (unsigned int)(256 * p23 / (p23 + p32)) : 0;
+		gap_len = (c11 + c14 + c13) * m / c13;
+		burst_len = ctotal * m / c13 - gap_len;
+	}
+	else {
+		/* no bursts, it's all one gap */
+		burst_density = 0;
+		gap_len = (ErlNifSInt64)expected * m;
+		burst_len = 0;
+	}
+	gap_density = (c11 + c14) ? c14 * 256 / (c11 + c14) : 0;
+
+	/* E-model, Ie,eff from G.107 7.2 with the burst ratio of a two state
+	 * loss model fitted to the counts */
+	ppl = 100.0 * ((ErlNifSInt64)expected - s->received + s->discarded) / expected;
+	if (ppl < 0)
+		ppl = 0;
+	p = (c13 + c14 + c23) ? (double)(c13 + c14 + c23) / (s->received ? s->received : 1) : 0;
+	q = s->loss_events ? (double)(c13 + c14 + c23) / s->loss_events : 0;
+	burst_r = (p + q) > 0 ? 1 / (p + q) : 1;
+	if (burst_r < 1)
+		burst_r = 1;
+	ie_eff = ie + (95 - ie) * ppl / (ppl / burst_r + bpl);
+
+	/* Id for a one way delay of half the round trip plus the end system delay */
+	ta = rtt / 2.0 + esd;
+	id = 0.024 * ta + (ta > 177.3 ? 0.11 * (ta - 177.3) : 0);
+
+	r_lq = 93.2 - ie_eff;
+	r_cq = r_lq - id;
+	r = r_cq <= 0 ? 0 : r_cq >= 100 ? 100 : (unsigned int)lround(r_cq);
+
+	block[0] = enif_make_uint(env, s->ssrc);
+	block[1] = enif_make_uint(env, loss_rate);
+	block[2] = enif_make_uint(env, discard_rate);
+	block[3] = enif_make_uint(env, burst_density > 255 ? 255 : burst_density);
+	block[4] = enif_make_uint(env, gap_density > 255 ? 255 : gap_density);
+	block[5] = enif_make_uint(env, burst_len > 0xFFFF ? 0xFFFF : (unsigned int)lround(burst_len));
+	block[6] = enif_make_uint(env, gap_len > 0xFFFF ? 0xFFFF : (unsigned int)lround(gap_len));
+	block[7] = enif_make_uint(env, r);
+	block[8] = enif_make_uint(env, (unsigned int)lround(r_to_mos(r_lq) * 10));
+	block[9] = enif_make_uint(env, (unsigned int)lround(r_to_mos(r_cq) * 10));
+	enif_mutex_unlock(s->lock);
+
+	return enif_make_tuple_from_array(env, block, 10);
+}
+
+static ERL_NIF_TERM stats_stats(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	rtp_stats* s;
+	uint32_t expected = 0;
+	ERL_NIF_TERM ret;
+
+	if (!enif_get_resource(env, argv[0], rtp_stats_type, (void**)&s))
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(s->lock);
+	if (s->started && !s->probation)
+		expected = extended_max(s) - s->base_seq + 1;
+	ret = enif_make_list(env, 6,
+			enif_make_tuple2(env, atom_received, enif_make_uint(env, s->received)),
+			enif_make_tuple2(env, atom_expected, enif_make_uint(env, expected)),
+			enif_make_tuple2(env, atom_lost, enif_make_int64(env, (ErlNifSInt64)expected - s->received)),
+			enif_make_tuple2(env, atom_jitter,
+				enif_make_uint(env, (uint32_t)((ErlNifUInt64)(s->jitter >> 4) * 1000 / s->clock_rate))),
+			enif_make_tuple2(env, atom_last_seq, enif_make_uint(env, extended_max(s))),
+			enif_make_tuple2(env, atom_discarded, enif_make_uint(env, s->discarded)));
+	enif_mutex_unlock(s->lock);
+
+	return ret;
+}
+
+static void rtp_stats_dtor(ErlNifEnv* env, void* obj)
+{
+	rtp_stats* s = (rtp_stats*)obj;
+
+	if (s->lock)
+		enif_mutex_destroy(s->lock);
+}
+
+static int load(ErlNifEnv* env, void** priv_data, ERL_NIF_TERM load_info)
+{
+	rtp_stats_type = enif_open_resource_type(env, NULL, "rtp_stats",
+			rtp_stats_dtor, ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, NULL);
+	if (!rtp_stats_type)
+		return -1;
+
+	atom_ok = enif_make_atom(env, "ok");
+	atom_invalid = enif_make_atom(env, "invalid");
+	atom_nil = enif_make_atom(env, "nil");
+	atom_received = enif_make_atom(env, "received");
+	atom_expected = enif_make_atom(env, "expected");
+	atom_lost = enif_make_atom(env, "lost");
+	atom_jitter = enif_make_atom(env, "jitter");
+	atom_last_seq = enif_make_atom(env, "last_seq");
+	atom_discarded = enif_make_atom(env, "discarded");
+
+	return 0;
+}
+
+static int upgrade(ErlNifEnv* env, void** priv_data, void** old_priv_data, ERL_NIF_TERM load_info)
+{
+	return load(env, priv_data, load_info);
+}
+
+static ErlNifFunc nif_funcs[] =
+{
+	{"new", 2, stats_new, 0},
+	{"update", 4, stats_update, 0},
+	{"discarded", 2, stats_discarded, 0},
+	{"sr_received", 3, stats_sr_received, 0},
+	{"report", 2, stats_report, 0},
+	{"voip_metrics", 5, stats_voip_metrics, 0},
+	{"stats", 1, stats_stats, 0}
+};
+
+ERL_NIF_INIT(Elixir.XMediaLib.RtpStats.Native,nif_funcs,load,NULL,upgrade,NULL)
@@ -0,0 +1,243 @@
+/* ----------------------------------------------------------------------
+ *
+ * Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+ * for his excellent work in this area.
+ *
+ * @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+ *
+ * Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+ *
+ * Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+ *
+ * All rights reserved.
+ *
+ * XMediaLib is licensed by Xirsys, with permission, under the Apache
+ * License Version 2.0. (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See LICENSE for the full license text.
+ *
+ * ---------------------------------------------------------------------- */
+
+
+#ifndef __SKEIN_H__
+#define __SKEIN_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Skein-512 (v1.3) and Skein-MAC, for the SK32/SK64 ZRTP auth tags.
+ * skein512_mac_init() runs the key and configuration UBI calls once and
+ * keeps the chaining value, so a tag only costs the message blocks and the
+ * output block. The state is copied for every message, several threads can
+ * share a skein512_mac without a lock.
+ */
+
+#define SKEIN512_BLOCK 64
+#define SKEIN512_WORDS 8
+
+#define SKEIN_TYPE_KEY 0
+#define SKEIN_TYPE_CFG 4
+#define SKEIN_TYPE_MSG 48
+#define SKEIN_TYPE_OUT 63
+
+#define SKEIN_FLAG_FIRST ((uint64_t)1 << 62)
+#define SKEIN_FLAG_FINAL ((uint64_t)1 << 63)
+
+#define SKEIN_KS_PARITY 0x1BD11BDAA9FC1A22ULL
+
+typedef struct {
+	uint64_t h[SKEIN512_WORDS];
+	uint64_t pos;
+	uint64_t type;
+	int first;
+	size_t n;
+	uint8_t buf[SKEIN512_BLOCK];
+} skein512_ctx;
+
+typedef struct {
+	/* chaining value after the key and configuration */
+	uint64_t h[SKEIN512_WORDS];
+	size_t out_len;
+} skein512_mac;
+
+static const uint8_t skein512_rot[8][4] = {
+	{46, 36, 19, 37}, {33, 27, 14, 42}, {17, 49, 36, 39}, {44, 9, 54, 56},
+	{39, 30, 34, 24}, {13, 50, 10, 17}, {25, 29, 39, 43}, {8, 35, 56, 22}
+};
+
+static const uint8_t skein512_perm[8] = {2, 1, 4, 7, 6, 5, 0, 3};
+
+static inline uint64_t skein_rotl(uint64_t x, unsigned int n)
+{
+	return (x << n) | (x >> (64 - n));
+}
+
+static inline uint64_t skein_get64(const uint8_t* p)
+{
+	return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+		((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static inline void skein_put64(uint8_t* p, uint64_t v)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		p[i] = (v >> (8 * i)) & 0xFF;
+}
+
+/* Threefish-512 of block under key h and tweak t, fed forward into h (UBI) */
+static void skein512_block(uint64_t h[SKEIN512_WORDS], const uint8_t* block, uint64_t t0, uint64_t t1)
+{
+	uint64_t k[SKEIN512_WORDS + 1], t[3], m[SKEIN512_WORDS], x[SKEIN512_WORDS], f[SKEIN512_WORDS];
+	int i, d, s;
+
+	k[8] = SKEIN_KS_PARITY;
+	for (i = 0; i < SKEIN512_WORDS; i++) {
+		k[i] = h[i];
+		k[8] ^= h[i];
+		m[i] = skein_get64(block + 8 * i);
+	}
+	t[0] = t0;
+	t[1] = t1;
+	t[2] = t0 ^ t1;
+
+	for (d = 0; d < 72; d++) {
+		if (d % 4 == 0) {
+			s = d / 4;
+			for (i = 0; i < SKEIN512_WORDS; i++)
+				x[i] = (d ? x[i] : m[i]) + k[(s + i) % 9];
+			x[5] += t[s % 3];
+			x[6] += t[(s + 1) % 3];
+			x[7] += s;
+		}
+		for (i = 0; i < 4; i++) {
+			f[2 * i] = x[2 * i] + x[2 * i + 1];
+			f[2 * i + 1] = skein_rotl(x[2 * i + 1], skein512_rot[d % 8][i]) ^ f[2 * i];
+		}
+		for (i = 0; i < SKEIN512_WORDS; i++)
+			x[i] = f[skein512_perm[i]];
+	}
+
+	/* the last subkey, then the feed forward */
+	for (i = 0; i < SKEIN512_WORDS; i++)
+		h[i] = x[i] + k[(18 + i) % 9];
+	h[5] += t[18 % 3];
+	h[6] += t[19 % 3];
+	h[7] += 18;
+	for (i = 0; i < SKEIN512_WORDS; i++)
+		h[i] ^= m[i];
+}
+
+static void skein512_start(skein512_ctx* c, const uint64_t h[SKEIN512_WORDS], int type)
+{
+	memcpy(c->h, h, sizeof(c->h));
+	c->pos = 0;
+	c->type = (uint64_t)type << 56;
+	c->first = 1;
+	c->n = 0;
+}
+
+static void skein512_update(skein512_ctx* c, const uint8_t* data, size_t len)
+{
+	size_t take;
+
+	while (len > 0) {
+		/* a full buffer is only processed once more input shows up, the
+		 * last block has to carry the final flag */
+		if (c->n == SKEIN512_BLOCK) {
+			c->pos += SKEIN512_BLOCK;
+			skein512_block(c->h, c->buf, c->pos, c->type | (c->first ? SKEIN_FLAG_FIRST : 0));
+			c->first = 0;
+			c->n = 0;
+		}
+		take = SKEIN512_BLOCK - c->n;
+		if (take > len)
+			take = len;
+		memcpy(c->buf + c->n, data, take);
+		c->n += take;
+		data += take;
+		len -= take;
+	}
+}
+
+static void skein512_end(skein512_ctx* c, uint64_t h[SKEIN512_WORDS])
+{
+	memset(c->buf + c->n, 0, SKEIN512_BLOCK - c->n);
+	c->pos += c->n;
+	skein512_block(c->h, c->buf, c->pos, c->type | SKEIN_FLAG_FINAL | (c->first ? SKEIN_FLAG_FIRST : 0));
+	memcpy(h, c->h, sizeof(c->h));
+}
+
+/* the configuration UBI call, for out_len bytes of output, no tree hashing */
+static void skein512_config(uint64_t h[SKEIN512_WORDS], size_t out_len)
+{
+	skein512_ctx c;
+	uint8_t cfg[32] = {'S', 'H', 'A', '3', 1, 0, 0, 0};
+
+	skein_put64(cfg + 8, (uint64_t)out_len * 8);
+	skein512_start(&c, h, SKEIN_TYPE_CFG);
+	skein512_update(&c, cfg, sizeof(cfg));
+	skein512_end(&c, h);
+}
+
+/* the output UBI call, out_len is at most one block */
+static void skein512_output(const uint64_t h[SKEIN512_WORDS], uint8_t* out, size_t out_len)
+{
+	skein512_ctx c;
+	uint64_t r[SKEIN512_WORDS];
+	uint8_t counter[8] = {0};
+	uint8_t block[SKEIN512_BLOCK];
+	int i;
+
+	skein512_start(&c, h, SKEIN_TYPE_OUT);
+	skein512_update(&c, counter, sizeof(counter));
+	skein512_end(&c, r);
+	for (i = 0; i < SKEIN512_WORDS; i++)
+		skein_put64(block + 8 * i, r[i]);
+	memcpy(out, block, out_len);
+}
+
+/* out_len is in bytes, 1 to 64 */
+static void skein512_mac_init(skein512_mac* m, const uint8_t* key, size_t key_len, size_t out_len)
+{
+	skein512_ctx c;
+
+	memset(m->h, 0, sizeof(m->h));
+	if (key_len > 0) {
+		skein512_start(&c, m->h, SKEIN_TYPE_KEY);
+		skein512_update(&c, key, key_len);
+		skein512_end(&c, m->h);
+	}
+	skein512_config(m->h, out_len);
+	m->out_len = out_len;
+}
+
+/* MAC over data || extra (the SRTP packet and its ROC), out gets out_len bytes */
+static void skein512_mac_run(const skein512_mac* m, const uint8_t* data, size_t len,
+		const uint8_t* extra, size_t extra_len, uint8_t* out)
+{
+	skein512_ctx c;
+	uint64_t h[SKEIN512_WORDS];
+
+	skein512_start(&c, m->h, SKEIN_TYPE_MSG);
+	skein512_update(&c, data, len);
+	if (extra_len > 0)
+		skein512_update(&c, extra, extra_len);
+	skein512_end(&c, h);
+	skein512_output(h, out, m->out_len);
+}
+
+#endif /* __SKEIN_H__ */
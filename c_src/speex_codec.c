@@ -28,129 +28,172 @@
  *
  * ---------------------------------------------------------------------- */
 
+
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
-#include "erl_driver.h"
+#include <stdlib.h>
 #include <speex/speex.h>
+#include "codec.h"
 
 typedef struct {
-	ErlDrvPort port;
 	SpeexBits bits;
 	void* estate;
 	void* dstate;
+	/* samples per frame: 160, 320 or 640 for nb, wb and uwb */
+	int frame_size;
 } codec_data;
 
-enum {
-	CMD_ENCODE = 1,
-	CMD_DECODE = 2
-};
-
 /* http://tools.ietf.org/html/rfc5574 */
-/* FIXME hardcoded */
-#define FRAME_SIZE 160
+#define MAX_SPEEX_SIZE 200
 
 #ifndef spx_int16_t
 #define spx_int16_t short
 #endif
 
-static ErlDrvData codec_drv_start(ErlDrvPort port, char *buff)
+/* The mode follows the sample rate, so wideband audio stays wideband */
+static const SpeexMode* speex_mode(int sample_rate)
+{
+	switch (sample_rate) {
+	case 8000:
+		return &speex_nb_mode;
+	case 16000:
+		return &speex_wb_mode;
+	case 32000:
+		return &speex_uwb_mode;
+	default:
+		return NULL;
+	}
+}
+
+static void* speex_codec_init(int sample_rate, int channels)
 {
+	const SpeexMode* mode = speex_mode(sample_rate);
+	codec_data* d;
 	int tmp;
-	codec_data* d = (codec_data*)driver_alloc(sizeof(codec_data));
-	d->port = port;
+
+	if (!mode || channels != 1)
+		return NULL;
+	d = (codec_data*)malloc(sizeof(codec_data));
+	if (!d)
+		return NULL;
 	speex_bits_init(&d->bits);
-	/* FIXME hardcoded narrowband mode (speex_wb_mode, speex_uwb_mode) */
-	d->estate = speex_encoder_init(&speex_nb_mode);
-	d->dstate = speex_decoder_init(&speex_nb_mode);
-//	tmp=8;
-//	speex_encoder_ctl(d->estate, SPEEX_SET_QUALITY, &tmp);
+	d->estate = speex_encoder_init(mode);
+	d->dstate = speex_decoder_init(mode);
+	speex_encoder_ctl(d->estate, SPEEX_GET_FRAME_SIZE, &d->frame_size);
 	tmp=3;
 	speex_encoder_ctl(d->estate, SPEEX_SET_COMPLEXITY, &tmp);
-//	tmp=8000;
-//	speex_encoder_ctl(d->estate, SPEEX_SET_SAMPLING_RATE, &tmp);
 	tmp=1;
 	speex_decoder_ctl(d->dstate, SPEEX_SET_ENH, &tmp);
-	set_port_control_flags(port, PORT_CONTROL_FLAG_BINARY);
-	return (ErlDrvData)d;
+	return d;
 }
 
-static void codec_drv_stop(ErlDrvData handle)
+static void speex_codec_destroy(void* state)
 {
-	codec_data *d = (codec_data *) handle;
+	codec_data* d = (codec_data*)state;
 	speex_bits_destroy(&d->bits);
 	speex_encoder_destroy(d->estate);
 	speex_decoder_destroy(d->dstate);
-	driver_free((char*)handle);
+	free(d);
 }
 
-static ErlDrvSSizeT codec_drv_control(
-		ErlDrvData handle,
-		unsigned int command,
-		char *buf, ErlDrvSizeT len,
-		char **rbuf, ErlDrvSizeT rlen)
+/* SPEEX_RESET_STATE keeps quality/complexity/enhancer settings */
+static void speex_codec_reset(void* state)
 {
-	codec_data* d = (codec_data*)handle;
-
-	int i;
-	int ret = 0;
-	ErlDrvBinary *out;
-	*rbuf = NULL;
-	float frame[FRAME_SIZE];
-	char cbits[200];
-
-	switch(command) {
-		case CMD_ENCODE:
-			for (i=0; i < len / 2; i++){
-				frame[i] = (buf[2*i] & 0xff) | (buf[2*i+1] << 8);
-			}
-			speex_bits_reset(&d->bits);
-			speex_encode(d->estate, frame, &d->bits);
-			ret = speex_bits_write(&d->bits, cbits, 200);
-			out = driver_alloc_binary(ret);
-			memcpy(out->orig_bytes, cbits, ret);
-			*rbuf = (char *) out;
-			break;
-		 case CMD_DECODE:
-			out = driver_alloc_binary(2*FRAME_SIZE);
-			speex_bits_read_from(&d->bits, buf, len);
-			speex_decode_int(d->dstate, &d->bits, (spx_int16_t *)out->orig_bytes);
-			ret = 2*FRAME_SIZE;
-			*rbuf = (char *) out;
+	codec_data* d = (codec_data*)state;
+	speex_bits_reset(&d->bits);
+	speex_encoder_ctl(d->estate, SPEEX_RESET_STATE, NULL);
+	speex_decoder_ctl(d->dstate, SPEEX_RESET_STATE, NULL);
+}
+
+/* RFC 5574 allows several frames back to back in one payload */
+static int speex_codec_encode(void* state, const int16_t* pcm, size_t samples, uint8_t* out, size_t out_len)
+{
+	codec_data* d = (codec_data*)state;
+	size_t j;
+
+	if (samples == 0 || samples % d->frame_size != 0)
+		return -1;
+
+	speex_bits_reset(&d->bits);
+	for (j = 0; j < samples; j += d->frame_size)
+		speex_encode_int(d->estate, (spx_int16_t*)(pcm + j), &d->bits);
+	/* so the padding can't be mistaken for another frame */
+	speex_bits_insert_terminator(&d->bits);
+	return speex_bits_write(&d->bits, (char*)out, out_len);
+}
+
+static int speex_codec_decode(void* state, const uint8_t* in, size_t len, int16_t* pcm, size_t max_samples)
+{
+	codec_data* d = (codec_data*)state;
+	size_t samples = 0;
+	int ret;
+
+	speex_bits_read_from(&d->bits, (const char*)in, len);
+	while (samples + d->frame_size <= max_samples) {
+		ret = speex_decode_int(d->dstate, &d->bits, (spx_int16_t*)(pcm + samples));
+		/* -1 is the end of the payload */
+		if (ret == -1)
 			break;
-		 default:
+		if (ret != 0)
+			return -1;
+		samples += d->frame_size;
+		/* padding bits only */
+		if (speex_bits_remaining(&d->bits) < 5)
 			break;
 	}
-	return ret;
+	return samples ? (int)samples : -1;
 }
 
-ErlDrvEntry codec_driver_entry = {
-	NULL,			/* F_PTR init, N/A */
-	codec_drv_start,	/* L_PTR start, called when port is opened */
-	codec_drv_stop,		/* F_PTR stop, called when port is closed */
-	NULL,			/* F_PTR output, called when erlang has sent */
-	NULL,			/* F_PTR ready_input, called when input descriptor ready */
-	NULL,			/* F_PTR ready_output, called when output descriptor ready */
-	(char*) "speex_codec_drv",		/* char *driver_name, the argument to open_port */
-	NULL,			/* F_PTR finish, called when unloaded */
-	NULL,			/* handle */
-	codec_drv_control,	/* F_PTR control, port_command callback */
-	NULL,			/* F_PTR timeout, reserved */
-	NULL,			/* F_PTR outputv, reserved */
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	(int) ERL_DRV_EXTENDED_MARKER,
-	(int) ERL_DRV_EXTENDED_MAJOR_VERSION,
-	(int) ERL_DRV_EXTENDED_MINOR_VERSION,
-	0,
-	NULL,
-	NULL,
-	NULL
-};
+/* the decoder extrapolates from its own history when handed no bits */
+static int speex_codec_plc(void* state, const uint8_t* next, size_t next_len, int16_t* pcm, size_t samples)
+{
+	codec_data* d = (codec_data*)state;
+	size_t j;
+
+	if (samples == 0 || samples % d->frame_size != 0)
+		return -1;
+	for (j = 0; j < samples; j += d->frame_size)
+		speex_decode_int(d->dstate, NULL, (spx_int16_t*)(pcm + j));
+	return samples;
+}
 
-DRIVER_INIT(codec_drv) /* must match name in driver_entry */
+static size_t speex_max_encoded(void* state, size_t samples)
 {
-	return &codec_driver_entry;
+	codec_data* d = (codec_data*)state;
+	return (samples / d->frame_size) * MAX_SPEEX_SIZE;
 }
+
+/*
+ * A DTX frame from a remote encoder can be as small as 5 bits, but sizing
+ * for that would allocate seconds of audio per packet. No payload carries
+ * more than CODEC_MAX_PTIME worth of 20 ms frames, decode stops there.
+ */
+static size_t speex_max_decoded(void* state, size_t len)
+{
+	codec_data* d = (codec_data*)state;
+	size_t frames = len * 8 / 5 + 1;
+
+	if (frames > CODEC_MAX_PTIME / 20)
+		frames = CODEC_MAX_PTIME / 20;
+	return frames * d->frame_size;
+}
+
+const codec_ops speex_codec_ops = {
+	"speex",
+	speex_codec_init,
+	speex_codec_destroy,
+	speex_codec_encode,
+	speex_codec_decode,
+	speex_max_encoded,
+	speex_max_decoded,
+	speex_codec_reset,
+	NULL,			/* ctl */
+	speex_codec_plc
+};
+
+#define CODEC_OPS speex_codec_ops
+#define CODEC_NIF_FLAGS ERL_NIF_DIRTY_JOB_CPU_BOUND
+#include "codec_nif.h"
+
+CODEC_NIF_INIT(Elixir.XMediaLib.Codec.SPEEX)
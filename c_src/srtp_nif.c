@@ -0,0 +1,1134 @@
+/* ----------------------------------------------------------------------
+ *
+ * Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+ * for his excellent work in this area.
+ *
+ * @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+ *
+ * Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+ *
+ * Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+ *
+ * All rights reserved.
+ *
+ * XMediaLib is licensed by Xirsys, with permission, under the Apache
+ * License Version 2.0. (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See LICENSE for the full license text.
+ *
+ * ---------------------------------------------------------------------- */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+#include "erl_nif.h"
+#include "hmac_sha1.h"
+#include "skein.h"
+
+/*
+ * RFC 3711 SRTP/SRTCP. A context holds everything derived from the master
+ * key - the expanded AES key schedules for the RTP and RTCP session keys and
+ * the precomputed HMAC states - so protecting a packet is one call doing one
+ * AES-CTR pass and one HMAC over the packet.
+ *
+ * The rollover counter is tracked per context, so a context serves one
+ * RTP stream (one SSRC) in one direction. So is the replay window (RFC 3711
+ * 3.3.2): a packet whose index was already accepted, or which is too old for
+ * the window to tell, is refused before it is authenticated or decrypted.
+ *
+ * SRTP_AUTHENTICATION_SKEIN is the Skein-512-MAC of the ZRTP SK32 and SK64
+ * auth tag types (RFC 6189 5.1.3), keyed with a 256 bit session key and
+ * producing exactly tag_length bytes, as GNU ZRTP does. The key and the
+ * configuration block are absorbed once with the rest of the context.
+ */
+
+#define SRTP_ENCRYPTION_NULL 0
+#define SRTP_ENCRYPTION_AESCM 1
+#define SRTP_ENCRYPTION_AESGCM 2
+
+#define SRTP_AUTHENTICATION_NULL 0
+#define SRTP_AUTHENTICATION_SHA1_HMAC 1
+#define SRTP_AUTHENTICATION_SKEIN 2
+
+#define SRTP_LABEL_RTP_ENCR 0x0
+#define SRTP_LABEL_RTP_AUTH 0x1
+#define SRTP_LABEL_RTP_SALT 0x2
+#define SRTP_LABEL_RTCP_ENCR 0x3
+#define SRTP_LABEL_RTCP_AUTH 0x4
+#define SRTP_LABEL_RTCP_SALT 0x5
+
+#define SRTP_SALT_LEN 14
+/* RFC 7714, AEAD_AES_128_GCM and AEAD_AES_256_GCM */
+#define SRTP_AEAD_SALT_LEN 12
+#define SRTP_AEAD_TAG_LEN 16
+#define SRTP_MAX_KEY_LEN 32
+#define SRTP_MAX_TAG_LEN HMAC_SHA1_SIZE
+#define SRTP_SKEIN_KEY_LEN 32
+
+/* packets, a power of two and a multiple of 64 */
+#define SRTP_REPLAY_WINDOW 1024
+#define SRTP_REPLAY_WORDS (SRTP_REPLAY_WINDOW / 64)
+
+#define RTP_HEADER_LEN 12
+#define RTCP_HEADER_LEN 8
+#define SRTCP_INDEX_LEN 4
+
+typedef struct {
+	EVP_CIPHER_CTX* cipher;
+	/* the same AES key without a mode, for batches (see srtp_protect_batch) */
+	EVP_CIPHER_CTX* ecb;
+	hmac_sha1 auth;
+	skein512_mac skein;
+	uint8_t salt[SRTP_SALT_LEN];
+} srtp_keys;
+
+/*
+ * Sliding window over the packet index kept as a ring: the bit for index i
+ * is i % SRTP_REPLAY_WINDOW, so moving the window on only clears the bits
+ * it passes over instead of shifting the whole bitmap.
+ */
+typedef struct {
+	uint64_t top;
+	int started;
+	uint64_t bits[SRTP_REPLAY_WORDS];
+} replay_window;
+
+typedef struct {
+	ErlNifMutex* lock;
+	int ealg;
+	int aalg;
+	size_t tag_length;
+	srtp_keys rtp;
+	srtp_keys rtcp;
+	/* RFC 3711 3.3.1 */
+	uint32_t roc;
+	uint16_t s_l;
+	int s_l_set;
+	uint32_t rtcp_index;
+	replay_window rtp_replay;
+	replay_window rtcp_replay;
+} srtp_ctx;
+
+static ErlNifResourceType* srtp_ctx_type = NULL;
+static ErlNifResourceType* skein_mac_type = NULL;
+
+static ERL_NIF_TERM atom_ok;
+static ERL_NIF_TERM atom_error;
+static ERL_NIF_TERM atom_unsupported;
+static ERL_NIF_TERM atom_bad_packet;
+static ERL_NIF_TERM atom_auth_failed;
+static ERL_NIF_TERM atom_crypto_error;
+static ERL_NIF_TERM atom_replayed;
+
+static const EVP_CIPHER* aes_ctr(size_t key_len)
+{
+	switch (key_len) {
+		case 16:
+			return EVP_aes_128_ctr();
+		case 24:
+			return EVP_aes_192_ctr();
+		case 32:
+			return EVP_aes_256_ctr();
+		default:
+			return NULL;
+	}
+}
+
+static const EVP_CIPHER* aes_ecb(size_t key_len)
+{
+	switch (key_len) {
+		case 16:
+			return EVP_aes_128_ecb();
+		case 24:
+			return EVP_aes_192_ecb();
+		case 32:
+			return EVP_aes_256_ecb();
+		default:
+			return NULL;
+	}
+}
+
+static const EVP_CIPHER* aes_gcm(size_t key_len)
+{
+	switch (key_len) {
+		case 16:
+			return EVP_aes_128_gcm();
+		case 32:
+			return EVP_aes_256_gcm();
+		default:
+			return NULL;
+	}
+}
+
+/* RFC 3711 4.3.1, with a key derivation rate of zero */
+static int derive(const uint8_t* master_key, size_t key_len, const uint8_t* master_salt,
+		int label, uint8_t* out, size_t len)
+{
+	EVP_CIPHER_CTX* c;
+	uint8_t iv[16];
+	int outl, ok;
+
+	memset(iv, 0, sizeof(iv));
+	memcpy(iv, master_salt, SRTP_SALT_LEN);
+	iv[7] ^= label;
+	memset(out, 0, len);
+
+	if (!(c = EVP_CIPHER_CTX_new()))
+		return 0;
+	ok = EVP_EncryptInit_ex(c, aes_ctr(key_len), NULL, master_key, iv) &&
+		EVP_EncryptUpdate(c, out, &outl, out, len);
+	EVP_CIPHER_CTX_free(c);
+
+	return ok;
+}
+
+static int setup_keys(srtp_ctx* ctx, srtp_keys* keys, const uint8_t* master_key, size_t key_len,
+		const uint8_t* master_salt, int label_encr)
+{
+	uint8_t k_e[SRTP_MAX_KEY_LEN];
+	uint8_t k_a[SRTP_SKEIN_KEY_LEN];
+	int ok = 1;
+
+	if (ctx->ealg == SRTP_ENCRYPTION_AESCM) {
+		ok = derive(master_key, key_len, master_salt, label_encr, k_e, key_len) &&
+			derive(master_key, key_len, master_salt, label_encr + 2, keys->salt, SRTP_SALT_LEN) &&
+			(keys->cipher = EVP_CIPHER_CTX_new()) != NULL &&
+			EVP_EncryptInit_ex(keys->cipher, aes_ctr(key_len), NULL, k_e, NULL) &&
+			(keys->ecb = EVP_CIPHER_CTX_new()) != NULL &&
+			EVP_EncryptInit_ex(keys->ecb, aes_ecb(key_len), NULL, k_e, NULL) &&
+			EVP_CIPHER_CTX_set_padding(keys->ecb, 0);
+		OPENSSL_cleanse(k_e, sizeof(k_e));
+	}
+	else if (ctx->ealg == SRTP_ENCRYPTION_AESGCM) {
+		/* RFC 7714 11, the same KDF with a 96 bit session salt */
+		ok = derive(master_key, key_len, master_salt, label_encr, k_e, key_len) &&
+			derive(master_key, key_len, master_salt, label_encr + 2, keys->salt, SRTP_AEAD_SALT_LEN) &&
+			(keys->cipher = EVP_CIPHER_CTX_new()) != NULL &&
+			EVP_CipherInit_ex(keys->cipher, aes_gcm(key_len), NULL, k_e, NULL, 1);
+		OPENSSL_cleanse(k_e, sizeof(k_e));
+	}
+
+	if (ok && ctx->aalg == SRTP_AUTHENTICATION_SHA1_HMAC) {
+		ok = derive(master_key, key_len, master_salt, label_encr + 1, k_a, HMAC_SHA1_SIZE) &&
+			hmac_sha1_init(&keys->auth, k_a, HMAC_SHA1_SIZE);
+		OPENSSL_cleanse(k_a, sizeof(k_a));
+	}
+	else if (ok && ctx->aalg == SRTP_AUTHENTICATION_SKEIN) {
+		if ((ok = derive(master_key, key_len, master_salt, label_encr + 1, k_a, SRTP_SKEIN_KEY_LEN)))
+			skein512_mac_init(&keys->skein, k_a, SRTP_SKEIN_KEY_LEN, ctx->tag_length);
+		OPENSSL_cleanse(k_a, sizeof(k_a));
+	}
+
+	return ok;
+}
+
+static void free_keys(srtp_keys* keys)
+{
+	if (keys->cipher)
+		EVP_CIPHER_CTX_free(keys->cipher);
+	if (keys->ecb)
+		EVP_CIPHER_CTX_free(keys->ecb);
+	hmac_sha1_free(&keys->auth);
+	OPENSSL_cleanse(&keys->skein, sizeof(keys->skein));
+	OPENSSL_cleanse(keys->salt, sizeof(keys->salt));
+}
+
+static void srtp_ctx_dtor(ErlNifEnv* env, void* obj)
+{
+	srtp_ctx* ctx = (srtp_ctx*)obj;
+
+	free_keys(&ctx->rtp);
+	free_keys(&ctx->rtcp);
+	if (ctx->lock)
+		enif_mutex_destroy(ctx->lock);
+}
+
+/* AES-CM, RFC 3711 4.1.1. The IV is (salt * 2^16) ^ (SSRC * 2^64) ^ (index * 2^16) */
+static void aes_cm_iv(srtp_keys* keys, uint32_t ssrc, uint64_t index, uint8_t iv[16])
+{
+	int i;
+
+	memset(iv, 0, 16);
+	memcpy(iv, keys->salt, SRTP_SALT_LEN);
+	for (i = 0; i < 4; i++)
+		iv[4 + i] ^= (ssrc >> (24 - 8 * i)) & 0xFF;
+	for (i = 0; i < 6; i++)
+		iv[8 + i] ^= (index >> (40 - 8 * i)) & 0xFF;
+}
+
+static int aes_cm(srtp_keys* keys, uint32_t ssrc, uint64_t index, uint8_t* data, size_t len)
+{
+	uint8_t iv[16];
+	int outl;
+
+	aes_cm_iv(keys, ssrc, index, iv);
+
+	/* the key schedule stays, only the counter is reset */
+	return EVP_EncryptInit_ex(keys->cipher, NULL, NULL, NULL, iv) &&
+		EVP_EncryptUpdate(keys->cipher, data, &outl, data, len);
+}
+
+/*
+ * AES-GCM, RFC 7714 8 and 9. Encrypts or decrypts data in place and
+ * authenticates aad, aad2 and data in the same pass. The IV is the session
+ * salt XORed with 0x0000 || SSRC || index, index being ROC || SEQ for SRTP
+ * and the 31 bit SRTCP index for SRTCP. Returns 1, 0 if the tag doesn't
+ * match on decryption or -1 on an OpenSSL error.
+ */
+static int aes_gcm_crypt(srtp_keys* keys, int enc, uint32_t ssrc, uint64_t index,
+		const uint8_t* aad, size_t aad_len, const uint8_t* aad2, size_t aad2_len,
+		uint8_t* data, size_t len, uint8_t tag[SRTP_AEAD_TAG_LEN])
+{
+	uint8_t iv[SRTP_AEAD_SALT_LEN];
+	uint8_t last[16];
+	int outl, i;
+
+	memset(iv, 0, sizeof(iv));
+	for (i = 0; i < 4; i++)
+		iv[2 + i] = (ssrc >> (24 - 8 * i)) & 0xFF;
+	for (i = 0; i < 6; i++)
+		iv[6 + i] = (index >> (40 - 8 * i)) & 0xFF;
+	for (i = 0; i < SRTP_AEAD_SALT_LEN; i++)
+		iv[i] ^= keys->salt[i];
+
+	/* the key schedule and GHASH key stay, only the IV changes */
+	if (!EVP_CipherInit_ex(keys->cipher, NULL, NULL, NULL, iv, enc) ||
+			!EVP_CipherUpdate(keys->cipher, NULL, &outl, aad, aad_len) ||
+			(aad2_len && !EVP_CipherUpdate(keys->cipher, NULL, &outl, aad2, aad2_len)) ||
+			(len && !EVP_CipherUpdate(keys->cipher, data, &outl, data, len)))
+		return -1;
+
+	if (enc)
+		return EVP_CipherFinal_ex(keys->cipher, last, &outl) &&
+			EVP_CIPHER_CTX_ctrl(keys->cipher, EVP_CTRL_GCM_GET_TAG, SRTP_AEAD_TAG_LEN, tag) ? 1 : -1;
+
+	if (!EVP_CIPHER_CTX_ctrl(keys->cipher, EVP_CTRL_GCM_SET_TAG, SRTP_AEAD_TAG_LEN, tag))
+		return -1;
+	return EVP_CipherFinal_ex(keys->cipher, last, &outl) > 0;
+}
+
+static int auth_tag(srtp_ctx* ctx, srtp_keys* keys, const uint8_t* data, size_t len,
+		const uint8_t* extra, size_t extra_len, uint8_t tag[HMAC_SHA1_SIZE])
+{
+	if (ctx->aalg == SRTP_AUTHENTICATION_SKEIN) {
+		skein512_mac_run(&keys->skein, data, len, extra, extra_len, tag);
+		return 1;
+	}
+
+	return hmac_sha1_start(&keys->auth) &&
+		hmac_sha1_update(&keys->auth, data, len) &&
+		(extra_len == 0 || hmac_sha1_update(&keys->auth, extra, extra_len)) &&
+		hmac_sha1_final(&keys->auth, tag);
+}
+
+static inline uint32_t get_u32(const uint8_t* p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void put_u32(uint8_t* p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+/* Returns the header length (incl. CSRCs and extension) or 0 if malformed */
+static size_t rtp_header_len(const uint8_t* p, size_t len)
+{
+	size_t hlen;
+
+	if (len < RTP_HEADER_LEN || (p[0] >> 6) != 2)
+		return 0;
+
+	hlen = RTP_HEADER_LEN + 4 * (p[0] & 0x0F);
+	if (p[0] & 0x10) {
+		if (len < hlen + 4)
+			return 0;
+		hlen += 4 + 4 * (((size_t)p[hlen + 2] << 8) | p[hlen + 3]);
+	}
+
+	return hlen <= len ? hlen : 0;
+}
+
+/* RFC 3711 3.3.1 and Appendix A */
+static uint32_t guess_roc(srtp_ctx* ctx, uint16_t seq)
+{
+	if (!ctx->s_l_set)
+		return ctx->roc;
+
+	if (ctx->s_l < 32768) {
+		if ((int)seq - (int)ctx->s_l > 32768 && ctx->roc > 0)
+			return ctx->roc - 1;
+	}
+	else if ((int)ctx->s_l - 32768 > (int)seq)
+		return ctx->roc + 1;
+
+	return ctx->roc;
+}
+
+static void update_roc(srtp_ctx* ctx, uint16_t seq, uint32_t v)
+{
+	if (!ctx->s_l_set || v > ctx->roc) {
+		ctx->roc = v;
+		ctx->s_l = seq;
+		ctx->s_l_set = 1;
+	}
+	else if (v == ctx->roc && seq > ctx->s_l)
+		ctx->s_l = seq;
+}
+
+static inline int replay_bit(const replay_window* w, uint64_t index)
+{
+	return (w->bits[(index / 64) % SRTP_REPLAY_WORDS] >> (index % 64)) & 1;
+}
+
+/* 1 if index hasn't been seen and isn't older than the window */
+static int replay_check(const replay_window* w, uint64_t index)
+{
+	if (!w->started || index > w->top)
+		return 1;
+	if (w->top - index >= SRTP_REPLAY_WINDOW)
+		return 0;
+	return !replay_bit(w, index);
+}
+
+/* only once the packet is authenticated, forgeries mustn't move the window */
+static void replay_add(replay_window* w, uint64_t index)
+{
+	uint64_t i;
+
+	if (!w->started || index >= w->top + SRTP_REPLAY_WINDOW) {
+		memset(w->bits, 0, sizeof(w->bits));
+		w->top = index;
+		w->started = 1;
+	}
+	else if (index > w->top) {
+		for (i = w->top + 1; i < index; i++)
+			w->bits[(i / 64) % SRTP_REPLAY_WORDS] &= ~((uint64_t)1 << (i % 64));
+		w->top = index;
+	}
+
+	w->bits[(index / 64) % SRTP_REPLAY_WORDS] |= (uint64_t)1 << (index % 64);
+}
+
+static ERL_NIF_TERM error(ErlNifEnv* env, ERL_NIF_TERM reason)
+{
+	return enif_make_tuple2(env, atom_error, reason);
+}
+
+/*
+ * The AEAD transforms, RFC 7714. The whole packet goes through OpenSSL once
+ * instead of an AES-CM pass and an HMAC pass, and the tag is always
+ * SRTP_AEAD_TAG_LEN.
+ */
+static ERL_NIF_TERM do_protect_gcm(ErlNifEnv* env, srtp_ctx* ctx, ErlNifBinary* in)
+{
+	ERL_NIF_TERM result;
+	uint8_t* out;
+	size_t hlen;
+	uint16_t seq;
+	uint32_t v;
+
+	if (!(hlen = rtp_header_len(in->data, in->size)))
+		return error(env, atom_bad_packet);
+
+	seq = ((uint16_t)in->data[2] << 8) | in->data[3];
+	v = guess_roc(ctx, seq);
+
+	out = enif_make_new_binary(env, in->size + SRTP_AEAD_TAG_LEN, &result);
+	memcpy(out, in->data, in->size);
+
+	if (aes_gcm_crypt(&ctx->rtp, 1, get_u32(out + 8), ((uint64_t)v << 16) | seq,
+				out, hlen, NULL, 0, out + hlen, in->size - hlen, out + in->size) < 0)
+		return error(env, atom_crypto_error);
+
+	update_roc(ctx, seq, v);
+	return enif_make_tuple2(env, atom_ok, result);
+}
+
+static ERL_NIF_TERM do_unprotect_gcm(ErlNifEnv* env, srtp_ctx* ctx, ErlNifBinary* in)
+{
+	ERL_NIF_TERM result;
+	uint8_t* out;
+	size_t hlen, len;
+	uint16_t seq;
+	uint32_t v;
+	uint64_t index;
+	int ret;
+
+	if (in->size < SRTP_AEAD_TAG_LEN || !(hlen = rtp_header_len(in->data, in->size - SRTP_AEAD_TAG_LEN)))
+		return error(env, atom_bad_packet);
+
+	len = in->size - SRTP_AEAD_TAG_LEN;
+	seq = ((uint16_t)in->data[2] << 8) | in->data[3];
+	v = guess_roc(ctx, seq);
+	index = ((uint64_t)v << 16) | seq;
+
+	if (!replay_check(&ctx->rtp_replay, index))
+		return error(env, atom_replayed);
+
+	out = enif_make_new_binary(env, len, &result);
+	memcpy(out, in->data, len);
+
+	ret = aes_gcm_crypt(&ctx->rtp, 0, get_u32(out + 8), index,
+			out, hlen, NULL, 0, out + hlen, len - hlen, in->data + len);
+	if (ret < 0)
+		return error(env, atom_crypto_error);
+	if (!ret)
+		return error(env, atom_auth_failed);
+
+	replay_add(&ctx->rtp_replay, index);
+	update_roc(ctx, seq, v);
+	return enif_make_tuple2(env, atom_ok, result);
+}
+
+/* the tag goes before the E || SRTCP index word, which is part of the AAD */
+static ERL_NIF_TERM do_protect_rtcp_gcm(ErlNifEnv* env, srtp_ctx* ctx, ErlNifBinary* in)
+{
+	ERL_NIF_TERM result;
+	uint8_t* out;
+	uint8_t* trailer;
+
+	if (in->size < RTCP_HEADER_LEN || (in->data[0] >> 6) != 2)
+		return error(env, atom_bad_packet);
+
+	out = enif_make_new_binary(env, in->size + SRTP_AEAD_TAG_LEN + SRTCP_INDEX_LEN, &result);
+	memcpy(out, in->data, in->size);
+	trailer = out + in->size + SRTP_AEAD_TAG_LEN;
+	put_u32(trailer, ctx->rtcp_index | 0x80000000);
+
+	if (aes_gcm_crypt(&ctx->rtcp, 1, get_u32(out + 4), ctx->rtcp_index,
+				out, RTCP_HEADER_LEN, trailer, SRTCP_INDEX_LEN,
+				out + RTCP_HEADER_LEN, in->size - RTCP_HEADER_LEN, out + in->size) < 0)
+		return error(env, atom_crypto_error);
+
+	ctx->rtcp_index = (ctx->rtcp_index + 1) & 0x7FFFFFFF;
+	return enif_make_tuple2(env, atom_ok, result);
+}
+
+static ERL_NIF_TERM do_unprotect_rtcp_gcm(ErlNifEnv* env, srtp_ctx* ctx, ErlNifBinary* in)
+{
+	ERL_NIF_TERM result;
+	const uint8_t* trailer;
+	uint8_t* out;
+	size_t len;
+	uint32_t index;
+	int ret;
+
+	if (in->size < RTCP_HEADER_LEN + SRTP_AEAD_TAG_LEN + SRTCP_INDEX_LEN || (in->data[0] >> 6) != 2)
+		return error(env, atom_bad_packet);
+
+	len = in->size - SRTP_AEAD_TAG_LEN - SRTCP_INDEX_LEN;
+	trailer = in->data + len + SRTP_AEAD_TAG_LEN;
+	index = get_u32(trailer);
+
+	if (!replay_check(&ctx->rtcp_replay, index & 0x7FFFFFFF))
+		return error(env, atom_replayed);
+
+	out = enif_make_new_binary(env, len, &result);
+	memcpy(out, in->data, len);
+
+	/* unencrypted SRTCP is authenticated as a whole */
+	if (index & 0x80000000)
+		ret = aes_gcm_crypt(&ctx->rtcp, 0, get_u32(out + 4), index & 0x7FFFFFFF,
+				out, RTCP_HEADER_LEN, trailer, SRTCP_INDEX_LEN,
+				out + RTCP_HEADER_LEN, len - RTCP_HEADER_LEN, in->data + len);
+	else
+		ret = aes_gcm_crypt(&ctx->rtcp, 0, get_u32(out + 4), index,
+				out, len, trailer, SRTCP_INDEX_LEN, NULL, 0, in->data + len);
+	if (ret < 0)
+		return error(env, atom_crypto_error);
+	if (!ret)
+		return error(env, atom_auth_failed);
+
+	replay_add(&ctx->rtcp_replay, index & 0x7FFFFFFF);
+	return enif_make_tuple2(env, atom_ok, result);
+}
+
+/*
+ * An SRTP packet between the state bookkeeping and the AES-CM pass. The
+ * single packet calls and the batches both go through *_start(), which does
+ * everything touching the context state (ROC, replay window, the HMAC for
+ * unprotect) and leaves the keystream to the caller.
+ */
+typedef struct {
+	srtp_ctx* ctx;
+	int pending;
+	ERL_NIF_TERM result;
+	/* the packet being built, len bytes without the tag */
+	uint8_t* out;
+	size_t len;
+	size_t hlen;
+	uint32_t ssrc;
+	uint32_t roc;
+	uint64_t index;
+	/* offset of the keystream in a batch */
+	size_t ks;
+} srtp_item;
+
+/* Returns the result term, with item->pending set if the payload still has to be encrypted and tagged */
+static ERL_NIF_TERM protect_start(ErlNifEnv* env, srtp_ctx* ctx, ErlNifBinary* in, srtp_item* item)
+{
+	size_t hlen, tlen;
+	uint16_t seq;
+	uint32_t v;
+
+	item->ctx = ctx;
+	item->pending = 0;
+
+	if (!(hlen = rtp_header_len(in->data, in->size)))
+		return error(env, atom_bad_packet);
+
+	tlen = ctx->aalg == SRTP_AUTHENTICATION_NULL ? 0 : ctx->tag_length;
+	seq = ((uint16_t)in->data[2] << 8) | in->data[3];
+	v = guess_roc(ctx, seq);
+
+	item->out = enif_make_new_binary(env, in->size + tlen, &item->result);
+	memcpy(item->out, in->data, in->size);
+	item->len = in->size;
+	item->hlen = hlen;
+	item->ssrc = get_u32(in->data + 8);
+	item->roc = v;
+	item->index = ((uint64_t)v << 16) | seq;
+	item->pending = 1;
+
+	update_roc(ctx, seq, v);
+	item->result = enif_make_tuple2(env, atom_ok, item->result);
+	return item->result;
+}
+
+/* the tag, once the payload is encrypted */
+static ERL_NIF_TERM protect_finish(ErlNifEnv* env, srtp_item* item)
+{
+	uint8_t roc[4];
+	uint8_t tag[HMAC_SHA1_SIZE];
+	srtp_ctx* ctx = item->ctx;
+
+	if (ctx->aalg != SRTP_AUTHENTICATION_NULL) {
+		put_u32(roc, item->roc);
+		if (!auth_tag(ctx, &ctx->rtp, item->out, item->len, roc, sizeof(roc), tag))
+			return error(env, atom_crypto_error);
+		memcpy(item->out + item->len, tag, ctx->tag_length);
+	}
+
+	return item->result;
+}
+
+static ERL_NIF_TERM do_protect(ErlNifEnv* env, srtp_ctx* ctx, ErlNifBinary* in)
+{
+	srtp_item item;
+	ERL_NIF_TERM ret;
+
+	if (ctx->ealg == SRTP_ENCRYPTION_AESGCM)
+		return do_protect_gcm(env, ctx, in);
+
+	ret = protect_start(env, ctx, in, &item);
+	if (!item.pending)
+		return ret;
+
+	if (ctx->ealg == SRTP_ENCRYPTION_AESCM &&
+			!aes_cm(&ctx->rtp, item.ssrc, item.index, item.out + item.hlen, item.len - item.hlen))
+		return error(env, atom_crypto_error);
+
+	return protect_finish(env, &item);
+}
+
+/*
+ * Checks, authenticates and accepts the packet into the replay window and
+ * ROC, leaving only the decryption. Authenticating first means nothing is
+ * spent on decrypting forgeries.
+ */
+static ERL_NIF_TERM unprotect_start(ErlNifEnv* env, srtp_ctx* ctx, ErlNifBinary* in, srtp_item* item)
+{
+	uint8_t roc[4];
+	uint8_t tag[HMAC_SHA1_SIZE];
+	size_t hlen, tlen, len;
+	uint16_t seq;
+	uint32_t v;
+	uint64_t index;
+
+	item->ctx = ctx;
+	item->pending = 0;
+
+	tlen = ctx->aalg == SRTP_AUTHENTICATION_NULL ? 0 : ctx->tag_length;
+	if (in->size < tlen || !(hlen = rtp_header_len(in->data, in->size - tlen)))
+		return error(env, atom_bad_packet);
+
+	len = in->size - tlen;
+	seq = ((uint16_t)in->data[2] << 8) | in->data[3];
+	v = guess_roc(ctx, seq);
+	index = ((uint64_t)v << 16) | seq;
+
+	if (!replay_check(&ctx->rtp_replay, index))
+		return error(env, atom_replayed);
+
+	if (tlen) {
+		put_u32(roc, v);
+		if (!auth_tag(ctx, &ctx->rtp, in->data, len, roc, sizeof(roc), tag))
+			return error(env, atom_crypto_error);
+		if (CRYPTO_memcmp(tag, in->data + len, tlen) != 0)
+			return error(env, atom_auth_failed);
+	}
+
+	item->out = enif_make_new_binary(env, len, &item->result);
+	memcpy(item->out, in->data, len);
+	item->len = len;
+	item->hlen = hlen;
+	item->ssrc = get_u32(in->data + 8);
+	item->roc = v;
+	item->index = index;
+	item->pending = 1;
+
+	replay_add(&ctx->rtp_replay, index);
+	update_roc(ctx, seq, v);
+	item->result = enif_make_tuple2(env, atom_ok, item->result);
+	return item->result;
+}
+
+static ERL_NIF_TERM do_unprotect(ErlNifEnv* env, srtp_ctx* ctx, ErlNifBinary* in)
+{
+	srtp_item item;
+	ERL_NIF_TERM ret;
+
+	if (ctx->ealg == SRTP_ENCRYPTION_AESGCM)
+		return do_unprotect_gcm(env, ctx, in);
+
+	ret = unprotect_start(env, ctx, in, &item);
+	if (!item.pending)
+		return ret;
+
+	if (ctx->ealg == SRTP_ENCRYPTION_AESCM &&
+			!aes_cm(&ctx->rtp, item.ssrc, item.index, item.out + item.hlen, item.len - item.hlen))
+		return error(env, atom_crypto_error);
+
+	return ret;
+}
+
+static ERL_NIF_TERM do_protect_rtcp(ErlNifEnv* env, srtp_ctx* ctx, ErlNifBinary* in)
+{
+	ERL_NIF_TERM result;
+	uint8_t tag[HMAC_SHA1_SIZE];
+	uint8_t* out;
+	size_t tlen;
+	uint32_t index;
+
+	if (ctx->ealg == SRTP_ENCRYPTION_AESGCM)
+		return do_protect_rtcp_gcm(env, ctx, in);
+
+	if (in->size < RTCP_HEADER_LEN || (in->data[0] >> 6) != 2)
+		return error(env, atom_bad_packet);
+
+	tlen = ctx->aalg == SRTP_AUTHENTICATION_NULL ? 0 : ctx->tag_length;
+	index = ctx->rtcp_index;
+
+	out = enif_make_new_binary(env, in->size + SRTCP_INDEX_LEN + tlen, &result);
+	memcpy(out, in->data, in->size);
+
+	if (ctx->ealg == SRTP_ENCRYPTION_AESCM) {
+		if (!aes_cm(&ctx->rtcp, get_u32(out + 4), index, out + RTCP_HEADER_LEN, in->size - RTCP_HEADER_LEN))
+			return error(env, atom_crypto_error);
+		/* E flag */
+		index |= 0x80000000;
+	}
+	put_u32(out + in->size, index);
+
+	if (tlen) {
+		if (!auth_tag(ctx, &ctx->rtcp, out, in->size + SRTCP_INDEX_LEN, NULL, 0, tag))
+			return error(env, atom_crypto_error);
+		memcpy(out + in->size + SRTCP_INDEX_LEN, tag, tlen);
+	}
+
+	ctx->rtcp_index = (ctx->rtcp_index + 1) & 0x7FFFFFFF;
+	return enif_make_tuple2(env, atom_ok, result);
+}
+
+static ERL_NIF_TERM do_unprotect_rtcp(ErlNifEnv* env, srtp_ctx* ctx, ErlNifBinary* in)
+{
+	ERL_NIF_TERM result;
+	uint8_t tag[HMAC_SHA1_SIZE];
+	uint8_t* out;
+	size_t tlen, len;
+	uint32_t index;
+
+	if (ctx->ealg == SRTP_ENCRYPTION_AESGCM)
+		return do_unprotect_rtcp_gcm(env, ctx, in);
+
+	tlen = ctx->aalg == SRTP_AUTHENTICATION_NULL ? 0 : ctx->tag_length;
+	if (in->size < RTCP_HEADER_LEN + SRTCP_INDEX_LEN + tlen || (in->data[0] >> 6) != 2)
+		return error(env, atom_bad_packet);
+
+	len = in->size - tlen - SRTCP_INDEX_LEN;
+	index = get_u32(in->data + len);
+
+	if (!replay_check(&ctx->rtcp_replay, index & 0x7FFFFFFF))
+		return error(env, atom_replayed);
+
+	if (tlen) {
+		if (!auth_tag(ctx, &ctx->rtcp, in->data, len + SRTCP_INDEX_LEN, NULL, 0, tag))
+			return error(env, atom_crypto_error);
+		if (CRYPTO_memcmp(tag, in->data + len + SRTCP_INDEX_LEN, tlen) != 0)
+			return error(env, atom_auth_failed);
+	}
+
+	out = enif_make_new_binary(env, len, &result);
+	memcpy(out, in->data, len);
+
+	if (index & 0x80000000) {
+		if (ctx->ealg != SRTP_ENCRYPTION_AESCM)
+			return error(env, atom_unsupported);
+		if (!aes_cm(&ctx->rtcp, get_u32(out + 4), index & 0x7FFFFFFF, out + RTCP_HEADER_LEN, len - RTCP_HEADER_LEN))
+			return error(env, atom_crypto_error);
+	}
+
+	replay_add(&ctx->rtcp_replay, index & 0x7FFFFFFF);
+	return enif_make_tuple2(env, atom_ok, result);
+}
+
+static ERL_NIF_TERM srtp_new(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	int ealg, aalg;
+	unsigned int tag_length;
+	ErlNifBinary key, salt;
+	uint8_t master_salt[SRTP_SALT_LEN];
+	srtp_ctx* ctx;
+	ERL_NIF_TERM term;
+
+	if (!enif_get_int(env, argv[0], &ealg) || !enif_get_int(env, argv[1], &aalg) ||
+			!enif_inspect_binary(env, argv[2], &key) || !enif_inspect_binary(env, argv[3], &salt) ||
+			!enif_get_uint(env, argv[4], &tag_length))
+		return enif_make_badarg(env);
+
+	if (ealg == SRTP_ENCRYPTION_AESGCM) {
+		/* the GCM tag is the authentication, there's no HMAC on top */
+		if (aalg != SRTP_AUTHENTICATION_NULL || !aes_gcm(key.size) ||
+				salt.size != SRTP_AEAD_SALT_LEN || tag_length != SRTP_AEAD_TAG_LEN)
+			return error(env, atom_unsupported);
+	}
+	else if ((ealg != SRTP_ENCRYPTION_NULL && ealg != SRTP_ENCRYPTION_AESCM) ||
+			(aalg != SRTP_AUTHENTICATION_NULL && aalg != SRTP_AUTHENTICATION_SHA1_HMAC &&
+			 aalg != SRTP_AUTHENTICATION_SKEIN) ||
+			(aalg == SRTP_AUTHENTICATION_SKEIN && tag_length == 0) ||
+			!aes_ctr(key.size) || salt.size != SRTP_SALT_LEN || tag_length > SRTP_MAX_TAG_LEN)
+		return error(env, atom_unsupported);
+
+	/* the 96 bit AEAD master salt goes into the KDF zero padded */
+	memset(master_salt, 0, sizeof(master_salt));
+	memcpy(master_salt, salt.data, salt.size);
+
+	ctx = (srtp_ctx*)enif_alloc_resource(srtp_ctx_type, sizeof(srtp_ctx));
+	memset(ctx, 0, sizeof(srtp_ctx));
+	ctx->ealg = ealg;
+	ctx->aalg = aalg;
+	ctx->tag_length = tag_length;
+
+	if (!setup_keys(ctx, &ctx->rtp, key.data, key.size, master_salt, SRTP_LABEL_RTP_ENCR) ||
+			!setup_keys(ctx, &ctx->rtcp, key.data, key.size, master_salt, SRTP_LABEL_RTCP_ENCR) ||
+			!(ctx->lock = enif_mutex_create((char*)"srtp_ctx"))) {
+		enif_release_resource(ctx);
+		return error(env, atom_crypto_error);
+	}
+
+	term = enif_make_resource(env, ctx);
+	enif_release_resource(ctx);
+
+	return enif_make_tuple2(env, atom_ok, term);
+}
+
+typedef ERL_NIF_TERM (*srtp_op)(ErlNifEnv*, srtp_ctx*, ErlNifBinary*);
+
+static ERL_NIF_TERM run_op(ErlNifEnv* env, const ERL_NIF_TERM argv[], srtp_op op)
+{
+	srtp_ctx* ctx;
+	ErlNifBinary in;
+	ERL_NIF_TERM ret;
+
+	if (!enif_get_resource(env, argv[0], srtp_ctx_type, (void**)&ctx) ||
+			!enif_inspect_binary(env, argv[1], &in))
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(ctx->lock);
+	ret = op(env, ctx, &in);
+	enif_mutex_unlock(ctx->lock);
+
+	return ret;
+}
+
+static ERL_NIF_TERM srtp_protect(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	return run_op(env, argv, do_protect);
+}
+
+static ERL_NIF_TERM srtp_unprotect(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	return run_op(env, argv, do_unprotect);
+}
+
+static ERL_NIF_TERM srtp_protect_rtcp(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	return run_op(env, argv, do_protect_rtcp);
+}
+
+static ERL_NIF_TERM srtp_unprotect_rtcp(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	return run_op(env, argv, do_unprotect_rtcp);
+}
+
+/*
+ * Skein-MAC on its own, for the Elixir SRTP path and ZRTP. The resource is
+ * the keyed state and never changes once made, so it needs no lock.
+ */
+static void skein_mac_dtor(ErlNifEnv* env, void* obj)
+{
+	OPENSSL_cleanse(obj, sizeof(skein512_mac));
+}
+
+static ERL_NIF_TERM skein_mac_new(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	ErlNifBinary key;
+	unsigned int tag_length;
+	skein512_mac* mac;
+	ERL_NIF_TERM term;
+
+	if (!enif_inspect_binary(env, argv[0], &key) || !enif_get_uint(env, argv[1], &tag_length) ||
+			tag_length == 0 || tag_length > SKEIN512_BLOCK)
+		return enif_make_badarg(env);
+
+	mac = (skein512_mac*)enif_alloc_resource(skein_mac_type, sizeof(skein512_mac));
+	skein512_mac_init(mac, key.data, key.size, tag_length);
+
+	term = enif_make_resource(env, mac);
+	enif_release_resource(mac);
+
+	return term;
+}
+
+static ERL_NIF_TERM skein_mac(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	skein512_mac* mac;
+	ErlNifBinary data, extra;
+	ERL_NIF_TERM result;
+
+	if (!enif_get_resource(env, argv[0], skein_mac_type, (void**)&mac) ||
+			!enif_inspect_binary(env, argv[1], &data) || !enif_inspect_binary(env, argv[2], &extra))
+		return enif_make_badarg(env);
+
+	skein512_mac_run(mac, data.data, data.size, extra.data, extra.size,
+			enif_make_new_binary(env, mac->out_len, &result));
+
+	return result;
+}
+
+/*
+ * Batches of {ctx, packet}. The state bookkeeping runs packet by packet in
+ * list order, as for single calls. The AES-CM packets are then grouped by
+ * context and the counter blocks of a whole group are encrypted with one
+ * AES-ECB call, so AES-NI pipelines blocks from many short packets instead
+ * of running one CTR stream per packet. GCM and NULL packets are handled by
+ * the single packet path.
+ */
+typedef ERL_NIF_TERM (*srtp_start)(ErlNifEnv*, srtp_ctx*, ErlNifBinary*, srtp_item*);
+
+static int item_cmp(const void* a, const void* b)
+{
+	const srtp_item* x = *(const srtp_item* const*)a;
+	const srtp_item* y = *(const srtp_item* const*)b;
+
+	if (x->ctx != y->ctx)
+		return x->ctx < y->ctx ? -1 : 1;
+	/* the items are one array, this keeps the list order within a context */
+	return x < y ? -1 : x > y;
+}
+
+static inline size_t cm_blocks(const srtp_item* item)
+{
+	return (item->len - item->hlen + 15) / 16;
+}
+
+/* AES-CM for the items [first, last) of one context, ks has room for all their blocks */
+static int batch_keystream(srtp_item** first, srtp_item** last, uint8_t* ks)
+{
+	srtp_keys* keys = &(*first)->ctx->rtp;
+	srtp_item** it;
+	uint8_t* p = ks;
+	uint8_t* payload;
+	size_t i, n;
+	int outl;
+
+	for (it = first; it < last; it++) {
+		(*it)->ks = p - ks;
+		n = cm_blocks(*it);
+		for (i = 0; i < n; i++, p += 16) {
+			aes_cm_iv(keys, (*it)->ssrc, (*it)->index, p);
+			p[14] = (i >> 8) & 0xFF;
+			p[15] = i & 0xFF;
+		}
+	}
+
+	if (p > ks && !EVP_EncryptUpdate(keys->ecb, ks, &outl, ks, p - ks))
+		return 0;
+
+	for (it = first; it < last; it++) {
+		payload = (*it)->out + (*it)->hlen;
+		n = (*it)->len - (*it)->hlen;
+		for (i = 0; i < n; i++)
+			payload[i] ^= ks[(*it)->ks + i];
+	}
+
+	return 1;
+}
+
+/* {ctx, packet} */
+static int get_pair(ErlNifEnv* env, ERL_NIF_TERM term, srtp_ctx** ctx, ErlNifBinary* in)
+{
+	const ERL_NIF_TERM* pair;
+	int arity;
+
+	return enif_get_tuple(env, term, &arity, &pair) && arity == 2 &&
+		enif_get_resource(env, pair[0], srtp_ctx_type, (void**)ctx) &&
+		enif_inspect_binary(env, pair[1], in);
+}
+
+static ERL_NIF_TERM run_batch(ErlNifEnv* env, ERL_NIF_TERM list, srtp_start start, int protect)
+{
+	unsigned int n, i, j, pending = 0;
+	ERL_NIF_TERM head, rest, ret;
+	ErlNifBinary in;
+	srtp_ctx* ctx;
+	srtp_item* items;
+	srtp_item** order;
+	size_t blocks = 0;
+	uint8_t* ks;
+
+	if (!enif_get_list_length(env, list, &n))
+		return enif_make_badarg(env);
+
+	/* check the whole list before the state of any context moves */
+	for (rest = list; enif_get_list_cell(env, rest, &head, &rest); )
+		if (!get_pair(env, head, &ctx, &in))
+			return enif_make_badarg(env);
+
+	items = (srtp_item*)enif_alloc(n * sizeof(srtp_item) + 1);
+	order = (srtp_item**)enif_alloc(n * sizeof(srtp_item*) + 1);
+	if (!items || !order) {
+		if (items)
+			enif_free(items);
+		if (order)
+			enif_free(order);
+		return enif_make_badarg(env);
+	}
+
+	for (i = 0; enif_get_list_cell(env, list, &head, &list); i++) {
+		get_pair(env, head, &ctx, &in);
+
+		enif_mutex_lock(ctx->lock);
+		if (ctx->ealg == SRTP_ENCRYPTION_AESCM)
+			items[i].result = start(env, ctx, &in, &items[i]);
+		else {
+			items[i].result = protect ? do_protect(env, ctx, &in) : do_unprotect(env, ctx, &in);
+			items[i].pending = 0;
+		}
+		enif_mutex_unlock(ctx->lock);
+
+		if (items[i].pending) {
+			order[pending++] = &items[i];
+			blocks += cm_blocks(&items[i]);
+		}
+	}
+
+	qsort(order, pending, sizeof(srtp_item*), item_cmp);
+	ks = (uint8_t*)enif_alloc(blocks * 16 + 1);
+
+	for (i = 0; i < pending; i = j) {
+		ctx = order[i]->ctx;
+		for (j = i + 1; j < pending && order[j]->ctx == ctx; j++)
+			;
+
+		enif_mutex_lock(ctx->lock);
+		if (!ks || !batch_keystream(order + i, order + j, ks)) {
+			for (; i < j; i++)
+				order[i]->result = error(env, atom_crypto_error);
+		}
+		else if (protect) {
+			for (; i < j; i++)
+				order[i]->result = protect_finish(env, order[i]);
+		}
+		enif_mutex_unlock(ctx->lock);
+	}
+
+	ret = enif_make_list(env, 0);
+	for (i = n; i > 0; i--)
+		ret = enif_make_list_cell(env, items[i - 1].result, ret);
+
+	if (ks)
+		enif_free(ks);
+	enif_free(items);
+	enif_free(order);
+
+	return ret;
+}
+
+static ERL_NIF_TERM srtp_protect_batch(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	return run_batch(env, argv[0], protect_start, 1);
+}
+
+static ERL_NIF_TERM srtp_unprotect_batch(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	return run_batch(env, argv[0], unprotect_start, 0);
+}
+
+static int load(ErlNifEnv* env, void** priv_data, ERL_NIF_TERM load_info)
+{
+	srtp_ctx_type = enif_open_resource_type(env, NULL, "srtp_ctx",
+			srtp_ctx_dtor, ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, NULL);
+	skein_mac_type = enif_open_resource_type(env, NULL, "skein_mac",
+			skein_mac_dtor, ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, NULL);
+	if (!srtp_ctx_type || !skein_mac_type)
+		return -1;
+
+	atom_ok = enif_make_atom(env, "ok");
+	atom_error = enif_make_atom(env, "error");
+	atom_unsupported = enif_make_atom(env, "unsupported");
+	atom_bad_packet = enif_make_atom(env, "bad_packet");
+	atom_auth_failed = enif_make_atom(env, "auth_failed");
+	atom_crypto_error = enif_make_atom(env, "crypto_error");
+	atom_replayed = enif_make_atom(env, "replayed");
+
+	return 0;
+}
+
+static int upgrade(ErlNifEnv* env, void** priv_data, void** old_priv_data, ERL_NIF_TERM load_info)
+{
+	return load(env, priv_data, load_info);
+}
+
+static ErlNifFunc nif_funcs[] =
+{
+	{"new", 5, srtp_new, 0},
+	{"protect", 2, srtp_protect, 0},
+	{"unprotect", 2, srtp_unprotect, 0},
+	{"protect_rtcp", 2, srtp_protect_rtcp, 0},
+	{"unprotect_rtcp", 2, srtp_unprotect_rtcp, 0},
+	/* a batch can be arbitrarily long */
+	{"protect_batch", 1, srtp_protect_batch, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+	{"unprotect_batch", 1, srtp_unprotect_batch, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+	{"skein_mac_new", 2, skein_mac_new, 0},
+	{"skein_mac", 3, skein_mac, 0}
+};
+
+ERL_NIF_INIT(Elixir.XMediaLib.Srtp.Native,nif_funcs,load,NULL,upgrade,NULL)
@@ -0,0 +1,435 @@
+/* ----------------------------------------------------------------------
+ *
+ * Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+ * for his excellent work in this area.
+ *
+ * @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+ *
+ * Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+ *
+ * Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+ *
+ * All rights reserved.
+ *
+ * XMediaLib is licensed by Xirsys, with permission, under the Apache
+ * License Version 2.0. (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See LICENSE for the full license text.
+ *
+ * ---------------------------------------------------------------------- */
+
+
+#include <stdint.h>
+#include <string.h>
+#include <openssl/crypto.h>
+#include "erl_nif.h"
+#include "hmac_sha1.h"
+
+/*
+ * RFC 5389 fast path for the receive side. scan/2 checks the header and
+ * magic cookie, walks the attributes once and verifies FINGERPRINT and
+ * MESSAGE-INTEGRITY where they sit in the packet - the length field the
+ * checks need is fed to the hash separately instead of rewriting a copy.
+ * Attribute values are returned as sub-binaries of the packet, so nothing
+ * is copied and decoding them is left to whoever needs them.
+ *
+ * Credentials are long lived while messages come by the thousand, so the
+ * HMAC key schedule is done once per key: the precomputed SHA-1 states are
+ * kept in a bounded LRU cache keyed by the key bytes, and an integrity check
+ * or hmac_sha1/2 only hashes the message. The hashing happens in the
+ * scheduler thread's own working context, so checks with the same key run
+ * side by side and cache_lock is only held for the lookup.
+ */
+
+#define STUN_HEADER_LEN 20
+#define STUN_MAGIC_COOKIE 0x2112A442
+#define STUN_FINGERPRINT_XOR 0x5354554E
+
+#define STUN_ATTR_MESSAGE_INTEGRITY 0x0008
+#define STUN_ATTR_FINGERPRINT 0x8028
+
+#define STUN_INTEGRITY_LEN (4 + HMAC_SHA1_SIZE)
+#define STUN_FINGERPRINT_LEN 8
+
+/* credentials kept, least recently used ones are dropped beyond that */
+#define STUN_KEY_CACHE_SIZE 1024
+#define STUN_KEY_CACHE_BUCKETS 2048
+
+/*
+ * A cached key. Entries are resources so one evicted while a check is
+ * using it lives until that check releases it. The cache owns one
+ * reference, every user takes another for the time it uses the entry.
+ */
+typedef struct stun_key {
+	/* read only once set up, hashed with the _ctx calls */
+	hmac_sha1 hmac;
+	/* the rest belongs to the cache and is under cache_lock */
+	struct stun_key* next;
+	struct stun_key* lru_prev;
+	struct stun_key* lru_next;
+	uint32_t hash;
+	size_t key_len;
+	uint8_t key[];
+} stun_key;
+
+static ErlNifResourceType* stun_key_type = NULL;
+static ErlNifMutex* cache_lock = NULL;
+static stun_key* cache[STUN_KEY_CACHE_BUCKETS];
+/* most recently used first */
+static stun_key* lru_head = NULL;
+static stun_key* lru_tail = NULL;
+static unsigned int cache_count = 0;
+
+/* per thread EVP_MD_CTX for the hashing, made on first use */
+static ErlNifTSDKey work_key;
+static int work_key_created = 0;
+
+static uint32_t crc_table[256];
+
+static ERL_NIF_TERM atom_ok;
+static ERL_NIF_TERM atom_error;
+static ERL_NIF_TERM atom_true;
+static ERL_NIF_TERM atom_false;
+static ERL_NIF_TERM atom_bad_packet;
+static ERL_NIF_TERM atom_bad_fingerprint;
+static ERL_NIF_TERM atom_auth_failed;
+static ERL_NIF_TERM atom_crypto_error;
+
+static inline uint16_t get_u16(const uint8_t* p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static inline uint32_t get_u32(const uint8_t* p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* ISO-HDLC CRC-32, the one erlang:crc32/1 computes */
+static void crc32_init(void)
+{
+	uint32_t c;
+	int i, k;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (k = 0; k < 8; k++)
+			c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+		crc_table[i] = c;
+	}
+}
+
+static uint32_t crc32(const uint8_t* p, size_t len)
+{
+	uint32_t c = 0xFFFFFFFF;
+
+	while (len--)
+		c = crc_table[(c ^ *p++) & 0xFF] ^ (c >> 8);
+	return c ^ 0xFFFFFFFF;
+}
+
+static void stun_key_dtor(ErlNifEnv* env, void* obj)
+{
+	stun_key* k = (stun_key*)obj;
+
+	hmac_sha1_free(&k->hmac);
+}
+
+/* FNV-1a */
+static uint32_t key_hash(const uint8_t* key, size_t len)
+{
+	uint32_t h = 2166136261u;
+
+	while (len--)
+		h = (h ^ *key++) * 16777619u;
+	return h;
+}
+
+static void lru_unlink(stun_key* k)
+{
+	if (k->lru_prev)
+		k->lru_prev->lru_next = k->lru_next;
+	else
+		lru_head = k->lru_next;
+	if (k->lru_next)
+		k->lru_next->lru_prev = k->lru_prev;
+	else
+		lru_tail = k->lru_prev;
+	k->lru_prev = k->lru_next = NULL;
+}
+
+static void lru_push(stun_key* k)
+{
+	k->lru_next = lru_head;
+	if (lru_head)
+		lru_head->lru_prev = k;
+	else
+		lru_tail = k;
+	lru_head = k;
+}
+
+static void cache_evict(stun_key* k)
+{
+	stun_key** p = &cache[k->hash % STUN_KEY_CACHE_BUCKETS];
+
+	while (*p != k)
+		p = &(*p)->next;
+	*p = k->next;
+	lru_unlink(k);
+	cache_count--;
+	enif_release_resource(k);
+}
+
+/*
+ * The cached state for key, set up on a miss. The caller gets its own
+ * reference and gives it back with enif_release_resource. NULL if the key
+ * schedule couldn't be set up.
+ */
+static stun_key* key_get(const uint8_t* key, size_t len)
+{
+	uint32_t h = key_hash(key, len);
+	stun_key** bucket = &cache[h % STUN_KEY_CACHE_BUCKETS];
+	stun_key* k;
+
+	enif_mutex_lock(cache_lock);
+
+	for (k = *bucket; k; k = k->next)
+		if (k->hash == h && k->key_len == len && !memcmp(k->key, key, len))
+			break;
+
+	if (k) {
+		if (k != lru_head) {
+			lru_unlink(k);
+			lru_push(k);
+		}
+	}
+	else {
+		k = (stun_key*)enif_alloc_resource(stun_key_type, sizeof(stun_key) + len);
+		memset(k, 0, sizeof(stun_key));
+		if (!hmac_sha1_init(&k->hmac, key, len)) {
+			enif_mutex_unlock(cache_lock);
+			enif_release_resource(k);
+			return NULL;
+		}
+		k->hash = h;
+		k->key_len = len;
+		memcpy(k->key, key, len);
+
+		k->next = *bucket;
+		*bucket = k;
+		lru_push(k);
+		if (++cache_count > STUN_KEY_CACHE_SIZE)
+			cache_evict(lru_tail);
+	}
+
+	enif_keep_resource(k);
+	enif_mutex_unlock(cache_lock);
+
+	return k;
+}
+
+/*
+ * The calling thread's working context. Scheduler threads live as long as
+ * the VM, so there are only ever a handful of these.
+ */
+static EVP_MD_CTX* thread_work(void)
+{
+	EVP_MD_CTX* work = (EVP_MD_CTX*)enif_tsd_get(work_key);
+
+	if (!work && (work = EVP_MD_CTX_new()))
+		enif_tsd_set(work_key, work);
+	return work;
+}
+
+/*
+ * RFC 5389 15.4, the HMAC covers everything before the attribute with the
+ * header length as if MESSAGE-INTEGRITY ended the message. Returns 1 if it
+ * matches, 0 if not and -1 if OpenSSL failed.
+ */
+static int check_integrity(const uint8_t* msg, size_t off, const ErlNifBinary* key)
+{
+	stun_key* k;
+	EVP_MD_CTX* work;
+	uint8_t len[2];
+	uint8_t mac[HMAC_SHA1_SIZE];
+	size_t l = off + STUN_INTEGRITY_LEN - STUN_HEADER_LEN;
+	int ok;
+
+	if (!(work = thread_work()) || !(k = key_get(key->data, key->size)))
+		return -1;
+
+	len[0] = l >> 8;
+	len[1] = l;
+	ok = hmac_sha1_start_ctx(&k->hmac, work) &&
+		hmac_sha1_update_ctx(work, msg, 2) &&
+		hmac_sha1_update_ctx(work, len, 2) &&
+		hmac_sha1_update_ctx(work, msg + 4, off - 4) &&
+		hmac_sha1_final_ctx(&k->hmac, work, mac);
+	enif_release_resource(k);
+
+	if (!ok)
+		return -1;
+	return CRYPTO_memcmp(mac, msg + off + 4, HMAC_SHA1_SIZE) == 0;
+}
+
+static ERL_NIF_TERM error(ErlNifEnv* env, ERL_NIF_TERM reason)
+{
+	return enif_make_tuple2(env, atom_error, reason);
+}
+
+/*
+ * scan(Packet, Key) -> {ok, Type, TransactionId, [{AttrType, Value}],
+ * Fingerprint, Integrity}. Key is nil when the message isn't authenticated,
+ * MESSAGE-INTEGRITY is then returned as an ordinary attribute. FINGERPRINT
+ * and a checked MESSAGE-INTEGRITY are left out of the list.
+ *
+ * Like the Elixir decoder before it, the walk is lenient: a header length
+ * that disagrees with the packet is left to the caller, and an attribute
+ * running past the end is cut short. Only FINGERPRINT and MESSAGE-INTEGRITY
+ * have to be whole, as the bytes they cover are checked.
+ */
+static ERL_NIF_TERM stun_scan(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	ErlNifBinary pkt, key;
+	ERL_NIF_TERM attrs, attr;
+	const uint8_t* p;
+	size_t off, next, len;
+	uint16_t type;
+	int has_key, fingerprint = 0, integrity = 0, ret;
+
+	if (!enif_inspect_binary(env, argv[0], &pkt))
+		return enif_make_badarg(env);
+	has_key = enif_inspect_iolist_as_binary(env, argv[1], &key);
+	p = pkt.data;
+
+	if (pkt.size < STUN_HEADER_LEN || (p[0] & 0xC0) ||
+			get_u32(p + 4) != STUN_MAGIC_COOKIE)
+		return error(env, atom_bad_packet);
+
+	attrs = enif_make_list(env, 0);
+	for (off = STUN_HEADER_LEN; off + 4 <= pkt.size; off = next) {
+		type = get_u16(p + off);
+		len = get_u16(p + off + 2);
+		if (off + 4 + len > pkt.size)
+			len = pkt.size - off - 4;
+		/* values are padded to 32 bits, some stacks leave it off the last one */
+		next = (off + 4 + len + 3) & ~(size_t)3;
+		if (next > pkt.size)
+			next = pkt.size;
+
+		if (type == STUN_ATTR_FINGERPRINT) {
+			if (get_u16(p + off + 2) != 4 || off + STUN_FINGERPRINT_LEN != pkt.size)
+				return error(env, atom_bad_packet);
+			if ((crc32(p, off) ^ STUN_FINGERPRINT_XOR) != get_u32(p + off + 4))
+				return error(env, atom_bad_fingerprint);
+			fingerprint = 1;
+			continue;
+		}
+
+		/* anything but FINGERPRINT after MESSAGE-INTEGRITY is ignored */
+		if (integrity)
+			continue;
+
+		if (type == STUN_ATTR_MESSAGE_INTEGRITY && has_key) {
+			if (get_u16(p + off + 2) != HMAC_SHA1_SIZE || off + STUN_INTEGRITY_LEN > pkt.size)
+				return error(env, atom_bad_packet);
+			ret = check_integrity(p, off, &key);
+			if (ret < 0)
+				return error(env, atom_crypto_error);
+			if (!ret)
+				return error(env, atom_auth_failed);
+			integrity = 1;
+			continue;
+		}
+
+		attr = enif_make_tuple2(env, enif_make_uint(env, type),
+				enif_make_sub_binary(env, argv[0], off + 4, len));
+		attrs = enif_make_list_cell(env, attr, attrs);
+	}
+
+	enif_make_reverse_list(env, attrs, &attrs);
+
+	return enif_make_tuple6(env, atom_ok,
+			enif_make_uint(env, get_u16(p) & 0x3FFF),
+			enif_make_sub_binary(env, argv[0], 8, 12),
+			attrs,
+			fingerprint ? atom_true : atom_false,
+			integrity ? atom_true : atom_false);
+}
+
+/* hmac_sha1(Key, Data), for MESSAGE-INTEGRITY on the sending side */
+static ERL_NIF_TERM stun_hmac_sha1(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	ErlNifBinary key, data;
+	ERL_NIF_TERM term;
+	stun_key* k;
+	EVP_MD_CTX* work;
+	uint8_t* mac;
+	int ok;
+
+	if (!enif_inspect_iolist_as_binary(env, argv[0], &key) ||
+			!enif_inspect_iolist_as_binary(env, argv[1], &data))
+		return enif_make_badarg(env);
+
+	if (!(work = thread_work()) || !(k = key_get(key.data, key.size)))
+		return error(env, atom_crypto_error);
+
+	mac = enif_make_new_binary(env, HMAC_SHA1_SIZE, &term);
+	ok = hmac_sha1_start_ctx(&k->hmac, work) &&
+		hmac_sha1_update_ctx(work, data.data, data.size) &&
+		hmac_sha1_final_ctx(&k->hmac, work, mac);
+	enif_release_resource(k);
+
+	return ok ? term : error(env, atom_crypto_error);
+}
+
+static int load(ErlNifEnv* env, void** priv_data, ERL_NIF_TERM load_info)
+{
+	stun_key_type = enif_open_resource_type(env, NULL, "stun_key",
+			stun_key_dtor, ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, NULL);
+	if (!stun_key_type)
+		return -1;
+	if (!cache_lock && !(cache_lock = enif_mutex_create("stun_key_cache")))
+		return -1;
+	if (!work_key_created) {
+		if (enif_tsd_key_create("stun_hmac_work", &work_key) != 0)
+			return -1;
+		work_key_created = 1;
+	}
+
+	crc32_init();
+
+	atom_ok = enif_make_atom(env, "ok");
+	atom_error = enif_make_atom(env, "error");
+	atom_true = enif_make_atom(env, "true");
+	atom_false = enif_make_atom(env, "false");
+	atom_bad_packet = enif_make_atom(env, "bad_packet");
+	atom_bad_fingerprint = enif_make_atom(env, "bad_fingerprint");
+	atom_auth_failed = enif_make_atom(env, "auth_failed");
+	atom_crypto_error = enif_make_atom(env, "crypto_error");
+
+	return 0;
+}
+
+static int upgrade(ErlNifEnv* env, void** priv_data, void** old_priv_data, ERL_NIF_TERM load_info)
+{
+	return load(env, priv_data, load_info);
+}
+
+static ErlNifFunc nif_funcs[] =
+{
+	{"scan", 2, stun_scan, 0},
+	{"hmac_sha1", 2, stun_hmac_sha1, 0}
+};
+
+ERL_NIF_INIT(Elixir.XMediaLib.Stun.Native,nif_funcs,load,NULL,upgrade,NULL)
@@ -0,0 +1,381 @@
+/* ----------------------------------------------------------------------
+ *
+ * Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+ * for his excellent work in this area.
+ *
+ * @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+ *
+ * Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+ *
+ * Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+ *
+ * All rights reserved.
+ *
+ * XMediaLib is licensed by Xirsys, with permission, under the Apache
+ * License Version 2.0. (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See LICENSE for the full license text.
+ *
+ * ---------------------------------------------------------------------- */
+
+
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include "erl_nif.h"
+#include "codec.h"
+#include "g711_lut.h"
+#include "resample.h"
+
+/*
+ * Decode, resample and encode in one NIF call. A transcoder is built from a
+ * source and a target format and owns both codec states, the resampler and
+ * the intermediate PCM buffers, which are reused from packet to packet. The
+ * codecs are linked in directly (compiled with CODEC_NO_NIF), so nothing
+ * goes through their own NIF libraries.
+ *
+ * PCMA <-> PCMU never leaves the compressed domain, it's a byte lookup.
+ *
+ * Source and target frames needn't line up (10 ms G.729 frames into 20 ms
+ * GSM, 30 ms iLBC into Opus), so only whole target frames are encoded and
+ * the rest of the PCM waits for the next packet. A packet that doesn't
+ * complete a frame transcodes to an empty payload.
+ */
+
+extern const codec_ops pcmu_codec_ops;
+extern const codec_ops pcma_codec_ops;
+extern const codec_ops g722_codec_ops;
+extern const codec_ops g726_codec_ops;
+extern const codec_ops g729_codec_ops;
+extern const codec_ops gsm_codec_ops;
+extern const codec_ops ilbc_codec_ops;
+extern const codec_ops lpc_codec_ops;
+extern const codec_ops dvi4_codec_ops;
+extern const codec_ops speex_codec_ops;
+extern const codec_ops opus_codec_ops;
+
+static const codec_ops* all_codecs[] = {
+	&pcmu_codec_ops,
+	&pcma_codec_ops,
+	&g722_codec_ops,
+	&g726_codec_ops,
+	&g729_codec_ops,
+	&gsm_codec_ops,
+	&ilbc_codec_ops,
+	&lpc_codec_ops,
+	&dvi4_codec_ops,
+	&speex_codec_ops,
+	&opus_codec_ops
+};
+
+typedef struct {
+	const codec_ops* ops;
+	void* state;
+	int sample_rate;
+	int channels;
+} endpoint;
+
+typedef struct {
+	ErlNifMutex* lock;
+	endpoint from;
+	endpoint to;
+	/* PCMA <-> PCMU table, NULL otherwise */
+	const uint8_t* g711;
+	int resample;
+	resample_state rs;
+	/* decoder output, and resampler output when formats differ */
+	int16_t* pcm;
+	size_t pcm_size;
+	int16_t* pcm2;
+	size_t pcm2_size;
+	/* samples (all channels) per target frame, and PCM short of a frame */
+	size_t frame;
+	int16_t* rest;
+	size_t rest_size;
+	size_t rest_len;
+} transcoder;
+
+static ErlNifResourceType* transcoder_type = NULL;
+
+static ERL_NIF_TERM atom_ok;
+static ERL_NIF_TERM atom_error;
+static ERL_NIF_TERM atom_unsupported;
+static ERL_NIF_TERM atom_codec_error;
+
+static int ensure_pcm(int16_t** buf, size_t* size, size_t wanted)
+{
+	int16_t* tmp;
+
+	if (wanted <= *size)
+		return 1;
+	tmp = (int16_t*)enif_realloc(*buf, wanted * sizeof(int16_t));
+	if (!tmp)
+		return 0;
+	*buf = tmp;
+	*size = wanted;
+	return 1;
+}
+
+/* Samples the target encoder takes at a time, all channels */
+static size_t frame_samples(const endpoint* e)
+{
+	size_t frame;
+
+	if (e->ops == &g729_codec_ops)
+		frame = e->sample_rate / 100;
+	else if (e->ops == &gsm_codec_ops || e->ops == &ilbc_codec_ops ||
+			e->ops == &speex_codec_ops || e->ops == &opus_codec_ops)
+		frame = e->sample_rate / 50;
+	else if (e->ops == &lpc_codec_ops)
+		frame = 180;
+	/* two samples to a byte */
+	else if (e->ops == &g722_codec_ops || e->ops == &dvi4_codec_ops)
+		frame = 2;
+	else
+		frame = 1;
+
+	return frame * e->channels;
+}
+
+static const codec_ops* find_codec(const char* name)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(all_codecs) / sizeof(all_codecs[0]); i++)
+		if (!strcasecmp(all_codecs[i]->name, name))
+			return all_codecs[i];
+	return NULL;
+}
+
+/* {Format, SampleRate, Channels} as used by XMediaLib.Codec */
+static int get_endpoint(ErlNifEnv* env, ERL_NIF_TERM term, endpoint* e)
+{
+	const ERL_NIF_TERM* tuple;
+	char name[16];
+	int arity;
+
+	if (!enif_get_tuple(env, term, &arity, &tuple) || arity != 3 ||
+			enif_get_string(env, tuple[0], name, sizeof(name), ERL_NIF_LATIN1) <= 0 ||
+			!enif_get_int(env, tuple[1], &e->sample_rate) ||
+			!enif_get_int(env, tuple[2], &e->channels))
+		return 0;
+
+	e->ops = find_codec(name);
+	e->state = NULL;
+	return 1;
+}
+
+static void endpoint_free(endpoint* e)
+{
+	if (e->state && e->ops->destroy)
+		e->ops->destroy(e->state);
+	e->state = NULL;
+}
+
+static void transcoder_dtor(ErlNifEnv* env, void* obj)
+{
+	transcoder* t = (transcoder*)obj;
+
+	endpoint_free(&t->from);
+	endpoint_free(&t->to);
+	resample_free(&t->rs);
+	if (t->pcm)
+		enif_free(t->pcm);
+	if (t->pcm2)
+		enif_free(t->pcm2);
+	if (t->rest)
+		enif_free(t->rest);
+	if (t->lock)
+		enif_mutex_destroy(t->lock);
+}
+
+static ERL_NIF_TERM transcoder_new(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	endpoint from, to;
+	transcoder* t;
+	ERL_NIF_TERM term;
+
+	if (!get_endpoint(env, argv[0], &from) || !get_endpoint(env, argv[1], &to))
+		return enif_make_badarg(env);
+
+	if (!from.ops || !to.ops || from.sample_rate <= 0 || to.sample_rate <= 0 ||
+			!resample_is_supported_channels(from.channels) ||
+			!resample_is_supported_channels(to.channels))
+		return enif_make_tuple2(env, atom_error, atom_unsupported);
+
+	t = (transcoder*)enif_alloc_resource(transcoder_type, sizeof(transcoder));
+	memset(t, 0, sizeof(transcoder));
+	t->from = from;
+	t->to = to;
+	resample_init(&t->rs, to.sample_rate, to.channels);
+	t->resample = from.sample_rate != to.sample_rate || from.channels != to.channels;
+	t->frame = frame_samples(&to);
+
+	if (from.ops == &pcmu_codec_ops && to.ops == &pcma_codec_ops && !t->resample)
+		t->g711 = g711_ulaw_to_alaw;
+	else if (from.ops == &pcma_codec_ops && to.ops == &pcmu_codec_ops && !t->resample)
+		t->g711 = g711_alaw_to_ulaw;
+
+	if ((from.ops->init && !(t->from.state = from.ops->init(from.sample_rate, from.channels))) ||
+			(to.ops->init && !(t->to.state = to.ops->init(to.sample_rate, to.channels)))) {
+		enif_release_resource(t);
+		return enif_make_tuple2(env, atom_error, atom_unsupported);
+	}
+	if (!(t->lock = enif_mutex_create((char*)"transcoder"))) {
+		enif_release_resource(t);
+		return enif_make_tuple2(env, atom_error, atom_codec_error);
+	}
+
+	term = enif_make_resource(env, t);
+	enif_release_resource(t);
+
+	return enif_make_tuple2(env, atom_ok, term);
+}
+
+static ERL_NIF_TERM do_transcode(ErlNifEnv* env, transcoder* t, ErlNifBinary* in)
+{
+	ErlNifBinary out;
+	int16_t* pcm;
+	size_t max, keep = 0;
+	long samples;
+	int ret;
+
+	if (t->g711) {
+		ERL_NIF_TERM result;
+		g711_transcode(t->g711, in->data, enif_make_new_binary(env, in->size, &result), in->size);
+		return enif_make_tuple2(env, atom_ok, result);
+	}
+
+	max = t->from.ops->max_decoded(t->from.state, in->size);
+	if (!ensure_pcm(&t->pcm, &t->pcm_size, max))
+		return enif_make_tuple2(env, atom_error, atom_codec_error);
+
+	samples = t->from.ops->decode(t->from.state, in->data, in->size, t->pcm, max);
+	if (samples < 0)
+		return enif_make_tuple2(env, atom_error, atom_codec_error);
+	pcm = t->pcm;
+
+	if (t->resample) {
+		long frames = resample_run(&t->rs, pcm, samples, t->from.sample_rate, t->from.channels);
+		if (frames < 0 || !ensure_pcm(&t->pcm2, &t->pcm2_size, frames * t->to.channels))
+			return enif_make_tuple2(env, atom_error, atom_codec_error);
+		resample_output(&t->rs, frames, t->pcm2);
+		pcm = t->pcm2;
+		samples = frames * t->to.channels;
+	}
+
+	/* prepend what was left over, keep back what doesn't make a whole frame */
+	if (t->frame > 1) {
+		if (!ensure_pcm(&t->rest, &t->rest_size, t->rest_len + samples))
+			return enif_make_tuple2(env, atom_error, atom_codec_error);
+		memcpy(t->rest + t->rest_len, pcm, samples * sizeof(int16_t));
+		samples += t->rest_len;
+		keep = samples % t->frame;
+		samples -= keep;
+		pcm = t->rest;
+		/* dropped if the encoder fails, so a bad packet isn't tried again */
+		t->rest_len = 0;
+
+		if (samples == 0) {
+			ERL_NIF_TERM result;
+			t->rest_len = keep;
+			enif_make_new_binary(env, 0, &result);
+			return enif_make_tuple2(env, atom_ok, result);
+		}
+	}
+
+	if (!enif_alloc_binary(t->to.ops->max_encoded(t->to.state, samples), &out))
+		return enif_make_tuple2(env, atom_error, atom_codec_error);
+
+	ret = t->to.ops->encode(t->to.state, pcm, samples, out.data, out.size);
+	if (ret < 0) {
+		enif_release_binary(&out);
+		return enif_make_tuple2(env, atom_error, atom_codec_error);
+	}
+	if ((size_t)ret != out.size)
+		enif_realloc_binary(&out, ret);
+
+	if (keep) {
+		memmove(t->rest, t->rest + samples, keep * sizeof(int16_t));
+		t->rest_len = keep;
+	}
+
+	return enif_make_tuple2(env, atom_ok, enif_make_binary(env, &out));
+}
+
+static ERL_NIF_TERM transcoder_transcode(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	transcoder* t;
+	ErlNifBinary in;
+	ERL_NIF_TERM ret;
+
+	if (!enif_get_resource(env, argv[0], transcoder_type, (void**)&t) ||
+			!enif_inspect_binary(env, argv[1], &in))
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(t->lock);
+	ret = do_transcode(env, t, &in);
+	enif_mutex_unlock(t->lock);
+
+	return ret;
+}
+
+static ERL_NIF_TERM transcoder_reset(ErlNifEnv* env, int argc, const ERL_NIF_TERM argv[])
+{
+	transcoder* t;
+
+	if (!enif_get_resource(env, argv[0], transcoder_type, (void**)&t))
+		return enif_make_badarg(env);
+
+	enif_mutex_lock(t->lock);
+	if (t->from.state && t->from.ops->reset)
+		t->from.ops->reset(t->from.state);
+	if (t->to.state && t->to.ops->reset)
+		t->to.ops->reset(t->to.state);
+	resample_reset(&t->rs);
+	t->rest_len = 0;
+	enif_mutex_unlock(t->lock);
+
+	return atom_ok;
+}
+
+static int load(ErlNifEnv* env, void** priv_data, ERL_NIF_TERM load_info)
+{
+	transcoder_type = enif_open_resource_type(env, NULL, "transcoder",
+			transcoder_dtor, ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER, NULL);
+	if (!transcoder_type)
+		return -1;
+
+	atom_ok = enif_make_atom(env, "ok");
+	atom_error = enif_make_atom(env, "error");
+	atom_unsupported = enif_make_atom(env, "unsupported");
+	atom_codec_error = enif_make_atom(env, "codec_error");
+
+	g711_lut_init();
+
+	return 0;
+}
+
+static int upgrade(ErlNifEnv* env, void** priv_data, void** old_priv_data, ERL_NIF_TERM load_info)
+{
+	return load(env, priv_data, load_info);
+}
+
+static ErlNifFunc transcoder_nif_funcs[] =
+{
+	{"new", 2, transcoder_new, 0},
+	{"transcode", 2, transcoder_transcode, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+	{"reset", 1, transcoder_reset, 0}
+};
+
+ERL_NIF_INIT(Elixir.XMediaLib.Transcoder,transcoder_nif_funcs,load,NULL,upgrade,NULL)
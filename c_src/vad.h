@@ -0,0 +1,196 @@
+/* ----------------------------------------------------------------------
+ *
+ * Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+ * for his excellent work in this area.
+ *
+ * @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+ *
+ * Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+ *
+ * Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+ *
+ * All rights reserved.
+ *
+ * XMediaLib is licensed by Xirsys, with permission, under the Apache
+ * License Version 2.0. (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * See LICENSE for the full license text.
+ *
+ * ---------------------------------------------------------------------- */
+
+
+#ifndef __VAD_H__
+#define __VAD_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Energy based voice activity detection and RFC 3389 comfort noise, shared
+ * by every codec through codec_nif.h.
+ *
+ * The noise floor follows the quietest frames: it drops quickly to a
+ * quieter frame and creeps up by about 1 dB a second otherwise. A frame
+ * 6 dB or more above the floor, and louder than -60 dBov, is speech. A
+ * hangover keeps talkspurts from being clipped at the end of words.
+ *
+ * Comfort noise payloads carry the noise level only (no spectral
+ * coefficients, which RFC 3389 allows), so the far end plays white noise at
+ * the right level. One is sent when silence starts, whenever the level moves
+ * by 3 dB or more, and once a second otherwise.
+ */
+
+#define VAD_HANGOVER_MS 200
+#define VAD_CN_REFRESH_MS 1000
+/* -60 dBov as a mean square, with 0 dBov = 2^30 */
+#define VAD_MIN_ENERGY 1074
+
+enum {
+	VAD_SPEECH,
+	/* silence, send the CN payload */
+	VAD_SEND_CN,
+	/* silence, send nothing */
+	VAD_SILENT
+};
+
+typedef struct {
+	int samples_per_sec;
+	/* mean square sample value of the noise floor, 0 before the first frame */
+	uint64_t noise;
+	/* ms of hangover left */
+	int hangover;
+	int in_silence;
+	/* level in the last CN payload, ms since it was sent */
+	int cn_level;
+	int cn_age;
+} vad_state;
+
+typedef struct {
+	/* RMS amplitude currently played, and the one being ramped to */
+	float amplitude;
+	float target;
+	uint32_t seed;
+} cn_state;
+
+static void vad_init(vad_state* v, int sample_rate, int channels)
+{
+	memset(v, 0, sizeof(vad_state));
+	v->samples_per_sec = sample_rate * channels;
+}
+
+static uint64_t vad_energy(const int16_t* pcm, size_t samples)
+{
+	uint64_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < samples; i++)
+		sum += (int32_t)pcm[i] * pcm[i];
+	return samples ? sum / samples : 0;
+}
+
+/* RFC 3389 noise level: -dBov, 0 to 127 */
+static int vad_level(uint64_t energy)
+{
+	int64_t log2_q16;
+	int bits = 0;
+	uint64_t e = energy;
+
+	if (!energy)
+		return 127;
+	while (e >>= 1)
+		bits++;
+	/* log2(1 + x) ~ x for the mantissa, good to a few tenths of a dB */
+	log2_q16 = ((int64_t)bits << 16) +
+		(int64_t)(bits >= 16 ? (energy >> (bits - 16)) & 0xFFFF : (energy << (16 - bits)) & 0xFFFF);
+	/* -10 * log10(energy / 2^30), 10 * log10(2) = 3.0103 */
+	log2_q16 = ((((int64_t)30 << 16) - log2_q16) * 30103 / 10000 + 0x8000) >> 16;
+	return log2_q16 < 0 ? 0 : log2_q16 > 127 ? 127 : (int)log2_q16;
+}
+
+/* Classifies a frame, setting *level to the CN level when one is due */
+static int vad_process(vad_state* v, const int16_t* pcm, size_t samples, int* level)
+{
+	uint64_t energy = vad_energy(pcm, samples);
+	int ms = v->samples_per_sec > 0 ? (int)(samples * 1000 / v->samples_per_sec) : 0;
+	int l;
+
+	if (!v->noise || energy < v->noise)
+		v->noise = v->noise ? v->noise - (v->noise - energy) / 4 : energy;
+	else
+		v->noise += (v->noise >> 8) + 1;
+
+	if (energy > VAD_MIN_ENERGY && energy >= 4 * v->noise) {
+		v->hangover = VAD_HANGOVER_MS;
+		v->in_silence = 0;
+		return VAD_SPEECH;
+	}
+	if (v->hangover > 0) {
+		v->hangover -= ms;
+		return VAD_SPEECH;
+	}
+
+	l = vad_level(v->noise);
+	v->cn_age += ms;
+	if (!v->in_silence || v->cn_age >= VAD_CN_REFRESH_MS ||
+			l - v->cn_level >= 3 || v->cn_level - l >= 3) {
+		v->in_silence = 1;
+		v->cn_level = l;
+		v->cn_age = 0;
+		*level = l;
+		return VAD_SEND_CN;
+	}
+	return VAD_SILENT;
+}
+
+static void cn_init(cn_state* c)
+{
+	c->amplitude = 0;
+	c->target = 0;
+	c->seed = 0x2545F491;
+}
+
+/* A CN payload: level, then optional reflection coefficients we ignore */
+static void cn_update(cn_state* c, const uint8_t* payload, size_t len)
+{
+	float a = 32767.0f;
+	int level;
+
+	if (!len)
+		return;
+	/* 10^(-1/20) per dB */
+	for (level = payload[0] & 0x7F; level > 0; level--)
+		a *= 0.89125094f;
+	c->target = a;
+}
+
+/* White noise at the current level, ramped across the frame on a change */
+static void cn_generate(cn_state* c, int16_t* pcm, size_t samples)
+{
+	float step = samples ? (c->target - c->amplitude) / samples : 0;
+	float s;
+	size_t i;
+
+	for (i = 0; i < samples; i++) {
+		c->amplitude += step;
+		/* xorshift32, uniform in [-1, 1) has an RMS of 1/sqrt(3) */
+		c->seed ^= c->seed << 13;
+		c->seed ^= c->seed >> 17;
+		c->seed ^= c->seed << 5;
+		s = ((int32_t)c->seed / 2147483648.0f) * 1.7320508f * c->amplitude;
+		pcm[i] = s > 32767.0f ? 32767 : s < -32768.0f ? -32768 : (int16_t)s;
+	}
+	c->amplitude = c->target;
+}
+
+#endif /* __VAD_H__ */
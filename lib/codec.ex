@@ -30,15 +30,26 @@
 
 defmodule XMediaLib.Codec do
   use GenServer
+  alias XMediaLib.Resampler
+
+  defstruct codec: nil,
+            state: nil,
+            type: nil,
+            samplerate: nil,
+            channels: nil,
+            resolution: nil,
+            resampler: nil,
+            # what open/2 applied, so Codec.Pool can tell codecs apart
+            options: []
 
-  defstruct port: nil, type: nil, samplerate: nil, channels: nil, resolution: nil, resampler: nil
-
-  @cmd_setup 0
   @cmd_encode 1
   @cmd_decode 2
-
-  defp cmd_resample(from_sr, from_ch, to_sr, to_ch),
-    do: div(from_sr, 1000) * 16_777_216 + from_ch * 65536 + div(to_sr, 1000) * 256 + to_ch
+  @cmd_encode_frames 3
+  @cmd_decode_frames 4
+  @cmd_set_option 5
+  @cmd_reset 6
+  @cmd_comfort_noise 7
+  @cmd_decode_lost 8
 
   # For testing purposes only
   def default_codecs(),
@@ -81,6 +92,13 @@ defmodule XMediaLib.Codec do
     end
   end
 
+  def start_link({format, sample_rate, channels, options}) do
+    case is_supported({format, sample_rate, channels}) do
+      true -> GenServer.start_link(__MODULE__, {format, sample_rate, channels, options}, [])
+      false -> {:stop, :unsupported}
+    end
+  end
+
   def start_link(args) do
     case is_supported(args) do
       true -> GenServer.start_link(__MODULE__, args, [])
@@ -88,196 +106,374 @@ defmodule XMediaLib.Codec do
     end
   end
 
-  def init({format, sample_rate, channels}) do
-    driver_name =
-      case format do
-        'PCMU' -> :pcmu_codec_drv
-        'GSM' -> :gsm_codec_drv
-        'DVI4' -> :dvi4_codec_drv
-        'PCMA' -> :pcma_codec_drv
-        'G722' -> :g722_codec_drv
-        'G726' -> :g726_codec_drv
-        'G729' -> :g729_codec_drv
-        'LPC' -> :lpc_codec_drv
-        'SPEEX' -> :speex_codec_drv
-        'ILBC' -> :ilbc_codec_drv
-        'OPUS' -> :opus_codec_drv
-      end
+  def init({format, sample_rate, channels, options}) do
+    case open({format, sample_rate, channels}, options) do
+      {:ok, codec} -> {:ok, codec}
+      {:error, error} -> {:stop, error}
+    end
+  end
 
-    result =
-      [load_library(driver_name), load_library(:resampler_drv)]
-      |> Enum.reject(&(&1 == :ok))
-
-    case result do
-      [] ->
-        port = :erlang.open_port({:spawn, driver_name}, [:binary])
-        port_resampler = :erlang.open_port({:spawn, :resampler_drv}, [:binary])
-        # FIXME only 16-bits per sample currently
-        :erlang.port_control(
-          port,
-          @cmd_setup,
-          <<sample_rate::native-unsigned-integer-size(32),
-            channels::native-unsigned-integer-size(32)>>
-        )
-
-        {:ok,
-         %__MODULE__{
-           port: port,
-           type: format,
-           samplerate: sample_rate,
-           channels: channels,
-           resolution: 16,
-           resampler: port_resampler
-         }}
-
-      {:error, error} ->
-        {:stop, error}
+  def init(desc) do
+    case open(desc) do
+      {:ok, codec} -> {:ok, codec}
+      {:error, error} -> {:stop, error}
     end
   end
 
-  # Encoding doesn't require resampling
-  def handle_call(
-        {@cmd_encode, {binary, sample_rate, channels, resolution}},
-        _from,
+  def handle_call({@cmd_encode, frame}, _from, codec),
+    do: {:reply, encode(codec, frame), codec}
+
+  def handle_call({@cmd_decode, payload}, _from, codec),
+    do: {:reply, decode(codec, payload), codec}
+
+  def handle_call({@cmd_encode_frames, frames}, _from, codec),
+    do: {:reply, encode_frames(codec, frames), codec}
+
+  def handle_call({@cmd_decode_frames, payloads}, _from, codec),
+    do: {:reply, decode_frames(codec, payloads), codec}
+
+  def handle_call({@cmd_set_option, option, value}, _from, codec),
+    do: {:reply, set_option(codec, option, value), codec}
+
+  def handle_call(@cmd_reset, _from, codec),
+    do: {:reply, reset(codec), codec}
+
+  def handle_call({@cmd_comfort_noise, payload, ptime}, _from, codec),
+    do: {:reply, comfort_noise(codec, payload, ptime), codec}
+
+  def handle_call({@cmd_decode_lost, ptime, next}, _from, codec),
+    do: {:reply, decode_lost(codec, ptime, next), codec}
+
+  def handle_call(_other, _from, state), do: {:noreply, state}
+
+  def handle_cast(:stop, state), do: {:stop, :normal, state}
+
+  def handle_cast(_request, state), do: {:noreply, state}
+
+  def handle_info({:DOWN, _, _, _, _}, state), do: {:stop, :normal, state}
+
+  def handle_info(_info, state), do: {:noreply, state}
+
+  def code_change(_old_vsn, state, _extra), do: {:ok, state}
+
+  def terminate(_reason, codec), do: close(codec)
+
+  @doc """
+  Opens a codec owned by the calling process. The returned struct can be
+  passed to `encode/2` and `decode/2` directly, which runs the codec in the
+  caller instead of going through a GenServer.
+  """
+  def open({format, sample_rate, channels} = desc) do
+    with true <- is_supported(desc) || {:error, :unsupported},
+         codec = native_codec(format),
+         true <- Code.ensure_loaded?(codec) || {:error, {:not_loaded, codec}},
+         {:ok, state} <- codec.new(sample_rate, channels) do
+      {:ok,
+       %__MODULE__{
+         codec: codec,
+         state: state,
+         type: format,
+         samplerate: sample_rate,
+         channels: channels,
+         # FIXME only 16-bits per sample currently
+         resolution: 16,
+         resampler: new_resampler(sample_rate, channels)
+       }}
+    end
+  end
+
+  @doc """
+  Same as `open/1`, then applies `options` with `set_option/3`. The options
+  are kept in the struct.
+  """
+  def open(desc, options) do
+    with {:ok, codec} <- open(desc),
+         :ok <- set_options(codec, options) do
+      {:ok, %__MODULE__{codec | options: options}}
+    end
+  end
+
+  def close(codec) when is_pid(codec), do: GenServer.cast(codec, :stop)
+
+  # Codec and resampler state are freed once the struct is garbage collected
+  def close(%__MODULE__{}), do: :ok
+
+  def decode(codec, payload) when is_pid(codec) and is_binary(payload),
+    do: GenServer.call(codec, {@cmd_decode, payload})
+
+  def decode(
         %__MODULE__{
-          port: port,
+          codec: codec,
+          state: state,
           samplerate: sample_rate,
           channels: channels,
           resolution: resolution
-        } = state
-      ) do
-    {:reply, encode_binary(port, @cmd_encode, binary), state}
+        },
+        payload
+      )
+      when is_binary(payload) do
+    case codec.decode(state, payload) do
+      {:ok, pcm} -> {:ok, {pcm, sample_rate, channels, resolution}}
+      error -> error
+    end
   end
 
+  def encode(codec, {payload, sample_rate, channels, resolution})
+      when is_pid(codec) and is_binary(payload),
+      do: GenServer.call(codec, {@cmd_encode, {payload, sample_rate, channels, resolution}})
+
+  # Encoding doesn't require resampling
+  def encode(
+        %__MODULE__{
+          codec: codec,
+          state: state,
+          samplerate: sample_rate,
+          channels: channels,
+          resolution: resolution
+        },
+        {payload, sample_rate, channels, resolution}
+      )
+      when is_binary(payload),
+      do: codec.encode(state, payload)
+
   # Encoding requires resampling
-  def handle_call(
-        {@cmd_encode, {binary, sample_rate, channels, _resolution}},
-        _from,
+  def encode(
         %__MODULE__{
-          port: port,
-          samplerate: native_sample_rate,
-          channels: native_channels,
-          resolution: _native_resolution,
-          resampler: port_resampler
-        } = state
-      ) do
-    result =
-      for resampled_binary <-
-            encode_binary(
-              port_resampler,
-              cmd_resample(sample_rate, channels, native_sample_rate, native_channels),
-              binary
-            ),
-          do: encode_binary(port, @cmd_encode, resampled_binary)
-
-    {:reply, result, state}
+          codec: codec,
+          state: state,
+          resampler: resampler
+        },
+        {payload, sample_rate, channels, _resolution}
+      )
+      when is_binary(payload) and resampler != nil do
+    with {:ok, resampled} <- Resampler.process(resampler, payload, sample_rate, channels),
+         do: codec.encode(state, resampled)
   end
 
-  def handle_call(
-        {@cmd_decode, binary},
-        _from,
+  def encode(%__MODULE__{}, {payload, _sample_rate, _channels, _resolution})
+      when is_binary(payload),
+      do: {:error, :no_resampler}
+
+  @doc """
+  Decodes a list of payloads in one go, returning the PCM frames as a list
+  in the same order.
+  """
+  def decode_frames(codec, payloads) when is_pid(codec) and is_list(payloads),
+    do: GenServer.call(codec, {@cmd_decode_frames, payloads})
+
+  def decode_frames(
         %__MODULE__{
-          port: port,
-          type: :G729,
+          codec: codec,
+          state: state,
           samplerate: sample_rate,
           channels: channels,
           resolution: resolution
-        } = state
-      ) do
-    # FIXME - drop G.729 annex B data for now
-    size = 10 * div(byte_size(binary), 10)
-    <<raw_binary::binary-size(size), _comfort_noise::binary>> = binary
-
-    case :erlang.port_control(port, @cmd_decode, raw_binary) do
-      new_binary when is_binary(new_binary) ->
-        {:reply, {:ok, {new_binary, sample_rate, channels, resolution}}, state}
-
-      _ ->
-        {:reply, {:error, :codec_error}, state}
+        },
+        payloads
+      )
+      when is_list(payloads) do
+    case codec.decode_frames(state, payloads) do
+      {:ok, frames} -> {:ok, {frames, sample_rate, channels, resolution}}
+      error -> error
     end
   end
 
-  def handle_call(
-        {@cmd_decode, binary},
-        _from,
+  @doc """
+  Encodes a list of PCM frames in one go, returning one payload per frame.
+  """
+  def encode_frames(codec, {frames, sample_rate, channels, resolution})
+      when is_pid(codec) and is_list(frames),
+      do: GenServer.call(codec, {@cmd_encode_frames, {frames, sample_rate, channels, resolution}})
+
+  def encode_frames(
         %__MODULE__{
-          port: port,
-          type: _format,
+          codec: codec,
+          state: state,
           samplerate: sample_rate,
           channels: channels,
           resolution: resolution
-        } = state
-      ) do
-    case :erlang.port_control(port, @cmd_decode, binary) do
-      new_binary when is_binary(new_binary) ->
-        {:reply, {:ok, {new_binary, sample_rate, channels, resolution}}, state}
-
-      _ ->
-        {:reply, {:error, :codec_error}, state}
+        },
+        {frames, sample_rate, channels, resolution}
+      )
+      when is_list(frames),
+      do: codec.encode_frames(state, frames)
+
+  def encode_frames(
+        %__MODULE__{codec: codec, state: state, resampler: resampler},
+        {frames, sample_rate, channels, _resolution}
+      )
+      when is_list(frames) and resampler != nil do
+    frames
+    |> Enum.reduce_while({:ok, []}, fn frame, {:ok, acc} ->
+      case Resampler.process(resampler, frame, sample_rate, channels) do
+        {:ok, resampled} -> {:cont, {:ok, [resampled | acc]}}
+        error -> {:halt, error}
+      end
+    end)
+    |> case do
+      {:ok, resampled} -> codec.encode_frames(state, Enum.reverse(resampled))
+      error -> error
     end
   end
 
-  def handle_call(_other, _from, state), do: {:noreply, state}
+  def encode_frames(%__MODULE__{}, {frames, _sample_rate, _channels, _resolution})
+      when is_list(frames),
+      do: {:error, :no_resampler}
 
-  def handle_cast(:stop, state), do: {:stop, :normal, state}
+  @doc """
+  Changes an encoder setting, in the middle of a stream if need be. Every
+  codec has
 
-  def handle_cast(_request, state), do: {:noreply, state}
+    * `:vad` - boolean, voice activity detection in front of the encoder.
+      Silent frames are not encoded: `encode/2` returns
+      `{:ok, {:cn, payload}}` when an RFC 3389 comfort noise packet (payload
+      type 13) should be sent and `{:ok, :silence}` when nothing should.
 
-  def handle_info({:DOWN, _, _, _, _}, state), do: {:stop, :normal, state}
+  G.729 has
 
-  def handle_info(_info, state), do: {:noreply, state}
+    * `:annexb` - boolean, Annex B VAD/DTX on the encoder. Payloads are then
+      speech frames, possibly ending in a 2-byte SID frame, or empty when
+      nothing needs to be sent. Set it before the stream starts.
 
-  def code_change(_old_vsn, state, _extra), do: {:ok, state}
+  Opus has
 
-  def terminate(_reason, %__MODULE__{port: port, resampler: port_resampler}) do
-    try do
-      :erlang.port_close(port)
-      :erlang.port_close(port_resampler)
-    catch
-      _ -> :ok
-    end
+    * `:bitrate` - bits per second, 0 lets the encoder choose
+    * `:complexity` - 0 (cheapest) to 10
+    * `:vbr`, `:fec`, `:dtx` - booleans
+    * `:packet_loss` - expected loss in percent, tunes FEC
+    * `:max_bandwidth` - audio bandwidth in Hz, 4000 to 20000
 
-    :ok
-  end
+  Returns `{:error, :unsupported}` for settings the codec doesn't know.
+  """
+  def set_option(codec, option, value) when is_pid(codec),
+    do: GenServer.call(codec, {@cmd_set_option, option, value})
 
-  def close(codec) when is_pid(codec), do: GenServer.cast(codec, :stop)
+  def set_option(%__MODULE__{codec: codec, state: state}, option, value) when is_atom(option),
+    do: codec.set_option(state, option, option_value(value))
 
-  def decode(codec, payload) when is_pid(codec) and is_binary(payload),
-    do: GenServer.call(codec, {@cmd_decode, payload})
+  @doc """
+  Clears the codec and resampler history without reallocating them, so the
+  codec can carry another stream. Settings made with `set_option/3` stay.
+  G.729 keeps its filter memory, bcg729 can only clear it by setting the
+  codec up again.
+  """
+  def reset(codec) when is_pid(codec), do: GenServer.call(codec, @cmd_reset)
 
-  def encode(codec, {payload, sample_rate, channels, resolution})
-      when is_pid(codec) and is_binary(payload),
-      do: GenServer.call(codec, {@cmd_encode, {payload, sample_rate, channels, resolution}})
+  def reset(%__MODULE__{codec: codec, state: state, resampler: resampler}) do
+    resampler == nil || Resampler.reset(resampler)
+    codec.reset(state)
+  end
 
-  # Private functions
+  @doc """
+  Plays out `ptime` milliseconds of comfort noise at the level carried by an
+  RFC 3389 payload. Pass `<<>>` for the frames between CN packets to carry on
+  at the last level. `ptime` is at most 120.
+  """
+  def comfort_noise(codec, payload, ptime \\ 20)
 
-  defp load_library(name) do
-    case :erl_ddll.load_driver(get_priv(), name) do
-      :ok ->
-        :ok
+  def comfort_noise(codec, payload, ptime) when is_pid(codec),
+    do: GenServer.call(codec, {@cmd_comfort_noise, payload, ptime})
 
-      {:error, :already_loaded} ->
-        :ok
+  def comfort_noise(
+        %__MODULE__{
+          codec: codec,
+          state: state,
+          samplerate: sample_rate,
+          channels: channels,
+          resolution: resolution
+        },
+        payload,
+        ptime
+      )
+      when is_binary(payload) do
+    case codec.comfort_noise(state, payload, div(sample_rate * channels * ptime, 1000)) do
+      {:ok, pcm} -> {:ok, {pcm, sample_rate, channels, resolution}}
+      error -> error
+    end
+  end
 
-      {:error, :permanent} ->
-        :ok
+  @doc """
+  Conceals `ptime` milliseconds of audio for a packet that never arrived,
+  in place of `decode/2`. Codecs with in-band FEC (Opus) recover the lost
+  frame from `next`, the payload following the gap, when it is known.
+  `ptime` is at most 120, longer gaps take several calls. Returns
+  `{:error, :unsupported}` for codecs without concealment.
+  """
+  def decode_lost(codec, ptime \\ 20, next \\ <<>>)
 
-      {:error, error} ->
-        IO.puts("""
-          Can't load #{name} library:
-          #{inspect(:erl_ddll.format_error(error))}
-        """)
+  def decode_lost(codec, ptime, next) when is_pid(codec),
+    do: GenServer.call(codec, {@cmd_decode_lost, ptime, next})
 
-        {:error, error}
+  def decode_lost(
+        %__MODULE__{
+          codec: codec,
+          state: state,
+          samplerate: sample_rate,
+          channels: channels,
+          resolution: resolution
+        },
+        ptime,
+        next
+      )
+      when is_binary(next) do
+    case codec.decode_lost(state, div(sample_rate * channels * ptime, 1000), next) do
+      {:ok, pcm} -> {:ok, {pcm, sample_rate, channels, resolution}}
+      error -> error
     end
   end
 
-  defp get_priv(), do: "./priv"
+  def set_options(codec, options) do
+    Enum.reduce_while(options, :ok, fn {option, value}, :ok ->
+      case set_option(codec, option, value) do
+        :ok -> {:cont, :ok}
+        {:error, error} -> {:halt, {:error, {option, error}}}
+      end
+    end)
+  end
+
+  @doc """
+  Converts a G.711 payload between A-law and u-law without decoding it to
+  linear PCM first. Each byte maps straight to its counterpart.
+  """
+  def transcode(payload, 'PCMA', 'PCMU') when is_binary(payload),
+    do: {:ok, XMediaLib.Codec.PCMA.to_pcmu(payload)}
+
+  def transcode(payload, 'PCMU', 'PCMA') when is_binary(payload),
+    do: {:ok, XMediaLib.Codec.PCMU.to_pcma(payload)}
+
+  def transcode(payload, format, format) when is_binary(payload), do: {:ok, payload}
+
+  def transcode(_payload, _from, _to), do: {:error, :unsupported}
+
+  # Private functions
+
+  defp native_codec(format) do
+    case format do
+      'PCMU' -> XMediaLib.Codec.PCMU
+      'GSM' -> XMediaLib.Codec.GSM
+      'DVI4' -> XMediaLib.Codec.DVI4
+      'PCMA' -> XMediaLib.Codec.PCMA
+      'G722' -> XMediaLib.Codec.G722
+      'G726' -> XMediaLib.Codec.G726
+      'G729' -> XMediaLib.Codec.G729
+      'LPC' -> XMediaLib.Codec.LPC
+      'SPEEX' -> XMediaLib.Codec.SPEEX
+      'ILBC' -> XMediaLib.Codec.ILBC
+      'OPUS' -> XMediaLib.Codec.OPUS
+    end
+  end
 
-  defp encode_binary(port, cmd, bin_in) do
-    case :erlang.port_control(port, cmd, bin_in) do
-      bin_out when is_binary(bin_out) -> {:ok, bin_out}
-      _ -> {:error, :codec_error}
+  defp option_value(true), do: 1
+  defp option_value(false), do: 0
+  defp option_value(value) when is_integer(value), do: value
+
+  # libsamplerate is optional, only encoding from a foreign format needs it
+  defp new_resampler(sample_rate, channels) do
+    with true <- Code.ensure_loaded?(Resampler),
+         {:ok, resampler} <- Resampler.new(sample_rate, channels) do
+      resampler
+    else
+      _ -> nil
     end
   end
 end
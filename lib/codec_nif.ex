@@ -0,0 +1,240 @@
+### ----------------------------------------------------------------------
+###
+### Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+### for his excellent work in this area.
+###
+### @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+###
+### Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+###
+### Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+###
+### All rights reserved.
+###
+### XMediaLib is licensed by Xirsys, with permission, under the Apache
+### License Version 2.0. (the "License");
+### you may not use this file except in compliance with the License.
+### You may obtain a copy of the License at
+###
+###      http://www.apache.org/licenses/LICENSE-2.0
+###
+### Unless required by applicable law or agreed to in writing, software
+### distributed under the License is distributed on an "AS IS" BASIS,
+### WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+### See the License for the specific language governing permissions and
+### limitations under the License.
+###
+### See LICENSE for the full license text.
+###
+### ----------------------------------------------------------------------
+
+defmodule XMediaLib.Codec.PCMU do
+  @moduledoc false
+  @on_load :init
+
+  def init() do
+    :erlang.load_nif('./priv/pcmu_codec_nif', 0)
+  end
+
+  def new(_sample_rate, _channels), do: "NIF library not loaded"
+  def encode(_state, _pcm), do: "NIF library not loaded"
+  def decode(_state, _payload), do: "NIF library not loaded"
+  def encode_frames(_state, _frames), do: "NIF library not loaded"
+  def decode_frames(_state, _payloads), do: "NIF library not loaded"
+  def set_option(_state, _option, _value), do: "NIF library not loaded"
+  def reset(_state), do: "NIF library not loaded"
+  def comfort_noise(_state, _payload, _samples), do: "NIF library not loaded"
+  def decode_lost(_state, _samples, _next), do: "NIF library not loaded"
+  def to_pcma(_payload), do: "NIF library not loaded"
+end
+
+defmodule XMediaLib.Codec.PCMA do
+  @moduledoc false
+  @on_load :init
+
+  def init() do
+    :erlang.load_nif('./priv/pcma_codec_nif', 0)
+  end
+
+  def new(_sample_rate, _channels), do: "NIF library not loaded"
+  def encode(_state, _pcm), do: "NIF library not loaded"
+  def decode(_state, _payload), do: "NIF library not loaded"
+  def encode_frames(_state, _frames), do: "NIF library not loaded"
+  def decode_frames(_state, _payloads), do: "NIF library not loaded"
+  def set_option(_state, _option, _value), do: "NIF library not loaded"
+  def reset(_state), do: "NIF library not loaded"
+  def comfort_noise(_state, _payload, _samples), do: "NIF library not loaded"
+  def decode_lost(_state, _samples, _next), do: "NIF library not loaded"
+  def to_pcmu(_payload), do: "NIF library not loaded"
+end
+
+defmodule XMediaLib.Codec.GSM do
+  @moduledoc false
+  @on_load :init
+
+  def init() do
+    :erlang.load_nif('./priv/gsm_codec_nif', 0)
+  end
+
+  def new(_sample_rate, _channels), do: "NIF library not loaded"
+  def encode(_state, _pcm), do: "NIF library not loaded"
+  def decode(_state, _payload), do: "NIF library not loaded"
+  def encode_frames(_state, _frames), do: "NIF library not loaded"
+  def decode_frames(_state, _payloads), do: "NIF library not loaded"
+  def set_option(_state, _option, _value), do: "NIF library not loaded"
+  def reset(_state), do: "NIF library not loaded"
+  def comfort_noise(_state, _payload, _samples), do: "NIF library not loaded"
+  def decode_lost(_state, _samples, _next), do: "NIF library not loaded"
+end
+
+defmodule XMediaLib.Codec.G722 do
+  @moduledoc false
+  @on_load :init
+
+  def init() do
+    :erlang.load_nif('./priv/g722_codec_nif', 0)
+  end
+
+  def new(_sample_rate, _channels), do: "NIF library not loaded"
+  def encode(_state, _pcm), do: "NIF library not loaded"
+  def decode(_state, _payload), do: "NIF library not loaded"
+  def encode_frames(_state, _frames), do: "NIF library not loaded"
+  def decode_frames(_state, _payloads), do: "NIF library not loaded"
+  def set_option(_state, _option, _value), do: "NIF library not loaded"
+  def reset(_state), do: "NIF library not loaded"
+  def comfort_noise(_state, _payload, _samples), do: "NIF library not loaded"
+  def decode_lost(_state, _samples, _next), do: "NIF library not loaded"
+end
+
+defmodule XMediaLib.Codec.G726 do
+  @moduledoc false
+  @on_load :init
+
+  def init() do
+    :erlang.load_nif('./priv/g726_codec_nif', 0)
+  end
+
+  def new(_sample_rate, _channels), do: "NIF library not loaded"
+  def encode(_state, _pcm), do: "NIF library not loaded"
+  def decode(_state, _payload), do: "NIF library not loaded"
+  def encode_frames(_state, _frames), do: "NIF library not loaded"
+  def decode_frames(_state, _payloads), do: "NIF library not loaded"
+  def set_option(_state, _option, _value), do: "NIF library not loaded"
+  def reset(_state), do: "NIF library not loaded"
+  def comfort_noise(_state, _payload, _samples), do: "NIF library not loaded"
+  def decode_lost(_state, _samples, _next), do: "NIF library not loaded"
+end
+
+defmodule XMediaLib.Codec.G729 do
+  @moduledoc false
+  @on_load :init
+
+  def init() do
+    :erlang.load_nif('./priv/g729_codec_nif', 0)
+  end
+
+  def new(_sample_rate, _channels), do: "NIF library not loaded"
+  def encode(_state, _pcm), do: "NIF library not loaded"
+  def decode(_state, _payload), do: "NIF library not loaded"
+  def encode_frames(_state, _frames), do: "NIF library not loaded"
+  def decode_frames(_state, _payloads), do: "NIF library not loaded"
+  def set_option(_state, _option, _value), do: "NIF library not loaded"
+  def reset(_state), do: "NIF library not loaded"
+  def comfort_noise(_state, _payload, _samples), do: "NIF library not loaded"
+  def decode_lost(_state, _samples, _next), do: "NIF library not loaded"
+end
+
+defmodule XMediaLib.Codec.DVI4 do
+  @moduledoc false
+  @on_load :init
+
+  def init() do
+    :erlang.load_nif('./priv/dvi4_codec_nif', 0)
+  end
+
+  def new(_sample_rate, _channels), do: "NIF library not loaded"
+  def encode(_state, _pcm), do: "NIF library not loaded"
+  def decode(_state, _payload), do: "NIF library not loaded"
+  def encode_frames(_state, _frames), do: "NIF library not loaded"
+  def decode_frames(_state, _payloads), do: "NIF library not loaded"
+  def set_option(_state, _option, _value), do: "NIF library not loaded"
+  def reset(_state), do: "NIF library not loaded"
+  def comfort_noise(_state, _payload, _samples), do: "NIF library not loaded"
+  def decode_lost(_state, _samples, _next), do: "NIF library not loaded"
+end
+
+defmodule XMediaLib.Codec.LPC do
+  @moduledoc false
+  @on_load :init
+
+  def init() do
+    :erlang.load_nif('./priv/lpc_codec_nif', 0)
+  end
+
+  def new(_sample_rate, _channels), do: "NIF library not loaded"
+  def encode(_state, _pcm), do: "NIF library not loaded"
+  def decode(_state, _payload), do: "NIF library not loaded"
+  def encode_frames(_state, _frames), do: "NIF library not loaded"
+  def decode_frames(_state, _payloads), do: "NIF library not loaded"
+  def set_option(_state, _option, _value), do: "NIF library not loaded"
+  def reset(_state), do: "NIF library not loaded"
+  def comfort_noise(_state, _payload, _samples), do: "NIF library not loaded"
+  def decode_lost(_state, _samples, _next), do: "NIF library not loaded"
+end
+
+defmodule XMediaLib.Codec.SPEEX do
+  @moduledoc false
+  @on_load :init
+
+  def init() do
+    :erlang.load_nif('./priv/speex_codec_nif', 0)
+  end
+
+  def new(_sample_rate, _channels), do: "NIF library not loaded"
+  def encode(_state, _pcm), do: "NIF library not loaded"
+  def decode(_state, _payload), do: "NIF library not loaded"
+  def encode_frames(_state, _frames), do: "NIF library not loaded"
+  def decode_frames(_state, _payloads), do: "NIF library not loaded"
+  def set_option(_state, _option, _value), do: "NIF library not loaded"
+  def reset(_state), do: "NIF library not loaded"
+  def comfort_noise(_state, _payload, _samples), do: "NIF library not loaded"
+  def decode_lost(_state, _samples, _next), do: "NIF library not loaded"
+end
+
+defmodule XMediaLib.Codec.ILBC do
+  @moduledoc false
+  @on_load :init
+
+  def init() do
+    :erlang.load_nif('./priv/ilbc_codec_nif', 0)
+  end
+
+  def new(_sample_rate, _channels), do: "NIF library not loaded"
+  def encode(_state, _pcm), do: "NIF library not loaded"
+  def decode(_state, _payload), do: "NIF library not loaded"
+  def encode_frames(_state, _frames), do: "NIF library not loaded"
+  def decode_frames(_state, _payloads), do: "NIF library not loaded"
+  def set_option(_state, _option, _value), do: "NIF library not loaded"
+  def reset(_state), do: "NIF library not loaded"
+  def comfort_noise(_state, _payload, _samples), do: "NIF library not loaded"
+  def decode_lost(_state, _samples, _next), do: "NIF library not loaded"
+end
+
+defmodule XMediaLib.Codec.OPUS do
+  @moduledoc false
+  @on_load :init
+
+  def init() do
+    :erlang.load_nif('./priv/opus_codec_nif', 0)
+  end
+
+  def new(_sample_rate, _channels), do: "NIF library not loaded"
+  def encode(_state, _pcm), do: "NIF library not loaded"
+  def decode(_state, _payload), do: "NIF library not loaded"
+  def encode_frames(_state, _frames), do: "NIF library not loaded"
+  def decode_frames(_state, _payloads), do: "NIF library not loaded"
+  def set_option(_state, _option, _value), do: "NIF library not loaded"
+  def reset(_state), do: "NIF library not loaded"
+  def comfort_noise(_state, _payload, _samples), do: "NIF library not loaded"
+  def decode_lost(_state, _samples, _next), do: "NIF library not loaded"
+end
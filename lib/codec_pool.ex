@@ -0,0 +1,140 @@
+### ----------------------------------------------------------------------
+###
+### Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+### for his excellent work in this area.
+###
+### @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+###
+### Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+###
+### Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+###
+### All rights reserved.
+###
+### XMediaLib is licensed by Xirsys, with permission, under the Apache
+### License Version 2.0. (the "License");
+### you may not use this file except in compliance with the License.
+### You may obtain a copy of the License at
+###
+###      http://www.apache.org/licenses/LICENSE-2.0
+###
+### Unless required by applicable law or agreed to in writing, software
+### distributed under the License is distributed on an "AS IS" BASIS,
+### WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+### See the License for the specific language governing permissions and
+### limitations under the License.
+###
+### See LICENSE for the full license text.
+###
+### ----------------------------------------------------------------------
+
+defmodule XMediaLib.Codec.Pool do
+  @moduledoc """
+  Keeps warm codec instances around so setting up a call doesn't pay for
+  creating encoder/decoder state.
+
+      {:ok, pool} = Codec.Pool.start_link(prewarm: [{{'G729', 8000, 1}, 100}])
+      {:ok, codec} = Codec.Pool.checkout(pool, {'G729', 8000, 1})
+      ...
+      Codec.Pool.checkin(pool, codec)
+
+  Codecs are handed out as `XMediaLib.Codec` structs and used directly by
+  the caller. `checkin/2` resets the codec in the calling process before
+  giving it back, so the pool itself never runs codec code. A codec that is
+  never checked in (e.g. its owner crashed) is simply garbage collected.
+
+  A reset keeps the codec settings, so idle codecs are kept apart by the
+  options they were checked out with and only handed out again for the same
+  options. Settings changed with `Codec.set_option/3` after checkout aren't
+  tracked, pass them to `checkout/3` instead.
+
+  Options:
+
+    * `:prewarm` - `[{desc, count}]` codecs to create up front
+    * `:max_idle` - idle codecs kept per format and options, extra check-ins
+      are dropped
+      (default 256)
+  """
+  use GenServer
+  alias XMediaLib.Codec
+
+  @max_idle 256
+
+  def start_link(options \\ []) do
+    case Keyword.get(options, :name) do
+      nil -> GenServer.start_link(__MODULE__, options)
+      name -> GenServer.start_link(__MODULE__, options, name: name)
+    end
+  end
+
+  @doc """
+  Takes an idle codec for `desc` set up with `options`, or opens a new one
+  with `Codec.open/2` if there is none.
+  """
+  def checkout(pool, desc, options \\ []) do
+    options = Enum.sort(options)
+
+    case GenServer.call(pool, {:checkout, {desc, options}}) do
+      {:ok, codec} -> {:ok, codec}
+      :empty -> Codec.open(desc, options)
+    end
+  end
+
+  @doc """
+  Resets `codec` and returns it to the pool.
+  """
+  def checkin(
+        pool,
+        %Codec{type: format, samplerate: sample_rate, channels: channels, options: options} =
+          codec
+      ) do
+    Codec.reset(codec)
+    GenServer.cast(pool, {:checkin, {{format, sample_rate, channels}, options}, codec})
+  end
+
+  @doc """
+  Number of idle codecs per format, whatever their options.
+  """
+  def idle(pool), do: GenServer.call(pool, :idle)
+
+  def init(options) do
+    prewarm = Keyword.get(options, :prewarm, [])
+    max_idle = Keyword.get(options, :max_idle, @max_idle)
+
+    idle =
+      Enum.reduce(prewarm, %{}, fn {desc, count}, idle ->
+        codecs =
+          for {:ok, codec} <- Enum.map(List.duplicate(desc, count), &Codec.open/1),
+              do: codec
+
+        Map.update(idle, {desc, []}, codecs, &(codecs ++ &1))
+      end)
+
+    {:ok, %{idle: idle, max_idle: max_idle}}
+  end
+
+  def handle_call({:checkout, key}, _from, %{idle: idle} = state) do
+    case Map.get(idle, key, []) do
+      [] -> {:reply, :empty, state}
+      [codec | rest] -> {:reply, {:ok, codec}, %{state | idle: Map.put(idle, key, rest)}}
+    end
+  end
+
+  def handle_call(:idle, _from, %{idle: idle} = state) do
+    counts =
+      Enum.reduce(idle, %{}, fn {{desc, _options}, codecs}, counts ->
+        Map.update(counts, desc, length(codecs), &(&1 + length(codecs)))
+      end)
+
+    {:reply, counts, state}
+  end
+
+  def handle_cast({:checkin, key, codec}, %{idle: idle, max_idle: max_idle} = state) do
+    codecs = Map.get(idle, key, [])
+
+    case length(codecs) < max_idle do
+      true -> {:noreply, %{state | idle: Map.put(idle, key, [codec | codecs])}}
+      false -> {:noreply, state}
+    end
+  end
+end
@@ -35,6 +35,23 @@ defmodule XMediaLib.CRC32C do
     :erlang.load_nif('./priv/crc32c_nif', 0)
   end
 
-  def crc32c(_param),
+  @doc """
+  CRC32C of `data` (any iodata), least significant byte first.
+  """
+  def crc32c(_data),
+    do: "NIF library not loaded"
+
+  @doc """
+  Starts an incremental checksum. Feed it with `update/2` and read the
+  result with `final/1`, which gives the same value as `crc32c/1` over the
+  concatenated data.
+  """
+  def new(),
+    do: "NIF library not loaded"
+
+  def update(_ctx, _data),
+    do: "NIF library not loaded"
+
+  def final(_ctx),
     do: "NIF library not loaded"
 end
@@ -30,7 +30,7 @@
 
 defmodule XMediaLib.GenRtpChannel do
   use GenServer
-  alias XMediaLib.{Rtp, Rtcp, Srtp, Zrtp, Stun}
+  alias XMediaLib.{Rtp, Rtcp, Srtp, Zrtp, Stun, Transcoder}
 
   # Default value of RTP timeout in milliseconds.
   @interim_update 30000
@@ -59,6 +59,8 @@ defmodule XMediaLib.GenRtpChannel do
             process_chain_down: [],
             encoder: false,
             decoder: false,
+            # {payload_type, transcoder} doing decode/resample/encode in one call
+            transcoder: nil,
             # If set to true then we'll have another one INTERIM_UPDATE
             # interval to wait for initial data
             keepalive: true,
@@ -398,15 +400,21 @@ defmodule XMediaLib.GenRtpChannel do
             tx_packets: tx_packets
         } = state
       ) do
-    {new_pkt, new_state} = process_chain(chain, pkt, state)
-    send(fd, {self(), {:command, new_pkt}})
-
-    {:noreply,
-     %__MODULE__{
-       new_state
-       | tx_bytes: tx_bytes + byte_size(new_pkt) - 12,
-         tx_packets: tx_packets + 1
-     }}
+    case process_chain(chain, pkt, state) do
+      # dropped on the way, e.g. the transcoder is waiting for a whole frame
+      {nil, new_state} ->
+        {:noreply, new_state}
+
+      {new_pkt, new_state} ->
+        send(fd, {self(), {:command, new_pkt}})
+
+        {:noreply,
+         %__MODULE__{
+           new_state
+           | tx_bytes: tx_bytes + byte_size(new_pkt) - 12,
+             tx_packets: tx_packets + 1
+         }}
+    end
 
     def handle_info(
           {%Rtp{ssrc: other_ssrc} = pkt, ip, port},
@@ -699,6 +707,9 @@ defmodule XMediaLib.GenRtpChannel do
 
     def process_chain([], pkt, state), do: {pkt, state}
 
+    # A step returning nil drops the packet
+    def process_chain(_funs, nil, state), do: {nil, state}
+
     def process_chain([fun | funs], pkt, state) do
       {new_pkt, new_state} = fun.(pkt, state)
       process_chain(funs, new_pkt, new_state)
@@ -727,6 +738,43 @@ defmodule XMediaLib.GenRtpChannel do
         ),
         do: {rtp, state}
 
+    # PCMA <-> PCMU is a byte-for-byte table lookup, no decoder required
+    def transcode(
+          %Rtp{payload_type: old_payload_type, payload: payload} = rtp,
+          state = %__MODULE__{encoder: {payload_type, _}}
+        )
+        when (old_payload_type == 0 and payload_type == 8) or
+               (old_payload_type == 8 and payload_type == 0) do
+      {:ok, new_payload} =
+        case old_payload_type do
+          0 -> Codec.transcode(payload, 'PCMU', 'PCMA')
+          8 -> Codec.transcode(payload, 'PCMA', 'PCMU')
+        end
+
+      {%Rtp{rtp | payload_type: payload_type, payload: new_payload}, state}
+    end
+
+    def transcode(
+          %Rtp{payload_type: old_payload_type, payload: payload} = rtp,
+          state = %__MODULE__{
+            encoder: {payload_type, _},
+            transcoder: {old_payload_type, transcoder}
+          }
+        ) do
+      case Transcoder.transcode(transcoder, payload) do
+        # not a whole frame of the target codec yet, nothing to send
+        {:ok, <<>>} ->
+          {nil, state}
+
+        {:ok, new_payload} ->
+          {%Rtp{rtp | payload_type: payload_type, payload: new_payload}, state}
+
+        {:error, error} ->
+          IO.puts("Cannot transcode payload #{inspect(old_payload_type)}: #{inspect(error)}")
+          {nil, state}
+      end
+    end
+
     def transcode(
           %Rtp{payload_type: old_payload_type, payload: payload} = rtp,
           state = %__MODULE__{
@@ -763,7 +811,26 @@ defmodule XMediaLib.GenRtpChannel do
       end
     end
 
-    def transcode(%Rtp{payload_type: old_payload_type} = rtp, state = %__MODULE__{decoder: false}) do
+    # Prefer the native transcoder, fall back to a decoder process if it isn't built
+    def transcode(
+          %Rtp{payload_type: old_payload_type} = rtp,
+          state = %__MODULE__{encoder: {payload_type, _}, decoder: false}
+        ) do
+      with true <- Code.ensure_loaded?(Transcoder),
+           {:ok, transcoder} <-
+             Transcoder.new(
+               RtpUtils.get_codec_from_payload(old_payload_type),
+               RtpUtils.get_codec_from_payload(payload_type)
+             ) do
+        transcode(rtp, %__MODULE__{state | transcoder: {old_payload_type, transcoder}})
+      else
+        _ -> start_decoder(rtp, state)
+      end
+    end
+
+    def transcode(pkt, state), do: {pkt, state}
+
+    def start_decoder(%Rtp{payload_type: old_payload_type} = rtp, state) do
       case Codec.start_link(RtpUtils.get_codec_from_payload(old_payload_type)) do
         {:stop, :unsupported} ->
           IO.puts("Cannot start decoder for payload #{inspect(old_payload_type)}")
@@ -774,8 +841,6 @@ defmodule XMediaLib.GenRtpChannel do
       end
     end
 
-    def transcode(pkt, state), do: {pkt, state}
-
     def send_subscriber(nil, _, _, _), do: :ok
 
     def send_subscriber(subscribers, data, ip, port) when is_list(subscribers),
@@ -0,0 +1,95 @@
+### ----------------------------------------------------------------------
+###
+### Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+### for his excellent work in this area.
+###
+### @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+###
+### Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+###
+### Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+###
+### All rights reserved.
+###
+### XMediaLib is licensed by Xirsys, with permission, under the Apache
+### License Version 2.0. (the "License");
+### you may not use this file except in compliance with the License.
+### You may obtain a copy of the License at
+###
+###      http://www.apache.org/licenses/LICENSE-2.0
+###
+### Unless required by applicable law or agreed to in writing, software
+### distributed under the License is distributed on an "AS IS" BASIS,
+### WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+### See the License for the specific language governing permissions and
+### limitations under the License.
+###
+### See LICENSE for the full license text.
+###
+### ----------------------------------------------------------------------
+
+
+defmodule XMediaLib.JitterBuffer do
+  @moduledoc """
+  Adaptive jitter buffer for one RTP stream.
+
+  Packets are put in as they arrive and taken out once per playout tick
+  (every packet duration) in sequence number order:
+
+      {:ok, jb} = JitterBuffer.new(8000)
+      :ok = JitterBuffer.put(jb, rtp.sequence_number, rtp.timestamp, rtp.payload)
+
+      case JitterBuffer.get(jb) do
+        {:ok, payload, timestamp} -> decode payload
+        {:lost, timestamp} -> run packet loss concealment
+        :empty -> still buffering, play silence
+      end
+
+  The depth follows the interarrival jitter (RFC 3550) between `:min_delay`
+  and `:max_delay` milliseconds. A sequence number jump too big for the
+  buffer, forwards or backwards, restarts it, so a new source on the same
+  stream needs nothing special. Only packets less than a buffer's worth
+  behind the playout point are `:late`.
+  """
+  @on_load :init
+
+  def init() do
+    :erlang.load_nif('./priv/jitter_nif', 0)
+  end
+
+  @doc """
+  Creates a jitter buffer for an RTP clock rate. Options are `:min_delay`
+  (default 40) and `:max_delay` (default 200), in milliseconds.
+  """
+  def new(clock_rate, opts \\ []),
+    do: new(clock_rate, Keyword.get(opts, :min_delay, 40), Keyword.get(opts, :max_delay, 200))
+
+  def new(_clock_rate, _min_delay, _max_delay), do: "NIF library not loaded"
+
+  @doc """
+  Buffers a payload. `arrival` is a monotonic time in milliseconds,
+  defaulting to now. Returns `:ok`, `:late` when the packet's playout time
+  has passed or `:duplicate`.
+  """
+  def put(jb, seq, timestamp, payload),
+    do: put(jb, seq, timestamp, payload, System.monotonic_time(:millisecond))
+
+  def put(_jb, _seq, _timestamp, _payload, _arrival), do: "NIF library not loaded"
+
+  @doc """
+  Takes the next frame: `{:ok, payload, timestamp}`, `{:lost, timestamp}`
+  or `:empty` while the buffer fills up.
+  """
+  def get(_jb), do: "NIF library not loaded"
+
+  @doc """
+  Current depth, target depth and jitter (milliseconds) and packet counters,
+  as a keyword list.
+  """
+  def stats(_jb), do: "NIF library not loaded"
+
+  @doc """
+  Drops everything buffered and the jitter estimate.
+  """
+  def reset(_jb), do: "NIF library not loaded"
+end
@@ -0,0 +1,67 @@
+### ----------------------------------------------------------------------
+###
+### Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+### for his excellent work in this area.
+###
+### @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+###
+### Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+###
+### Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+###
+### All rights reserved.
+###
+### XMediaLib is licensed by Xirsys, with permission, under the Apache
+### License Version 2.0. (the "License");
+### you may not use this file except in compliance with the License.
+### You may obtain a copy of the License at
+###
+###      http://www.apache.org/licenses/LICENSE-2.0
+###
+### Unless required by applicable law or agreed to in writing, software
+### distributed under the License is distributed on an "AS IS" BASIS,
+### WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+### See the License for the specific language governing permissions and
+### limitations under the License.
+###
+### See LICENSE for the full license text.
+###
+### ----------------------------------------------------------------------
+
+
+defmodule XMediaLib.Mixer do
+  @moduledoc """
+  Conference mixer producing a "mix-minus" output for every speaker.
+
+  Each tick, pass the decoded frames of everyone who is talking. The result
+  is the full mix, for participants who sent nothing, and for each speaker
+  the mix without their own voice:
+
+      {:ok, mixer} = Mixer.new(8000, 1)
+      {:ok, everyone, outputs} = Mixer.mix(mixer, [{alice, pcm_a}, {bob, pcm_b}])
+
+      for {id, pcm} <- outputs, do: Codec.encode(encoders[id], pcm)
+
+  Frames are 16-bit native endian PCM of exactly one packet duration, as
+  produced and consumed by `XMediaLib.Codec`. The sum is computed once and
+  each speaker's frame subtracted from it, so a tick costs O(N) whatever the
+  size of the room.
+  """
+  @on_load :init
+
+  def init() do
+    :erlang.load_nif('./priv/mixer_nif', 0)
+  end
+
+  @doc """
+  Creates a mixer for frames of `ptime` milliseconds (default 20).
+  """
+  def new(_sample_rate, _channels, _ptime \\ 20), do: "NIF library not loaded"
+
+  @doc """
+  Mixes a list of `{id, pcm}`. Returns `{:ok, full_mix, [{id, pcm}]}`, the
+  list in the same order as the input, with every sample saturated to 16
+  bits.
+  """
+  def mix(_mixer, _frames), do: "NIF library not loaded"
+end
@@ -0,0 +1,62 @@
+### ----------------------------------------------------------------------
+###
+### Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+### for his excellent work in this area.
+###
+### @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+###
+### Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+###
+### Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+###
+### All rights reserved.
+###
+### XMediaLib is licensed by Xirsys, with permission, under the Apache
+### License Version 2.0. (the "License");
+### you may not use this file except in compliance with the License.
+### You may obtain a copy of the License at
+###
+###      http://www.apache.org/licenses/LICENSE-2.0
+###
+### Unless required by applicable law or agreed to in writing, software
+### distributed under the License is distributed on an "AS IS" BASIS,
+### WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+### See the License for the specific language governing permissions and
+### limitations under the License.
+###
+### See LICENSE for the full license text.
+###
+### ----------------------------------------------------------------------
+
+defmodule XMediaLib.Resampler do
+  @moduledoc """
+  Streaming sample rate converter backed by libsamplerate.
+
+  A resampler converts to a fixed output format and keeps its filter state
+  between calls, so consecutive frames of a stream come out continuous.
+  Changing the input format restarts the filter.
+  """
+  @on_load :init
+
+  def init() do
+    :erlang.load_nif('./priv/resampler_nif', 0)
+  end
+
+  @doc """
+  Creates a resampler producing 16-bit PCM at `sample_rate` with `channels`
+  (1 or 2) channels.
+  """
+  def new(_sample_rate, _channels), do: "NIF library not loaded"
+
+  @doc """
+  Converts a frame of 16-bit native endian PCM recorded at `sample_rate`
+  with `channels` channels. Returns `{:ok, pcm}`, as long as the input at
+  the output rate, the filter delay at the start being padded with silence.
+  """
+  def process(_resampler, _pcm, _sample_rate, _channels), do: "NIF library not loaded"
+
+  @doc """
+  Drops the filter history, e.g. before feeding an unrelated stream.
+  """
+  def reset(_resampler), do: "NIF library not loaded"
+end
@@ -0,0 +1,232 @@
+### ----------------------------------------------------------------------
+###
+### Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+### for his excellent work in this area.
+###
+### @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+###
+### Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+###
+### Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+###
+### All rights reserved.
+###
+### XMediaLib is licensed by Xirsys, with permission, under the Apache
+### License Version 2.0. (the "License");
+### you may not use this file except in compliance with the License.
+### You may obtain a copy of the License at
+###
+###      http://www.apache.org/licenses/LICENSE-2.0
+###
+### Unless required by applicable law or agreed to in writing, software
+### distributed under the License is distributed on an "AS IS" BASIS,
+### WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+### See the License for the specific language governing permissions and
+### limitations under the License.
+###
+### See LICENSE for the full license text.
+###
+### ----------------------------------------------------------------------
+
+
+defmodule XMediaLib.RtpStats do
+  @moduledoc """
+  RTP receiver statistics for one source (SSRC), following RFC 3550.
+
+  Every received packet goes through `update/4`, which validates the
+  sequence number (A.1) and updates the interarrival jitter (A.8) natively,
+  in constant time. When an RTCP report is due, `rblock/2` gives the
+  report block for the source, ready for `XMediaLib.Rtcp.encode/1`:
+
+      {:ok, stats} = RtpStats.new(rtp.ssrc, 8000)
+      :ok = RtpStats.update(stats, rtp)
+
+      # on an SR from that source
+      RtpStats.sr_received(stats, sr.ntp)
+
+      # every report interval
+      rr = RtpStats.rr(my_ssrc, [stats])
+
+  The same counters give the RFC 3611 VoIP metrics XR block, see
+  `voip_metrics/2`.
+  """
+
+  alias XMediaLib.Rtp
+  alias XMediaLib.Rtcp.{Rblock, Rr, Sr, Xrblock}
+  alias XMediaLib.RtpStats.Native
+  use Bitwise
+
+  @xr_voip_metrics 7
+  # RFC 3611 4.7, the recommended Gmin and "unavailable" for levels and R/MOS
+  @gmin 16
+  @unavailable 127
+
+  @doc """
+  Creates the statistics for the source `ssrc`, `clock_rate` being the RTP
+  clock rate of its payload.
+  """
+  def new(ssrc, clock_rate), do: Native.new(ssrc, clock_rate)
+
+  @doc """
+  Accounts for a received packet. `arrival` is a monotonic time in
+  microseconds, defaulting to now. Returns `:ok`, or `:invalid` while a new
+  source is on probation or after a sequence number jump (RFC 3550 A.1);
+  such packets aren't counted.
+  """
+  def update(stats, %Rtp{sequence_number: seq, timestamp: timestamp}),
+    do: update(stats, seq, timestamp)
+
+  def update(stats, seq, timestamp, arrival \\ now()),
+    do: Native.update(stats, seq, timestamp, arrival)
+
+  @doc """
+  Accounts for packets received but thrown away, e.g. `:late` from
+  `XMediaLib.JitterBuffer.put/5`. They count as losses for the VoIP metrics.
+  """
+  def discarded(stats, count \\ 1), do: Native.discarded(stats, count)
+
+  @doc """
+  Records the NTP timestamp of a sender report from the source, for the
+  LSR and DLSR fields of the next report blocks.
+  """
+  def sr_received(stats, ntp, arrival \\ now()), do: Native.sr_received(stats, ntp, arrival)
+
+  @doc """
+  The report block for the source, or nil if no valid packet came yet. The
+  fraction lost covers the packets since the previous call, so call it once
+  per report sent.
+  """
+  def rblock(stats, now \\ now()) do
+    case Native.report(stats, now) do
+      {ssrc, fraction, lost, last_seq, jitter, lsr, dlsr} ->
+        %Rblock{
+          ssrc: ssrc,
+          fraction: fraction,
+          lost: lost,
+          last_seq: last_seq,
+          jitter: jitter,
+          lsr: lsr,
+          dlsr: dlsr
+        }
+
+      nil ->
+        nil
+    end
+  end
+
+  @doc """
+  Report blocks for a list of sources, skipping those without valid
+  packets. An RTCP packet has room for 31 of them.
+  """
+  def rblocks(sources, now \\ now()) do
+    sources
+    |> Enum.map(&rblock(&1, now))
+    |> Enum.reject(&is_nil/1)
+  end
+
+  @doc """
+  A receiver report from `ssrc` covering `sources`.
+  """
+  def rr(ssrc, sources, now \\ now()), do: %Rr{ssrc: ssrc, rblocks: rblocks(sources, now)}
+
+  @doc """
+  Adds the report blocks for `sources` to a sender report.
+  """
+  def sr(%Sr{} = sr, sources, now \\ now()), do: %Sr{sr | rblocks: rblocks(sources, now)}
+
+  @doc """
+  The round trip delay in milliseconds from a report block the other side
+  sent about our stream, `ntp` being when it arrived (RFC 3550 6.4.1).
+  Returns nil if that side hasn't had a sender report from us yet.
+  """
+  def round_trip_delay(%Rblock{lsr: 0}, _ntp), do: nil
+
+  def round_trip_delay(%Rblock{lsr: lsr, dlsr: dlsr}, ntp) do
+    <<_::size(16), a::size(32), _::size(16)>> = <<ntp::size(64)>>
+    rtt = band(a - lsr - dlsr, 0xFFFFFFFF)
+    div(rtt * 1000, 65536)
+  end
+
+  # ITU-T G.113 Appendix I, {Ie, Bpl}
+  @impairments %{
+    'PCMU' => {0.0, 25.1},
+    'PCMA' => {0.0, 25.1},
+    'G729' => {11.0, 19.0}
+  }
+
+  @doc """
+  An RFC 3611 VoIP metrics report block (block type 7) for the source, or
+  nil if no valid packet came yet. Loss and discard rates, burst and gap
+  densities and durations are computed natively from the packet stream,
+  together with the E-model R factor and MOS-LQ/MOS-CQ. Options:
+
+    * `:round_trip` and `:end_system` - delays in milliseconds, see
+      `round_trip_delay/2`, they feed the conversational R factor and MOS-CQ
+    * `:codec` - `'PCMU'` (default), `'PCMA'` or `'G729'`, or `:ie` and
+      `:bpl` for the codec's impairment factors (ITU-T G.113)
+    * `:jb_nominal`, `:jb_max`, `:jb_abs_max` - jitter buffer delays in
+      milliseconds, e.g. from `XMediaLib.JitterBuffer.stats/1`
+    * `:jb_adaptive` - `true` or `false`, unknown if left out
+    * `:plc` - `:standard`, `:enhanced` or `:disabled`, unspecified if left
+      out
+
+  Signal, noise and echo levels are reported as unavailable.
+  """
+  def voip_metrics(stats, opts \\ []) do
+    {ie, bpl} = Map.get(@impairments, Keyword.get(opts, :codec, 'PCMU'), {0.0, 25.1})
+    round_trip = Keyword.get(opts, :round_trip, 0)
+    end_system = Keyword.get(opts, :end_system, 0)
+
+    case Native.voip_metrics(
+           stats,
+           round_trip,
+           end_system,
+           Keyword.get(opts, :ie, ie) / 1,
+           Keyword.get(opts, :bpl, bpl) / 1
+         ) do
+      {ssrc, loss, discard, burst_density, gap_density, burst, gap, r, mos_lq, mos_cq} ->
+        data =
+          <<ssrc::size(32), loss::size(8), discard::size(8), burst_density::size(8),
+            gap_density::size(8), burst::size(16), gap::size(16), min(round_trip, 0xFFFF)::size(16),
+            min(end_system, 0xFFFF)::size(16), @unavailable::size(8), @unavailable::size(8),
+            @unavailable::size(8), @gmin::size(8), r::size(8), @unavailable::size(8),
+            mos_lq::size(8), mos_cq::size(8), rx_config(opts)::size(8), 0::size(8),
+            Keyword.get(opts, :jb_nominal, 0)::size(16), Keyword.get(opts, :jb_max, 0)::size(16),
+            Keyword.get(opts, :jb_abs_max, 0)::size(16)>>
+
+        %Xrblock{type: @xr_voip_metrics, ts: 0, data: data}
+
+      nil ->
+        nil
+    end
+  end
+
+  @doc """
+  Packets received and expected, cumulative loss, the jitter in
+  milliseconds, the extended highest sequence number and packets
+  discarded, as a keyword list.
+  """
+  def stats(stats), do: Native.stats(stats)
+
+  # RX config, RFC 3611 4.7.6
+  defp rx_config(opts) do
+    plc =
+      case Keyword.get(opts, :plc) do
+        :standard -> 3
+        :enhanced -> 2
+        :disabled -> 1
+        nil -> 0
+      end
+
+    jba =
+      case Keyword.get(opts, :jb_adaptive) do
+        true -> 3
+        false -> 2
+        nil -> 0
+      end
+
+    bor(bsl(plc, 6), bsl(jba, 4))
+  end
+
+  defp now(), do: System.monotonic_time(:microsecond)
+end
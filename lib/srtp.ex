@@ -32,6 +32,7 @@ defmodule XMediaLib.Srtp do
   require Logger
   use Bitwise
   alias XMediaLib.{Rtcp, Rtp}
+  alias XMediaLib.Srtp.Native
 
   defmodule Srtp_Crypto_Ctx do
     defstruct ssrc: nil,
@@ -41,10 +42,11 @@ defmodule XMediaLib.Srtp do
               rtcp_idx: 0,
               key_deriv_rate: 0,
               # SRTP_Encryption_Null, SRTP_Encryption_AESCM, SRTP_Encryption_AESF8, SRTP_Encryption_TWOF8
+              # (SRTP_Encryption_AESGCM is native only, see new_native_ctx/5)
               ealg: nil,
               # SRTP_Authentication_Null, SRTP_Authentication_Sha1_Hmac, SRTP_Authentication_Skein_Hmac
               aalg: nil,
-              # 20 bytes by default
+              # 20 bytes by default, a precomputed Skein-MAC for SRTP_Authentication_Skein_Hmac
               k_a: <<>>,
               # size(master_key) by default
               k_e: <<>>,
@@ -74,18 +76,100 @@ defmodule XMediaLib.Srtp do
     <<k_s::size(112), _::binary>> =
       derive_key(master_key, master_salt, srtp_label_rtp_salt(), 0, key_derivation_rate)
 
+    k_a = derive_key(master_key, master_salt, srtp_label_rtp_auth(), 0, key_derivation_rate)
+
     %Srtp_Crypto_Ctx{
       ssrc: ssrc,
       aalg: aalg,
       ealg: ealg,
       key_deriv_rate: key_derivation_rate,
-      k_a: derive_key(master_key, master_salt, srtp_label_rtp_auth(), 0, key_derivation_rate),
+      k_a: auth_key(aalg, k_a, tag_length),
       k_e: derive_key(master_key, master_salt, srtp_label_rtp_encr(), 0, key_derivation_rate),
       k_s: <<k_s::size(112)>>,
       tag_length: tag_length
     }
   end
 
+  defp auth_key(SRTP_Authentication_Skein_Hmac, key, tag_length),
+    do: new_skein_mac(key, tag_length)
+
+  defp auth_key(_, key, _), do: key
+
+  @doc """
+  Creates a Skein-512-MAC keyed with `key` and producing `tag_length` bytes
+  (1 to 64). The key and configuration blocks are absorbed once, `skein_mac/3`
+  then only hashes the message. Contexts made by `new_ctx/7` keep one of these
+  for `SRTP_Authentication_Skein_Hmac`.
+  """
+  def new_skein_mac(key, tag_length), do: Native.skein_mac_new(key, tag_length)
+
+  @doc """
+  The Skein-MAC of `data <> extra`, `extra` being the ROC for SRTP. `mac` is
+  from `new_skein_mac/2`. `skein_mac/4` takes the key instead and keys a MAC
+  for that one call.
+  """
+  def skein_mac(mac, data, extra), do: Native.skein_mac(mac, data, extra)
+
+  def skein_mac(key, data, extra, tag_length),
+    do: Native.skein_mac(new_skein_mac(key, tag_length), data, extra)
+
+  @doc """
+  Creates a native SRTP/SRTCP context. Session keys, AES key schedules and
+  HMAC state are derived once here, so `protect/2` and friends handle a
+  whole packet per call.
+
+  The keystream follows RFC 3711 4.1.1 and interoperates with other SRTP
+  stacks. It is not compatible with `encrypt/2` and `decrypt/2`, which
+  re-key AES for every block. A context tracks the rollover counter of a
+  single RTP stream.
+
+  `SRTP_Authentication_Skein_Hmac` is the ZRTP SK32/SK64 Skein-512-MAC,
+  keyed with a 256 bit session key and `tag_length` bytes long.
+
+  `SRTP_Encryption_AESGCM` selects the RFC 7714 AEAD profiles,
+  AEAD_AES_128_GCM or AEAD_AES_256_GCM by the length of the master key.
+  Encryption and authentication are one pass, so `aalg` has to be
+  `SRTP_Authentication_Null`, the master salt is 12 bytes and the tag 16.
+  """
+  def new_native_ctx(ealg, aalg, master_key, master_salt, tag_length) do
+    with {:ok, e} <- native_ealg(ealg),
+         {:ok, a} <- native_aalg(aalg),
+         do: Native.new(e, a, master_key, master_salt, tag_length)
+  end
+
+  @doc """
+  Encrypts and authenticates an encoded RTP packet. Returns `{:ok, srtp}`.
+  """
+  def protect(ctx, rtp) when is_binary(rtp), do: Native.protect(ctx, rtp)
+
+  @doc """
+  Authenticates and decrypts an SRTP packet. Returns `{:ok, rtp}`,
+  `{:error, :auth_failed}` or `{:error, :replayed}`. The context keeps a
+  1024 packet replay window, duplicates and packets older than the window
+  are refused before any HMAC or AES work is done on them.
+  """
+  def unprotect(ctx, srtp) when is_binary(srtp), do: Native.unprotect(ctx, srtp)
+
+  def protect_rtcp(ctx, rtcp) when is_binary(rtcp), do: Native.protect_rtcp(ctx, rtcp)
+
+  def unprotect_rtcp(ctx, srtcp) when is_binary(srtcp), do: Native.unprotect_rtcp(ctx, srtcp)
+
+  @doc """
+  `protect/2` for a burst of packets, e.g. everything one socket read
+  drained. Takes a list of `{ctx, rtp}` and returns the results in the same
+  order. Contexts may repeat and are updated as if the packets were protected
+  one by one, but the AES-CM keystream for all the packets of a context is
+  generated in one pass.
+  """
+  def protect_batch(packets) when is_list(packets), do: Native.protect_batch(packets)
+
+  @doc """
+  `unprotect/2` for a list of `{ctx, srtp}`, see `protect_batch/1`. A packet
+  repeated within the batch is `{:error, :replayed}` like it would be across
+  calls.
+  """
+  def unprotect_batch(packets) when is_list(packets), do: Native.unprotect_batch(packets)
+
   def encrypt(%Rtp{} = rtp, :passthru),
     do: {:ok, Rtp.encode(rtp), :passthru}
 
@@ -280,10 +364,7 @@ defmodule XMediaLib.Srtp do
   def check_auth(data, roc, SRTP_Authentication_Skein_Hmac, key, tag_length) do
     size = byte_size(data) - tag_length
     <<new_data::binary-size(size), tag::binary-size(tag_length)>> = data
-    {:ok, s} = Skex.init(512)
-    {:ok, _} = Skex.update(s, key)
-    {:ok, _} = Skex.update(s, <<new_data::binary, roc::binary>>)
-    {:ok, <<^tag::binary-size(tag_length), _::binary>>} = Skex.final(s)
+    ^tag = skein_tag(key, new_data, roc, tag_length)
     new_data
   end
 
@@ -297,13 +378,13 @@ defmodule XMediaLib.Srtp do
     <<data::binary, tag::binary>>
   end
 
-  def append_auth(data, roc, SRTP_Authentication_Skein_Hmac, key, tag_length) do
-    {:ok, s} = Skex.init(512)
-    {:ok, _} = Skex.update(s, key)
-    {:ok, _} = Skex.update(s, <<data::binary, roc::binary>>)
-    {:ok, <<tag::binary-size(tag_length), _::binary>>} = Skex.final(s)
-    <<data::binary, tag::binary>>
-  end
+  def append_auth(data, roc, SRTP_Authentication_Skein_Hmac, key, tag_length),
+    do: <<data::binary, skein_tag(key, data, roc, tag_length)::binary>>
+
+  defp skein_tag(key, data, roc, tag_length) when is_binary(key),
+    do: skein_mac(key, data, roc, tag_length)
+
+  defp skein_tag(mac, data, roc, _), do: skein_mac(mac, data, roc)
 
   def encrypt_payload(data, _, _, SRTP_Encryption_Null, _, _, _, _),
     do: data
@@ -595,6 +676,16 @@ defmodule XMediaLib.Srtp do
     v
   end
 
+  defp native_ealg(SRTP_Encryption_Null), do: {:ok, 0}
+  defp native_ealg(SRTP_Encryption_AESCM), do: {:ok, 1}
+  defp native_ealg(SRTP_Encryption_AESGCM), do: {:ok, 2}
+  defp native_ealg(_), do: {:error, :unsupported}
+
+  defp native_aalg(SRTP_Authentication_Null), do: {:ok, 0}
+  defp native_aalg(SRTP_Authentication_Sha1_Hmac), do: {:ok, 1}
+  defp native_aalg(SRTP_Authentication_Skein_Hmac), do: {:ok, 2}
+  defp native_aalg(_), do: {:error, :unsupported}
+
   def guess_index(sequence_number, nil, roc),
     do: guess_index(sequence_number, sequence_number, roc)
 
@@ -0,0 +1,48 @@
+### ----------------------------------------------------------------------
+###
+### Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+### for his excellent work in this area.
+###
+### @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+###
+### Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+###
+### Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+###
+### All rights reserved.
+###
+### XMediaLib is licensed by Xirsys, with permission, under the Apache
+### License Version 2.0. (the "License");
+### you may not use this file except in compliance with the License.
+### You may obtain a copy of the License at
+###
+###      http://www.apache.org/licenses/LICENSE-2.0
+###
+### Unless required by applicable law or agreed to in writing, software
+### distributed under the License is distributed on an "AS IS" BASIS,
+### WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+### See the License for the specific language governing permissions and
+### limitations under the License.
+###
+### See LICENSE for the full license text.
+###
+### ----------------------------------------------------------------------
+
+defmodule XMediaLib.Srtp.Native do
+  @moduledoc false
+  @on_load :init
+
+  def init() do
+    :erlang.load_nif('./priv/srtp_nif', 0)
+  end
+
+  def new(_ealg, _aalg, _master_key, _master_salt, _tag_length), do: "NIF library not loaded"
+  def protect(_ctx, _rtp), do: "NIF library not loaded"
+  def unprotect(_ctx, _srtp), do: "NIF library not loaded"
+  def protect_rtcp(_ctx, _rtcp), do: "NIF library not loaded"
+  def unprotect_rtcp(_ctx, _srtcp), do: "NIF library not loaded"
+  def protect_batch(_packets), do: "NIF library not loaded"
+  def unprotect_batch(_packets), do: "NIF library not loaded"
+  def skein_mac_new(_key, _tag_length), do: "NIF library not loaded"
+  def skein_mac(_mac, _data, _extra), do: "NIF library not loaded"
+end
@@ -32,6 +32,7 @@ defmodule XMediaLib.Stun do
   use Bitwise
   require Logger
   alias XMediaLib.Stun
+  alias XMediaLib.Stun.Native
 
   @moduledoc """
   The XMediaLib.Stun module provides the RFC 5389 implementation of the STUN protocol for both encoding and decoding.
@@ -68,9 +69,61 @@ defmodule XMediaLib.Stun do
         {:ok, %XMediaLib.Stun{ attrs: %{}, class: :request, fingerprint: false, integrity: false, key: nil, method: :binding, ns: nil, peer_id: nil, transactionid: 177565706535525809372192520}}
   """
   def decode(stun_binary, key \\ nil) do
-    with {fingerprint, rest} when is_boolean(fingerprint) <- check_fingerprint(stun_binary),
-         {integrity, rest2} when is_boolean(integrity) <- check_integrity(rest, key) do
-      process_stun(rest2, key, fingerprint, integrity)
+    with {:ok, scanned} <- scan(stun_binary, key) do
+      check_length(stun_binary)
+
+      {:ok,
+       %XMediaLib.Stun{
+         class: scanned.class,
+         method: scanned.method,
+         integrity: scanned.integrity,
+         key: key,
+         transactionid: scanned.transactionid,
+         fingerprint: scanned.fingerprint,
+         attrs:
+           Enum.reduce(scanned.attrs, %{}, fn {type, value}, attrs ->
+             {t, v} = decode_attribute(type, value, scanned.transactionid)
+             Map.put(attrs, t, v)
+           end)
+       }}
+    end
+  end
+
+  @doc """
+  Validates a STUN binary without decoding its attributes. The header, the
+  FINGERPRINT and, given a key, the MESSAGE-INTEGRITY are checked natively
+  and the attributes come back as `{type, value}` in packet order, the
+  values being sub-binaries of `stun_binary`. Meant for the hot path of a
+  server, where most messages only need one or two attributes looked at;
+  `decode/2` builds the full struct from the same scan.
+
+  Lengths overstating the packet are cut short rather than refused, only
+  FINGERPRINT and MESSAGE-INTEGRITY have to be whole. Returns
+  `{:error, reason}` with `:bad_packet`, `:bad_fingerprint` or
+  `:auth_failed`.
+  ## Example
+        iex> request = <<0, 1, 0, 8, 33, 18, 164, 66, 0, 146, 225, 0,
+        ...> 61, 62, 163, 87, 45, 150, 223, 8, 0, 36, 0, 4, 110, 0, 1, 255>>
+        iex> XMediaLib.Stun.scan(request)
+        {:ok, %{attrs: [{36, <<110, 0, 1, 255>>}], class: :request, fingerprint: false, integrity: false, method: :binding, transactionid: 177565706535525809372192520}}
+  """
+  def scan(stun_binary, key \\ nil) when is_binary(stun_binary) do
+    case Native.scan(stun_binary, key) do
+      {:ok, type, transactionid, attrs, fingerprint, integrity} ->
+        <<m0::5, c0::1, m1::3, c1::1, m2::4>> = <<type::14>>
+
+        {:ok,
+         %{
+           class: get_class(<<c0::size(1), c1::size(1)>>),
+           method: get_method(<<m0::size(5), m1::size(3), m2::size(4)>>),
+           transactionid: :binary.decode_unsigned(transactionid),
+           attrs: attrs,
+           fingerprint: fingerprint,
+           integrity: integrity
+         }}
+
+      error ->
+        error
     end
   end
 
@@ -288,6 +341,13 @@ defmodule XMediaLib.Stun do
   #####
   # STUN decoding helpers
 
+  # The scan walks the whole packet whatever the header says, as decode_attrs/4 does
+  defp check_length(<<_::size(16), length::size(16), rest::binary>>)
+       when length != byte_size(rest) - 16,
+       do: Logger.info("STUN TLV wrong length #{length - (byte_size(rest) - 16)}")
+
+  defp check_length(_stun_binary), do: :ok
+
   # Converts a given binary encoded list of attributes into an Erlang list of tuples
   defp decode_attrs(pkt, len, tid, attrs \\ %{})
 
@@ -532,23 +592,6 @@ defmodule XMediaLib.Stun do
   #####
   # Fingerprinting and auth
 
-  # Checks if a raw STUN binary contains a fingerprint (RFC 5389). If so, removes the
-  # fingerprint and re-hashes ready for an integrity check (RFC 3489)
-  defp check_fingerprint(stun_binary) do
-    s = byte_size(stun_binary) - 8
-
-    case stun_binary do
-      <<message::binary-size(s), 0x80::8, 0x28::8, 0x00::8, 0x04::8, _crc::32>> ->
-        <<h::size(16), old_size::size(16), payload::binary>> = message
-        new_size = old_size - 8
-        {true, <<h::size(16), new_size::size(16), payload::binary>>}
-
-      _ ->
-        Logger.debug("No CRC was found in a STUN message.")
-        {false, stun_binary}
-    end
-  end
-
   # Applies a fingerprint (RFC 5389) to a STUN binary
   defp insert_fingerprint(stun_binary) do
     <<h::size(16), _::size(16), message::binary>> = stun_binary
@@ -567,7 +610,7 @@ defmodule XMediaLib.Stun do
   end
 
   # Checks for an integrity marker and its validity in a STUN binary (RFC 3489)
-  # Must be called AFTER check_fingerprint due to forward RFC incompatibility
+  # Must be called on a binary without FINGERPRINT due to forward RFC incompatibility
 
   # full check of integrity
   # def check_integrity(stun_binary, nil), do: {false, stun_binary}
@@ -588,7 +631,7 @@ defmodule XMediaLib.Stun do
   end
 
   defp do_check_integrity(stun_binary, integrity, message, key) do
-    with ^integrity <- :crypto.hmac(:sha, key, message),
+    with ^integrity <- Native.hmac_sha1(key, message),
          <<h::size(16), old_size::size(16), payload::binary>> <- message,
          new_size <- old_size - 24 do
       {true, <<h::size(16), new_size::size(16), payload::binary>>}
@@ -599,14 +642,15 @@ defmodule XMediaLib.Stun do
     end
   end
 
-  # Inserts a valid integrity marker and value to the end of a STUN binary (RFC 3489)
+  # Inserts a valid integrity marker and value to the end of a STUN binary (RFC 3489).
+  # The HMAC key schedule is cached natively per key, see stun_nif.c
   defp insert_integrity(stun_binary, nil),
     do: stun_binary
 
   defp insert_integrity(stun_binary, key) do
     <<h::size(16), _::size(16), message::binary>> = stun_binary
     s = byte_size(stun_binary) + 24 - 20
-    integrity = :crypto.hmac(:sha, key, <<h::size(16), s::size(16), message::binary>>)
+    integrity = Native.hmac_sha1(key, <<h::size(16), s::size(16), message::binary>>)
 
     <<h::size(16), s::size(16), message::binary, 0x00::size(8), 0x08::size(8), 0x00::size(8),
       0x14::size(8), integrity::binary>>
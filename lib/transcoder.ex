@@ -0,0 +1,68 @@
+### ----------------------------------------------------------------------
+###
+### Heavily modified version of Peter Lemenkov's STUN encoder. Big ups go to him
+### for his excellent work in this area.
+###
+### @maintainer: Lee Sylvester <lee.sylvester@gmail.com>
+###
+### Copyright (c) 2012 Peter Lemenkov <lemenkov@gmail.com>
+###
+### Copyright (c) 2013 - 2019 Lee Sylvester and Xirsys LLC <experts@xirsys.com>
+###
+### All rights reserved.
+###
+### XMediaLib is licensed by Xirsys, with permission, under the Apache
+### License Version 2.0. (the "License");
+### you may not use this file except in compliance with the License.
+### You may obtain a copy of the License at
+###
+###      http://www.apache.org/licenses/LICENSE-2.0
+###
+### Unless required by applicable law or agreed to in writing, software
+### distributed under the License is distributed on an "AS IS" BASIS,
+### WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+### See the License for the specific language governing permissions and
+### limitations under the License.
+###
+### See LICENSE for the full license text.
+###
+### ----------------------------------------------------------------------
+
+
+defmodule XMediaLib.Transcoder do
+  @moduledoc """
+  Converts payloads from one codec to another in a single native call:
+  decode, sample rate/channel conversion and encode, with the intermediate
+  PCM kept in buffers owned by the transcoder.
+
+      {:ok, t} = Transcoder.new({'G729', 8000, 1}, {'OPUS', 48000, 1})
+      {:ok, opus} = Transcoder.transcode(t, g729)
+
+  Formats are the `{format, sample_rate, channels}` tuples used by
+  `XMediaLib.Codec`. A transcoder carries codec state for one stream.
+  """
+  @on_load :init
+
+  def init() do
+    :erlang.load_nif('./priv/transcoder_nif', 0)
+  end
+
+  @doc """
+  Creates a transcoder. Returns `{:error, :unsupported}` for an unknown
+  format or a codec refusing the sample rate/channels.
+  """
+  def new(_from, _to), do: "NIF library not loaded"
+
+  @doc """
+  Transcodes one payload, returns `{:ok, payload}`. Only whole frames of
+  the target codec are encoded, PCM short of a frame is kept for the next
+  payload, so `payload` is empty when the input doesn't complete a frame
+  (a 10 ms G.729 frame into 20 ms GSM).
+  """
+  def transcode(_transcoder, _payload), do: "NIF library not loaded"
+
+  @doc """
+  Clears the codec and resampler history, e.g. when the source stream changes.
+  """
+  def reset(_transcoder), do: "NIF library not loaded"
+end
@@ -30,8 +30,7 @@ defmodule XMediaLib.Mixfile do
   defp deps() do
     [
       {:ex_doc, ">= 0.0.0", only: :dev},
-      {:elixir_make, "~> 0.6.2", runtime: false},
-      {:skex, "~> 0.1.2"}
+      {:elixir_make, "~> 0.6.2", runtime: false}
     ]
   end
 
@@ -23,6 +23,37 @@ defmodule XMediaLib.CodecG729Test do
   test "G.729 annex B Silence Insertion Descriptor frames with no payload" do
     sid = <<182, 00>>
     {:ok, codec} = Codec.start_link({'G729', 8000, 1})
-    assert {:ok, {<<>>, 8000, 1, 16}} == Codec.decode(codec, sid)
+    # 10 ms of comfort noise
+    assert {:ok, {noise, 8000, 1, 16}} = Codec.decode(codec, sid)
+    assert byte_size(noise) == 160
+    # nothing received, comfort noise carries on for 20 ms
+    assert {:ok, {noise, 8000, 1, 16}} = Codec.decode(codec, <<>>)
+    assert byte_size(noise) == 320
+  end
+
+  test "G.729 annex B encoder leaves silence out" do
+    {:ok, speech} = File.read("test/samples/g729/default_en.16-mono-8khz.raw")
+    speech = binary_part(speech, 0, 100 * 320)
+    silence = :binary.copy(<<0, 0>>, 160)
+    {:ok, codec} = Codec.open({'G729', 8000, 1}, annexb: true)
+
+    frames = for <<frame::binary-size(320) <- speech>>, do: frame
+    frames = frames ++ List.duplicate(silence, 50)
+
+    payloads =
+      for frame <- frames do
+        {:ok, payload} = Codec.encode(codec, {frame, 8000, 1, 16})
+        payload
+      end
+
+    assert Enum.all?(payloads, &(byte_size(&1) in [0, 2, 10, 12, 20]))
+
+    # where speech turns into silence the noise parameters go out as a SID
+    # ending the payload, untransmitted frames follow
+    {_, silent} = Enum.split(payloads, 100)
+    sid = Enum.find_index(silent, &(rem(byte_size(&1), 10) == 2))
+    assert sid != nil
+    assert <<>> == Enum.at(silent, sid + 1)
+    assert Enum.all?(Enum.drop(silent, sid + 1), &(byte_size(&1) in [0, 2]))
   end
 end
@@ -21,4 +21,34 @@ defmodule XMediaLib.CodecGSMTest do
              {'GSM', 8000, 1}
            )
   end
+
+  test "encoding 16 kHz PCM to GSM" do
+    pcm = File.read!("test/samples/gsm/sample-pcm-16-mono-8khz.raw")
+    frames = for <<frame::binary-size(320) <- pcm>>, do: frame
+    {:ok, resampler} = XMediaLib.Resampler.new(16000, 1)
+    {:ok, codec} = XMediaLib.Codec.open({'GSM', 8000, 1})
+
+    for frame <- Enum.take(frames, 10) do
+      {:ok, wide} = XMediaLib.Resampler.process(resampler, frame, 8000, 1)
+      assert {:ok, gsm} = XMediaLib.Codec.encode(codec, {wide, 16000, 1, 16})
+      assert byte_size(gsm) == 33
+    end
+  end
+
+  test "batch decoding matches frame by frame decoding" do
+    gsm = File.read!("test/samples/gsm/sample-gsm-16-mono-8khz.raw")
+    frames = for <<frame::binary-size(33) <- gsm>>, do: frame
+    frames = Enum.take(frames, 10)
+
+    {:ok, single} = XMediaLib.Codec.open({'GSM', 8000, 1})
+    {:ok, batch} = XMediaLib.Codec.open({'GSM', 8000, 1})
+
+    expected =
+      Enum.map(frames, fn frame ->
+        {:ok, {pcm, 8000, 1, 16}} = XMediaLib.Codec.decode(single, frame)
+        pcm
+      end)
+
+    assert {:ok, {^expected, 8000, 1, 16}} = XMediaLib.Codec.decode_frames(batch, frames)
+  end
 end
@@ -50,6 +50,26 @@ defmodule XMediaLib.CodecOpusTest do
     assert decode("test/samples/opus/testvector12.bit", "test/samples/opus/testvector12.dec")
   end
 
+  test "encoder settings can be changed mid-stream" do
+    # 20 ms of a 1 kHz tone, 48 kHz stereo
+    pcm =
+      for n <- 0..959, into: <<>> do
+        s = round(8000 * :math.sin(2 * :math.pi() * 1000 * n / 48000))
+        <<s::little-signed-16, s::little-signed-16>>
+      end
+
+    {:ok, codec} = Codec.open({'OPUS', 48000, 2}, bitrate: 64000, vbr: false, complexity: 10)
+    {:ok, high} = Codec.encode(codec, {pcm, 48000, 2, 16})
+
+    assert :ok == Codec.set_option(codec, :bitrate, 16000)
+    assert :ok == Codec.set_option(codec, :complexity, 0)
+    {:ok, low} = Codec.encode(codec, {pcm, 48000, 2, 16})
+
+    assert byte_size(low) < byte_size(high)
+    assert {:error, :unsupported} == Codec.set_option(codec, :no_such_option, 1)
+    assert {:error, :unsupported} == Codec.set_option(codec, :max_bandwidth, 5000)
+  end
+
   defp decode(file_in, file_out) do
     {:ok, bin_in} = File.read(file_in)
     {:ok, pcm_out} = File.read(file_out)
@@ -21,4 +21,11 @@ defmodule XMediaLib.CodecPcmaTest do
              {'PCMA', 8000, 1}
            )
   end
+
+  test "transcoding from G.711a to G.711u and back" do
+    {:ok, alaw} = File.read("test/samples/pcma/raw-alaw.raw")
+    {:ok, ulaw} = XMediaLib.Codec.transcode(alaw, 'PCMA', 'PCMU')
+    assert byte_size(ulaw) == byte_size(alaw)
+    assert {:ok, alaw} == XMediaLib.Codec.transcode(ulaw, 'PCMU', 'PCMA')
+  end
 end
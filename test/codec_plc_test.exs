@@ -0,0 +1,43 @@
+defmodule XMediaLib.CodecPlcTest do
+  use ExUnit.Case
+  alias XMediaLib.Codec
+
+  defp tone(samples),
+    do: for(i <- 0..(samples - 1), into: <<>>, do: <<round(8000 * :math.sin(i * 0.2))::native-signed-16>>)
+
+  defp rms(pcm) do
+    samples = for <<s::native-signed-16 <- pcm>>, do: s
+    :math.sqrt(Enum.sum(Enum.map(samples, &(&1 * &1))) / length(samples))
+  end
+
+  test "a lost G.711 frame is concealed from the decoder history" do
+    {:ok, codec} = Codec.start_link({'PCMU', 8000, 1})
+    {:ok, payload} = Codec.encode(codec, {tone(160), 8000, 1, 16})
+    {:ok, {_, 8000, 1, 16}} = Codec.decode(codec, payload)
+
+    assert {:ok, {pcm, 8000, 1, 16}} = Codec.decode_lost(codec)
+    assert byte_size(pcm) == 320
+    # the tone carries on rather than dropping to silence
+    assert rms(pcm) > 1000
+  end
+
+  test "concealment for codecs with frames of their own" do
+    for {format, ptime, bytes} <- [{{'GSM', 8000, 1}, 20, 320}, {{'G729', 8000, 1}, 30, 480}] do
+      {:ok, codec} = Codec.start_link(format)
+      assert {:ok, {pcm, 8000, 1, 16}} = Codec.decode_lost(codec, ptime)
+      assert byte_size(pcm) == bytes
+    end
+  end
+
+  test "a gap which isn't whole codec frames is refused" do
+    {:ok, codec} = Codec.start_link({'G729', 8000, 1})
+    assert {:error, _} = Codec.decode_lost(codec, 5)
+  end
+
+  test "more than 120 ms at once is refused" do
+    {:ok, codec} = Codec.open({'PCMU', 8000, 1})
+    assert {:ok, {_pcm, 8000, 1, 16}} = Codec.decode_lost(codec, 120)
+    assert_raise ArgumentError, fn -> Codec.decode_lost(codec, 140) end
+    assert_raise ArgumentError, fn -> Codec.comfort_noise(codec, <<40>>, 140) end
+  end
+end
@@ -0,0 +1,51 @@
+defmodule XMediaLib.CodecPoolTest do
+  use ExUnit.Case
+  alias XMediaLib.Codec
+
+  @desc {'GSM', 8000, 1}
+
+  test "prewarmed codecs are handed out and taken back" do
+    {:ok, pool} = Codec.Pool.start_link(prewarm: [{@desc, 2}])
+    assert %{@desc => 2} == Codec.Pool.idle(pool)
+
+    {:ok, codec} = Codec.Pool.checkout(pool, @desc)
+    assert %{@desc => 1} == Codec.Pool.idle(pool)
+
+    Codec.Pool.checkin(pool, codec)
+    assert %{@desc => 2} == Codec.Pool.idle(pool)
+  end
+
+  test "a returned codec behaves like a fresh one" do
+    {:ok, pool} = Codec.Pool.start_link(max_idle: 1)
+    gsm = File.read!("test/samples/gsm/sample-gsm-16-mono-8khz.raw")
+    frames = for <<frame::binary-size(33) <- gsm>>, do: frame
+    frames = Enum.take(frames, 5)
+
+    {:ok, fresh} = Codec.open(@desc)
+    {:ok, expected} = Codec.decode_frames(fresh, frames)
+
+    {:ok, codec} = Codec.Pool.checkout(pool, @desc)
+    {:ok, _} = Codec.decode_frames(codec, Enum.reverse(frames))
+    Codec.Pool.checkin(pool, codec)
+
+    {:ok, reused} = Codec.Pool.checkout(pool, @desc)
+    assert reused.state == codec.state
+    assert {:ok, expected} == Codec.decode_frames(reused, frames)
+  end
+
+  test "codecs only go back out with the options they were set up with" do
+    {:ok, pool} = Codec.Pool.start_link()
+
+    {:ok, vad} = Codec.Pool.checkout(pool, @desc, vad: true)
+    Codec.Pool.checkin(pool, vad)
+    assert %{@desc => 1} == Codec.Pool.idle(pool)
+
+    {:ok, plain} = Codec.Pool.checkout(pool, @desc)
+    assert plain.state != vad.state
+    assert %{@desc => 1} == Codec.Pool.idle(pool)
+
+    {:ok, reused} = Codec.Pool.checkout(pool, @desc, vad: true)
+    assert reused.state == vad.state
+    assert %{@desc => 0} == Codec.Pool.idle(pool)
+  end
+end
@@ -35,4 +35,18 @@ defmodule XMediaLib.CodecSpeexTest do
     Codec.close(codec)
     assert ret
   end
+
+  test "wideband and ultra-wideband keep their sample rate" do
+    for {sample_rate, samples} <- [{16000, 320}, {32000, 640}] do
+      pcm =
+        for i <- 0..(samples - 1),
+            into: <<>>,
+            do: <<round(8000 * :math.sin(2 * :math.pi() * 1000 * i / sample_rate))::native-signed-16>>
+
+      {:ok, codec} = Codec.open({'SPEEX', sample_rate, 1})
+      {:ok, payload} = Codec.encode(codec, {pcm, sample_rate, 1, 16})
+      assert {:ok, {decoded, ^sample_rate, 1, 16}} = Codec.decode(codec, payload)
+      assert byte_size(decoded) == byte_size(pcm)
+    end
+  end
 end
@@ -0,0 +1,40 @@
+defmodule XMediaLib.CodecVadTest do
+  use ExUnit.Case
+  alias XMediaLib.Codec
+
+  defp noise(amplitude),
+    do: for(_ <- 1..160, into: <<>>, do: <<:rand.uniform(2 * amplitude + 1) - amplitude - 1::native-signed-16>>)
+
+  defp tone(),
+    do: for(i <- 0..159, into: <<>>, do: <<round(8000 * :math.sin(i * 0.2))::native-signed-16>>)
+
+  test "silence is not encoded, comfort noise is sent instead" do
+    {:ok, codec} = Codec.open({'PCMU', 8000, 1}, vad: true)
+
+    assert {:ok, {:cn, <<level>>}} = Codec.encode(codec, {noise(50), 8000, 1, 16})
+    assert level in 50..80
+    assert {:ok, :silence} == Codec.encode(codec, {noise(50), 8000, 1, 16})
+
+    assert {:ok, payload} = Codec.encode(codec, {tone(), 8000, 1, 16})
+    assert byte_size(payload) == 160
+  end
+
+  test "encoding is untouched without vad" do
+    {:ok, codec} = Codec.open({'PCMU', 8000, 1})
+    assert {:ok, payload} = Codec.encode(codec, {noise(50), 8000, 1, 16})
+    assert byte_size(payload) == 160
+  end
+
+  test "comfort noise is played out at the signalled level" do
+    {:ok, codec} = Codec.open({'PCMU', 8000, 1})
+
+    {:ok, {pcm, 8000, 1, 16}} = Codec.comfort_noise(codec, <<40>>)
+    assert byte_size(pcm) == 320
+
+    {:ok, {pcm, 8000, 1, 16}} = Codec.comfort_noise(codec, <<>>)
+    samples = for <<s::native-signed-16 <- pcm>>, do: s
+    rms = :math.sqrt(Enum.sum(Enum.map(samples, &(&1 * &1))) / length(samples))
+    # -40 dBov is about 328
+    assert rms > 200 and rms < 500
+  end
+end
@@ -21,4 +21,21 @@ defmodule XMediaLib.CRC32CTest do
     str = for x <- 31..0, into: <<>>, do: <<x::8>>
     assert <<0x5C, 0xDB, 0x3F, 0x11>> = CRC32C.crc32c(str)
   end
+
+  test "iolists are checksummed in place" do
+    str = for x <- 0..31, into: <<>>, do: <<x::8>>
+    <<a::binary-size(5), b::binary-size(20), c::binary>> = str
+    assert CRC32C.crc32c(str) == CRC32C.crc32c([a, [b | c]])
+    assert CRC32C.crc32c(str) == CRC32C.crc32c(:binary.bin_to_list(str))
+  end
+
+  test "incremental update gives the same result as a single pass" do
+    str = for x <- 31..0, into: <<>>, do: <<x::8>>
+    <<a::binary-size(13), b::binary>> = str
+
+    ctx = CRC32C.new()
+    ctx = CRC32C.update(ctx, a)
+    ctx = CRC32C.update(ctx, [b])
+    assert <<0x5C, 0xDB, 0x3F, 0x11>> = CRC32C.final(ctx)
+  end
 end
@@ -0,0 +1,74 @@
+defmodule XMediaLib.JitterBufferTest do
+  use ExUnit.Case
+  alias XMediaLib.JitterBuffer
+
+  # 20 ms packets at 8 kHz, arriving on time
+  defp put(jb, seq), do: JitterBuffer.put(jb, seq, seq * 160, <<seq>>, seq * 20)
+
+  test "reorders packets and reports the missing ones" do
+    {:ok, jb} = JitterBuffer.new(8000, min_delay: 40)
+
+    for seq <- [0, 1, 3, 2, 4, 6, 7], do: assert(:ok == put(jb, seq))
+
+    assert {:ok, <<0>>, 0} == JitterBuffer.get(jb)
+    assert {:ok, <<1>>, 160} == JitterBuffer.get(jb)
+    assert {:ok, <<2>>, 320} == JitterBuffer.get(jb)
+    assert {:ok, <<3>>, 480} == JitterBuffer.get(jb)
+    assert {:ok, <<4>>, 640} == JitterBuffer.get(jb)
+    assert {:lost, 800} == JitterBuffer.get(jb)
+    assert {:ok, <<6>>, 960} == JitterBuffer.get(jb)
+  end
+
+  test "waits for the minimum delay before playing" do
+    {:ok, jb} = JitterBuffer.new(8000, min_delay: 60)
+
+    assert :empty == JitterBuffer.get(jb)
+    put(jb, 0)
+    put(jb, 1)
+    assert :empty == JitterBuffer.get(jb)
+    put(jb, 2)
+    assert {:ok, <<0>>, 0} == JitterBuffer.get(jb)
+  end
+
+  test "drops duplicates and packets already played out" do
+    {:ok, jb} = JitterBuffer.new(8000, min_delay: 20)
+
+    assert :ok == put(jb, 0)
+    assert :duplicate == put(jb, 0)
+    assert {:ok, <<0>>, 0} == JitterBuffer.get(jb)
+    assert :late == put(jb, 0)
+
+    stats = JitterBuffer.stats(jb)
+    assert stats[:received] == 1
+    assert stats[:late] == 1
+  end
+
+  test "a sequence number jump restarts the buffer" do
+    {:ok, jb} = JitterBuffer.new(8000, min_delay: 20)
+
+    put(jb, 0)
+    put(jb, 1)
+    assert :ok == JitterBuffer.put(jb, 5000, 90000, <<"new">>, 40)
+    assert {:ok, "new", 90000} == JitterBuffer.get(jb)
+  end
+
+  test "a backwards jump after playout has started restarts the buffer" do
+    {:ok, jb} = JitterBuffer.new(8000, min_delay: 20)
+
+    put(jb, 100)
+    assert {:ok, <<100>>, 16000} == JitterBuffer.get(jb)
+    assert :late == put(jb, 99)
+    assert :ok == JitterBuffer.put(jb, 40000, 1234, <<"new">>, 2020)
+    assert {:ok, "new", 1234} == JitterBuffer.get(jb)
+    assert :ok == JitterBuffer.put(jb, 40001, 1394, <<"next">>, 2040)
+  end
+
+  test "target depth grows with jitter" do
+    {:ok, jb} = JitterBuffer.new(8000, min_delay: 20, max_delay: 300)
+
+    for seq <- 0..99,
+        do: JitterBuffer.put(jb, seq, seq * 160, <<>>, seq * 20 + rem(seq * 37, 60))
+
+    assert JitterBuffer.stats(jb)[:target] > 20
+  end
+end
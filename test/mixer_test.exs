@@ -0,0 +1,41 @@
+defmodule XMediaLib.MixerTest do
+  use ExUnit.Case
+  alias XMediaLib.Mixer
+
+  defp frame(sample), do: for(_ <- 1..160, into: <<>>, do: <<sample::native-signed-16>>)
+
+  test "everyone hears everyone else" do
+    {:ok, mixer} = Mixer.new(8000, 1)
+
+    {:ok, full, outputs} = Mixer.mix(mixer, [{:a, frame(100)}, {:b, frame(-30)}, {:c, frame(7)}])
+
+    assert full == frame(77)
+    assert [{:a, frame(-23)}, {:b, frame(107)}, {:c, frame(70)}] == outputs
+  end
+
+  test "the mix saturates instead of wrapping" do
+    {:ok, mixer} = Mixer.new(8000, 1)
+
+    {:ok, full, [{:a, a}, {:b, b}, {:c, c}]} =
+      Mixer.mix(mixer, [{:a, frame(30000)}, {:b, frame(30000)}, {:c, frame(-30000)}])
+
+    assert full == frame(30000)
+    assert a == frame(0)
+    assert b == frame(0)
+    assert c == frame(32767)
+  end
+
+  test "mixed frames can be encoded directly" do
+    {:ok, mixer} = Mixer.new(8000, 1)
+    {:ok, codec} = XMediaLib.Codec.open({'PCMU', 8000, 1})
+
+    {:ok, _, [{:a, pcm}, _]} = Mixer.mix(mixer, [{:a, frame(1000)}, {:b, frame(2000)}])
+    assert {:ok, payload} = XMediaLib.Codec.encode(codec, pcm)
+    assert byte_size(payload) == 160
+  end
+
+  test "frames of the wrong size are refused" do
+    {:ok, mixer} = Mixer.new(8000, 1)
+    assert_raise ArgumentError, fn -> Mixer.mix(mixer, [{:a, <<0, 0>>}]) end
+  end
+end
@@ -0,0 +1,35 @@
+defmodule XMediaLib.ResamplerTest do
+  use ExUnit.Case
+  alias XMediaLib.Resampler
+
+  # 20 ms of a 440 Hz tone at 8 kHz, native endian
+  defp frame(n) do
+    for i <- (n * 160)..(n * 160 + 159), into: <<>> do
+      <<round(8000 * :math.sin(2 * :math.pi() * 440 * i / 8000))::native-signed-16>>
+    end
+  end
+
+  test "upsampling a stream from 8 kHz to 16 kHz" do
+    {:ok, resampler} = Resampler.new(16000, 1)
+
+    # The filter delay is padded, every 20 ms frame in is a 20 ms frame out
+    for n <- 0..49 do
+      {:ok, pcm} = Resampler.process(resampler, frame(n), 8000, 1)
+      assert byte_size(pcm) == 640
+    end
+  end
+
+  test "mono output from stereo input" do
+    {:ok, resampler} = Resampler.new(8000, 1)
+    mono = frame(0)
+    stereo = for <<s::binary-size(2) <- mono>>, into: <<>>, do: s <> s
+
+    {:ok, pcm} = Resampler.process(resampler, stereo, 8000, 2)
+    assert rem(byte_size(pcm), 2) == 0
+    assert byte_size(pcm) <= byte_size(mono)
+  end
+
+  test "unsupported channel count" do
+    assert {:error, :unsupported} = Resampler.new(8000, 6)
+  end
+end
@@ -0,0 +1,96 @@
+defmodule XMediaLib.RtpStatsTest do
+  use ExUnit.Case
+  alias XMediaLib.{Rtcp, RtpStats}
+  alias XMediaLib.Rtcp.{Rblock, Rr, Xr, Xrblock}
+
+  # 20 ms packets at 8 kHz starting near the sequence number wrap, arrival
+  # in microseconds
+  @first 65530
+  defp update(stats, n, delay \\ 0),
+    do: RtpStats.update(stats, rem(@first + n, 65536), n * 160, n * 20_000 + delay)
+
+  test "a new source is valid after two packets in sequence" do
+    {:ok, stats} = RtpStats.new(0x1234, 8000)
+
+    assert nil == RtpStats.rblock(stats, 0)
+    assert :invalid == update(stats, 0)
+    assert :ok == update(stats, 1)
+    assert %Rblock{ssrc: 0x1234, lost: 0, fraction: 0} = RtpStats.rblock(stats, 0)
+  end
+
+  test "loss, sequence number wrap and jitter" do
+    {:ok, stats} = RtpStats.new(0x1234, 8000)
+
+    for n <- 0..49, n not in [10, 11], do: update(stats, n)
+
+    # 49 packets expected since the source became valid, 2 of them lost
+    assert %Rblock{fraction: 10, lost: 2, last_seq: 65579, jitter: 0, lsr: 0, dlsr: 0} =
+             RtpStats.rblock(stats, 1_000_000)
+
+    # every other packet 5 ms late
+    for n <- 50..299, do: update(stats, n, rem(n, 2) * 5000)
+    RtpStats.sr_received(stats, 0x1122334455667788, 6_000_000)
+
+    assert %Rblock{fraction: 0, lost: 2, jitter: 39, lsr: 0x33445566, dlsr: 32768} =
+             RtpStats.rblock(stats, 6_500_000)
+
+    assert [received: 297, expected: 299, lost: 2, jitter: 4, last_seq: 65829, discarded: 0] ==
+             RtpStats.stats(stats)
+  end
+
+  test "report blocks are ready to encode" do
+    {:ok, a} = RtpStats.new(1, 8000)
+    {:ok, b} = RtpStats.new(2, 8000)
+
+    for n <- 0..9, do: update(a, n)
+
+    rr = RtpStats.rr(0x1234, [a, b], 0)
+    assert %Rr{ssrc: 0x1234, rblocks: [%Rblock{ssrc: 1, last_seq: 65539}]} = rr
+    assert {:ok, %Rtcp{payloads: [^rr]}} = Rtcp.decode(Rtcp.encode(%Rtcp{payloads: [rr]}))
+  end
+
+  test "VoIP metrics of a clean stream" do
+    {:ok, stats} = RtpStats.new(7, 8000)
+    for n <- 0..999, do: update(stats, n)
+
+    assert %Xrblock{type: 7, ts: 0, data: data} =
+             RtpStats.voip_metrics(stats, plc: :standard, jb_adaptive: true, jb_nominal: 40)
+
+    # no loss or discards, one 999 packet gap, R 93 and MOS 4.4
+    assert <<7::size(32), 0, 0, 0, 0, 0::size(16), 19980::size(16), 0::size(32), 127, 127, 127,
+             16, 93, 127, 44, 44, 0xF0, 0, 40::size(16), 0::size(32)>> == data
+
+    # half a second round trip costs conversational quality only
+    assert <<_::binary-size(24), 81, 127, 44, 40, _::binary>> =
+             RtpStats.voip_metrics(stats, round_trip: 400, end_system: 40).data
+
+    xr = %Xr{ssrc: 0x1234, xrblocks: [%Xrblock{type: 7, ts: 0, data: data}]}
+    assert {:ok, %Rtcp{payloads: [^xr]}} = Rtcp.decode(Rtcp.encode(%Rtcp{payloads: [xr]}))
+  end
+
+  test "VoIP metrics of isolated losses and bursts" do
+    {:ok, stats} = RtpStats.new(7, 8000)
+    for n <- 0..999, rem(n, 50) != 25, do: update(stats, n)
+
+    # 2 % loss, all of it in the gap
+    assert <<_::size(32), 5, 0, 0, 5, 0::size(16), 19980::size(16), _::size(64), 84, _, 42, 42,
+             _::binary>> = RtpStats.voip_metrics(stats, round_trip: 100, end_system: 40).data
+
+    {:ok, stats} = RtpStats.new(7, 8000)
+    for n <- 0..999, n not in 500..509 and n not in 700..704, do: update(stats, n)
+    RtpStats.discarded(stats, 3)
+
+    # two bursts of 10 and 5 packets, every packet in them lost
+    assert <<_::size(32), 3, 0, 255, 0, 170::size(16), _::binary>> =
+             RtpStats.voip_metrics(stats).data
+
+    assert RtpStats.stats(stats)[:discarded] == 3
+  end
+
+  test "round trip delay from a report block" do
+    # our SR went out at 0x1234.0000, was held 0.5 s and the RR came back at 0x1234.C000
+    block = %Rblock{lsr: 0x1234_0000, dlsr: 0x8000}
+    assert 250 == RtpStats.round_trip_delay(block, 0x1234_C000 * 65536)
+    assert nil == RtpStats.round_trip_delay(%Rblock{lsr: 0, dlsr: 0}, 0x1234_C000 * 65536)
+  end
+end
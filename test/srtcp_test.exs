@@ -21,4 +21,47 @@ defmodule XMediaLib.SrtcpTest do
   test "Simple pass-thru encrypting of the SRTP structure" do
     assert {:ok, @srtcp_sr_bin, :passthru} = Srtp.encrypt(@srtcp_sr, :passthru)
   end
+
+  # AES_CM_128_HMAC_SHA1_80 test vector shipped with libsrtp (SRTCP index 1)
+  @master_key <<0xE1F97A0D3E018BE0D64FA32C06DE4139::size(128)>>
+  @master_salt <<0x0EC675AD498AFEEBB6960B3AABE6::size(112)>>
+  @rtcp <<0x81C8000BCAFEBABE::size(64), 0xABABABABABABABABABABABABABABABAB::size(128)>>
+  @srtcp <<0x81C8000BCAFEBABE::size(64), 0x7128035BE487B9BDBEF89041F977A5A8::size(128),
+           0x80000001::size(32), 0x993E08CD54D6C1230798::size(80)>>
+
+  test "Native SRTCP unprotect" do
+    {:ok, ctx} =
+      Srtp.new_native_ctx(
+        SRTP_Encryption_AESCM,
+        SRTP_Authentication_Sha1_Hmac,
+        @master_key,
+        @master_salt,
+        10
+      )
+
+    assert {:ok, @rtcp} = Srtp.unprotect_rtcp(ctx, @srtcp)
+  end
+
+  test "Native SRTCP protect and unprotect" do
+    args = [SRTP_Encryption_AESCM, SRTP_Authentication_Sha1_Hmac, @master_key, @master_salt, 10]
+    {:ok, tx} = apply(Srtp, :new_native_ctx, args)
+    {:ok, rx} = apply(Srtp, :new_native_ctx, args)
+
+    {:ok, srtcp} = Srtp.protect_rtcp(tx, @rtcp)
+    assert byte_size(srtcp) == byte_size(@rtcp) + 4 + 10
+    assert {:ok, @rtcp} = Srtp.unprotect_rtcp(rx, srtcp)
+    assert {:error, :replayed} = Srtp.unprotect_rtcp(rx, srtcp)
+  end
+
+  test "Native SRTCP AEAD AES-GCM" do
+    salt = binary_part(@master_salt, 0, 12)
+    args = [SRTP_Encryption_AESGCM, SRTP_Authentication_Null, @master_key, salt, 16]
+    {:ok, tx} = apply(Srtp, :new_native_ctx, args)
+    {:ok, rx} = apply(Srtp, :new_native_ctx, args)
+
+    {:ok, srtcp} = Srtp.protect_rtcp(tx, @rtcp)
+    assert byte_size(srtcp) == byte_size(@rtcp) + 16 + 4
+    assert <<_::binary-size(40), 0x80000000::32>> = srtcp
+    assert {:ok, @rtcp} = Srtp.unprotect_rtcp(rx, srtcp)
+  end
 end
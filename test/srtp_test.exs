@@ -189,4 +189,149 @@ defmodule XMediaLib.SrtpTest do
 
     assert <<0x6B68642C59BBFC2F34DB60DBDFB2::size(112), _::binary>> = enc_part
   end
+
+  # AES_CM_128_HMAC_SHA1_80 test vector shipped with libsrtp
+  @native_rtp <<0x800F1234DECAFBADCAFEBABE::size(96), 0xABABABABABABABABABABABABABABABAB::size(128)>>
+  @native_srtp <<0x800F1234DECAFBADCAFEBABE::size(96), 0x4E55DC4CE79978D88CA4D215949D2402::size(128),
+                 0xB78D6ACC99EA179B8DBB::size(80)>>
+
+  test "Native AES-CM / HMAC-SHA1 protect" do
+    {:ok, ctx} =
+      Srtp.new_native_ctx(
+        SRTP_Encryption_AESCM,
+        SRTP_Authentication_Sha1_Hmac,
+        @master_key,
+        @master_salt,
+        10
+      )
+
+    assert {:ok, @native_srtp} = Srtp.protect(ctx, @native_rtp)
+  end
+
+  test "Native AES-CM / HMAC-SHA1 unprotect" do
+    {:ok, ctx} =
+      Srtp.new_native_ctx(
+        SRTP_Encryption_AESCM,
+        SRTP_Authentication_Sha1_Hmac,
+        @master_key,
+        @master_salt,
+        10
+      )
+
+    # a forgery must not take the sequence number from the real packet
+    <<head::binary-size(20), byte, rest::binary>> = @native_srtp
+    assert {:error, :auth_failed} = Srtp.unprotect(ctx, <<head::binary, byte + 1, rest::binary>>)
+
+    assert {:ok, @native_rtp} = Srtp.unprotect(ctx, @native_srtp)
+    assert {:error, :replayed} = Srtp.unprotect(ctx, @native_srtp)
+  end
+
+  test "Native AEAD AES-GCM protect and unprotect" do
+    for master_key <- [@master_key, @master_key <> @master_key] do
+      salt = binary_part(@master_salt, 0, 12)
+      args = [SRTP_Encryption_AESGCM, SRTP_Authentication_Null, master_key, salt, 16]
+      {:ok, tx} = apply(Srtp, :new_native_ctx, args)
+      {:ok, rx} = apply(Srtp, :new_native_ctx, args)
+
+      {:ok, srtp} = Srtp.protect(tx, @native_rtp)
+      assert byte_size(srtp) == byte_size(@native_rtp) + 16
+      assert binary_part(srtp, 12, 16) != binary_part(@native_rtp, 12, 16)
+
+      <<head::binary-size(20), byte, rest::binary>> = srtp
+      assert {:error, :auth_failed} = Srtp.unprotect(rx, <<head::binary, byte + 1, rest::binary>>)
+      assert {:ok, @native_rtp} = Srtp.unprotect(rx, srtp)
+    end
+  end
+
+  test "AES-GCM authenticates by itself" do
+    assert {:error, :unsupported} =
+             Srtp.new_native_ctx(
+               SRTP_Encryption_AESGCM,
+               SRTP_Authentication_Sha1_Hmac,
+               @master_key,
+               binary_part(@master_salt, 0, 12),
+               16
+             )
+  end
+
+  test "Skein-512 MAC" do
+    # unkeyed it is plain Skein-512-512
+    assert Base.decode16!(
+             "BC5B4C50925519C290CC634277AE3D6257212395CBA733BBAD37A4AF0FA06AF4" <>
+               "1FCA7903D06564FEA7A2D3730DBDB80C1F85562DFCC070334EA4D1D9E72CBA7A"
+           ) == Srtp.skein_mac(<<>>, <<>>, <<>>, 64)
+
+    mac = Srtp.new_skein_mac(@master_key, 4)
+    tag = Srtp.skein_mac(mac, @native_rtp, <<0::size(32)>>)
+    assert byte_size(tag) == 4
+    assert tag == Srtp.skein_mac(@master_key, @native_rtp <> <<0::size(32)>>, <<>>, 4)
+
+    data = Srtp.append_auth(@native_rtp, <<0::size(32)>>, SRTP_Authentication_Skein_Hmac, mac, 4)
+    assert data == @native_rtp <> tag
+
+    assert @native_rtp ==
+             Srtp.check_auth(data, <<0::size(32)>>, SRTP_Authentication_Skein_Hmac, @master_key, 4)
+  end
+
+  test "Native AES-CM / Skein-MAC protect and unprotect" do
+    for tag_length <- [4, 8] do
+      args = [
+        SRTP_Encryption_AESCM,
+        SRTP_Authentication_Skein_Hmac,
+        @master_key,
+        @master_salt,
+        tag_length
+      ]
+
+      {:ok, tx} = apply(Srtp, :new_native_ctx, args)
+      {:ok, rx} = apply(Srtp, :new_native_ctx, args)
+
+      {:ok, srtp} = Srtp.protect(tx, @native_rtp)
+      assert byte_size(srtp) == byte_size(@native_rtp) + tag_length
+
+      <<head::binary-size(20), byte, rest::binary>> = srtp
+      assert {:error, :auth_failed} = Srtp.unprotect(rx, <<head::binary, byte + 1, rest::binary>>)
+      assert {:ok, @native_rtp} = Srtp.unprotect(rx, srtp)
+    end
+  end
+
+  test "Native batch protect and unprotect" do
+    new = fn ->
+      {:ok, ctx} =
+        Srtp.new_native_ctx(
+          SRTP_Encryption_AESCM,
+          SRTP_Authentication_Sha1_Hmac,
+          @master_key,
+          @master_salt,
+          10
+        )
+
+      ctx
+    end
+
+    [tx1, tx2, rx1, rx2] = for _ <- 1..4, do: new.()
+
+    packets =
+      for seq <- 0..9 do
+        payload = :binary.copy(<<seq>>, 16 + 13 * seq)
+        <<0x800F::size(16), seq::size(16), 0xDECAFBADCAFEBABE::size(64), payload::binary>>
+      end
+
+    # two streams interleaved, each must match packet by packet protection
+    batch = Enum.flat_map(packets, &[{tx1, &1}, {tx2, &1}])
+    results = Srtp.protect_batch(batch)
+    assert results == Enum.map(batch, fn {ctx, rtp} -> Srtp.protect(ctx, rtp) end)
+
+    srtps = for {:ok, srtp} <- Enum.take_every(results, 2), do: srtp
+
+    # the copy of the first packet is a replay within the batch
+    assert [{:ok, first}, {:error, :replayed} | rest] =
+             Srtp.unprotect_batch(Enum.map([hd(srtps) | srtps], &{rx1, &1}))
+
+    assert [first | Enum.map(rest, fn {:ok, rtp} -> rtp end)] == packets
+
+    # a malformed entry fails the whole batch before any context moves
+    assert_raise ArgumentError, fn -> Srtp.unprotect_batch([{rx2, hd(srtps)}, :junk]) end
+    assert {:ok, hd(packets)} == Srtp.unprotect(rx2, hd(srtps))
+  end
 end
@@ -219,6 +219,55 @@ defmodule XMediaLib.StunTest do
     assert @req_auth_bin = Stun.encode(@req_auth)
   end
 
+  test "Scanning leaves attribute values as they are on the wire" do
+    assert {:ok,
+            %{
+              class: :request,
+              method: :binding,
+              fingerprint: true,
+              integrity: true,
+              attrs: [
+                {0x8022, "STUN test client"},
+                {0x0024, <<110, 0, 1, 255>>},
+                {0x8029, <<147, 47, 249, 177, 81, 38, 59, 54>>},
+                {0x0006, "evtj:h6vY"}
+              ]
+            }} = Stun.scan(@req_bin, @password)
+  end
+
+  test "Scanning rejects a damaged FINGERPRINT or MESSAGE-INTEGRITY" do
+    <<head::binary-size(24), byte, rest::binary>> = @req_bin
+    damaged = <<head::binary, bxor(byte, 1), rest::binary>>
+
+    assert {:error, :bad_fingerprint} = Stun.scan(damaged)
+    assert {:error, :auth_failed} = Stun.scan(damaged, @password)
+    assert {:error, :auth_failed} = Stun.decode(@req_bin, "wrong password")
+    assert {:error, :bad_packet} = Stun.scan(binary_part(@req_bin, 0, byte_size(@req_bin) - 2))
+  end
+
+  test "Scanning cuts short what the header or an attribute overstates" do
+    request = <<0, 1, 0, 8, 33, 18, 164, 66, 0, 146, 225, 0, 61, 62, 163, 87, 45, 150, 223, 8>>
+
+    # header length 12 for 8 bytes of attributes, PRIORITY claims 8 bytes for 4
+    assert {:ok, %{attrs: [{0x0024, <<110, 0, 1, 255>>}]}} =
+             Stun.scan(<<request::binary, 0, 36, 0, 4, 110, 0, 1, 255>> |> put_length(12))
+
+    assert {:ok, %{attrs: [{0x0024, <<110, 0, 1, 255>>}]}} =
+             Stun.scan(<<request::binary, 0, 36, 0, 8, 110, 0, 1, 255>>)
+
+    assert {:ok, %Stun{attrs: %{priority: _}}} =
+             Stun.decode(<<request::binary, 0, 36, 0, 8, 110, 0, 1, 255>>)
+  end
+
+  test "MESSAGE-INTEGRITY holds for more credentials than are cached" do
+    keys = for i <- 1..1100, do: "credential #{i}"
+
+    for key <- keys ++ Enum.take(keys, 10) do
+      stun = %Stun{@req_auth | key: key}
+      assert {:ok, %Stun{integrity: true}} = stun |> Stun.encode() |> Stun.decode(key)
+    end
+  end
+
   @google_request <<0x00, 0x03, 0x00, 0x74, 0x21, 0x12, 0xA4, 0x42, 0x73, 0x79, 0x33, 0x73, 0x68,
                     0x5A, 0x4B, 0x7A, 0x4E, 0x64, 0x4E, 0x55, 0x00, 0x19, 0x00, 0x04, 0x11, 0x00,
                     0x00, 0x00, 0x00, 0x06, 0x00, 0x22, 0x43, 0x4E, 0x54, 0x6F, 0x33, 0x4F, 0x6B,
@@ -309,7 +358,8 @@ defmodule XMediaLib.StunTest do
                 xor_peer_address: {{185, 136, 233, 160}, 58299}
               },
               class: :indication,
-              fingerprint: true,
+              # the FINGERPRINT at the end belongs to the message inside DATA
+              fingerprint: false,
               integrity: false,
               key: nil,
               method: :send,
@@ -399,4 +449,7 @@ defmodule XMediaLib.StunTest do
       )
     end)
   end
+
+  defp put_length(<<head::binary-size(2), _::size(16), rest::binary>>, length),
+    do: <<head::binary, length::size(16), rest::binary>>
 end
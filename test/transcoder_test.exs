@@ -0,0 +1,62 @@
+defmodule XMediaLib.TranscoderTest do
+  use ExUnit.Case
+  alias XMediaLib.{Codec, Transcoder}
+
+  test "GSM to PCMU matches decoding and encoding separately" do
+    gsm = File.read!("test/samples/gsm/sample-gsm-16-mono-8khz.raw")
+    frames = for <<frame::binary-size(33) <- gsm>>, do: frame
+    frames = Enum.take(frames, 20)
+
+    {:ok, decoder} = Codec.open({'GSM', 8000, 1})
+    {:ok, encoder} = Codec.open({'PCMU', 8000, 1})
+    {:ok, transcoder} = Transcoder.new({'GSM', 8000, 1}, {'PCMU', 8000, 1})
+
+    Enum.each(frames, fn frame ->
+      {:ok, pcm} = Codec.decode(decoder, frame)
+      {:ok, expected} = Codec.encode(encoder, pcm)
+      assert {:ok, expected} == Transcoder.transcode(transcoder, frame)
+    end)
+  end
+
+  test "PCMA to PCMU is a straight table lookup" do
+    alaw = File.read!("test/samples/pcma/raw-alaw.raw")
+    {:ok, transcoder} = Transcoder.new({'PCMA', 8000, 1}, {'PCMU', 8000, 1})
+    assert Codec.transcode(alaw, 'PCMA', 'PCMU') == Transcoder.transcode(transcoder, alaw)
+  end
+
+  test "rate conversion happens in between" do
+    g729 = File.read!("test/samples/g729/default_en.g729")
+    <<frame::binary-size(20), _::binary>> = g729
+    {:ok, transcoder} = Transcoder.new({'G729', 8000, 1}, {'PCMU', 16000, 2})
+    {:ok, payload} = Transcoder.transcode(transcoder, frame)
+    # 20 ms at 16 kHz stereo
+    assert byte_size(payload) == 640
+  end
+
+  test "only whole target frames are encoded" do
+    g729 = File.read!("test/samples/g729/default_en.g729")
+    <<f1::binary-size(10), f2::binary-size(10), f3::binary-size(30), _::binary>> = g729
+    {:ok, transcoder} = Transcoder.new({'G729', 8000, 1}, {'GSM', 8000, 1})
+
+    # 10 ms frames into 20 ms GSM frames, the remainder waits
+    assert {:ok, <<>>} == Transcoder.transcode(transcoder, f1)
+    assert {:ok, gsm} = Transcoder.transcode(transcoder, f2)
+    assert byte_size(gsm) == 33
+    assert {:ok, gsm} = Transcoder.transcode(transcoder, f3)
+    assert byte_size(gsm) == 33
+    assert {:ok, gsm} = Transcoder.transcode(transcoder, f1)
+    assert byte_size(gsm) == 33
+  end
+
+  test "the first packet into 48 kHz Opus is a whole frame" do
+    g729 = File.read!("test/samples/g729/default_en.g729")
+    <<frame::binary-size(20), _::binary>> = g729
+    {:ok, transcoder} = Transcoder.new({'G729', 8000, 1}, {'OPUS', 48000, 1})
+    assert {:ok, opus} = Transcoder.transcode(transcoder, frame)
+    assert byte_size(opus) > 0
+  end
+
+  test "unknown formats are refused" do
+    assert {:error, :unsupported} == Transcoder.new({'NOPE', 8000, 1}, {'PCMU', 8000, 1})
+  end
+end